@@ -0,0 +1,670 @@
+/* The interpreter, compiled once per CPU variant so that the differences
+ * between them are settled by the preprocessor instead of on every
+ * instruction. The including file defines
+ *   ENGINE         variant name, the engine is exported as cpu_ENGINE
+ *   ENGINE_NAME    name to select it by
+ *   ENGINE_TABLE   its decoding table
+ *   ENGINE_CYCLES  its base cycles
+ *   ENGINE_ADC, ENGINE_SBC  alu.h functions for ADC and SBC, which decide
+ *                  whether there is a decimal mode
+ *   ENGINE_CMOS    1 for the 65C02 instructions, modes and fixes, 0 for the
+ *                  NMOS ones including the undocumented opcodes
+ * and includes this twice, with ENGINE_BUS 0 and then 1.
+ *
+ * The first pass is the fast engine: cycles come from ENGINE_CYCLES and
+ * only the logical accesses of an instruction reach the bus. The second
+ * pass, exec_bus of the variant, steps one clock at a time: every cycle
+ * is one bus access done by bus_read() or bus_write(), including the
+ * dummy reads, the double write of read-modify-write instructions and the
+ * extra reads of page crossings and taken branches, and every cycle runs
+ * due device events and the machine's cycle hook. Instructions the bus
+ * model doesn't spell out cycle by cycle are padded to ENGINE_CYCLES with
+ * idle cycles. */
+
+#ifndef ENGINE_COMMON_
+#define ENGINE_COMMON_
+
+#include <emu6502/cpu.h>
+#include <emu6502/alu.h>
+#include <emu6502/memory.h>
+#include <emu6502/machine.h>
+#include <emu6502/decoding.h>
+#include <emu6502/args.h>
+#include <emu6502/stats.h>
+#include <emu6502/perf.h>
+#include <emu6502/hle.h>
+#include <stdio.h>
+
+#define BRK_VECTOR 0xfffe
+
+#define reg cpu_reg
+
+#define ENGINE_CAT_(a, b) a##b
+#define ENGINE_CAT(a, b) ENGINE_CAT_(a, b)
+
+typedef union mem_val {
+    uint16_t w;
+    uint8_t b;
+} mem_val_t;
+
+/* how an instruction uses its operand, which decides the dummy cycles */
+enum bus_access { BUS_READ, BUS_WRITE, BUS_RMW };
+
+static void cpu_illegal(uint8_t opcode) {
+    STAT_INC(illegal);
+    if(current_machine->flags & MACHINE_TRAP_ILLEGAL)
+        cpu_halt = HALT_ILLEGAL;
+    else if(current_machine->flags & MACHINE_STDIO)
+        fprintf(stderr, "[Error] Illegal opcode $%02x\n", opcode);
+}
+
+static enum bus_access bus_access(enum instr_type type) {
+    switch(type) {
+    case OP_STA: case OP_STX: case OP_STY: case OP_STZ:
+    case OP_SAX: case OP_SHA: case OP_SHX: case OP_SHY: case OP_TAS:
+        return BUS_WRITE;
+    case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR:
+#if ENGINE_CMOS
+        /* the 65C02 shifts only pay for indexing when the page changes */
+        return BUS_READ;
+#endif
+    case OP_INC: case OP_DEC: case OP_SLO: case OP_RLA: case OP_SRE:
+    case OP_RRA: case OP_DCP: case OP_ISC: case OP_TSB: case OP_TRB:
+    case OP_RMB: case OP_SMB:
+        return BUS_RMW;
+    default:
+        return BUS_READ;
+    }
+}
+
+/* one clock cycle: device events that are due, then the hook */
+static inline void bus_tick(machine_t *m) {
+    m->cycles++;
+    if(m->cycles >= m->next_event) memory_sync_due();
+    if(m->cycle_hook) m->cycle_hook(m->cycle_data, m->cycles);
+}
+
+static inline uint8_t bus_read(uint16_t addr) {
+    bus_tick(current_machine);
+    return memory_read(addr);
+}
+
+static inline void bus_write(uint16_t addr, uint8_t val) {
+    bus_tick(current_machine);
+    memory_write(addr, val);
+}
+
+static inline uint16_t bus_read_w(uint16_t addr) {
+    uint8_t l = bus_read(addr);
+    return l | bus_read(addr+1)<<8;
+}
+
+static inline uint16_t bus_read_zp_w(uint8_t addr) {
+    uint8_t l = bus_read(addr);
+    return l | bus_read((uint8_t)(addr+1))<<8;
+}
+
+static inline uint16_t bus_read_w_page(uint16_t addr) {
+    uint8_t l = bus_read(addr);
+    return l | bus_read((addr&0xff00) | (uint8_t)(addr+1))<<8;
+}
+
+#endif /* ENGINE_COMMON_ */
+
+#if ENGINE_BUS
+#define ENGINE_FN(f)  ENGINE_CAT(f, _bus)
+#define READ(a)       bus_read(a)
+#define WRITE(a, v)   bus_write((a), (v))
+#define READ_W(a)     bus_read_w(a)
+#define READ_ZP_W(a)  bus_read_zp_w(a)
+#define READ_W_PAGE(a) bus_read_w_page(a)
+#define DUMMY(a)      (void)bus_read(a)
+#else
+#define ENGINE_FN(f)  f
+#define READ(a)       memory_read(a)
+#define WRITE(a, v)   memory_write((a), (v))
+#define READ_W(a)     memory_read_w(a)
+#define READ_ZP_W(a)  memory_read_zp_w(a)
+#define READ_W_PAGE(a) memory_read_w_page(a)
+#define DUMMY(a)      ((void)0)
+#endif
+#define PUSH(v)       WRITE(0x100 + (uint8_t)(reg.s--), (v))
+#define PULL()        READ(0x100 + (uint8_t)(++reg.s))
+
+#if ENGINE_BUS
+/* Indexing reads from the address before the carry into the high byte
+ * is fixed, the 65C02 rereads the last operand byte instead. Reads only
+ * pay for it when the page changes. */
+static inline void ENGINE_FN(cpu_index_dummy)(uint16_t base, uint16_t addr,
+                                              enum bus_access access) {
+    if(access == BUS_READ && !((base ^ addr) & 0xff00)) return;
+#if ENGINE_CMOS
+    DUMMY(reg.pc-1);
+#else
+    DUMMY((base & 0xff00) | (addr & 0xff));
+#endif
+}
+#define INDEX(base, addr) ENGINE_FN(cpu_index_dummy)((base), (addr), access)
+#else
+#define INDEX(base, addr) ((void)0)
+#endif
+
+static void ENGINE_FN(cpu_mode_get_addr)(mem_val_t *v,
+                                         enum instr_address_mode mode,
+                                         enum bus_access access) {
+    uint16_t base;
+    (void)access, (void)base;
+    switch(mode) {
+    default:
+    case MODE_ACCUMULATOR:
+    case MODE_IMPLIED:
+        /* the byte after the opcode is read and ignored */
+        DUMMY(reg.pc);
+        return;
+
+    case MODE_IMMEDIATE:
+        v->b = READ(reg.pc++);
+        break;
+
+    case MODE_ABSOLUTE:
+        v->w = READ_W(reg.pc), reg.pc += 2;
+        break;
+
+    case MODE_ZERO_PAGE:
+        v->w = READ(reg.pc++);
+        break;
+
+    case MODE_RELATIVE:
+        /* relative PC on the next instruction */
+        v->w = reg.pc+1 + (int8_t)READ(reg.pc), reg.pc++;
+        break;
+
+    case MODE_ABSOLUTE_INDIRECT:
+        base = READ_W(reg.pc), reg.pc += 2;
+#if ENGINE_CMOS
+        v->w = READ_W(base);
+#else
+        /* JMP ($12ff) takes the high byte from $1200 */
+        v->w = READ_W_PAGE(base);
+#endif
+        break;
+
+    case MODE_ABSOLUTE_X:
+        base = READ_W(reg.pc), reg.pc += 2;
+        v->w = base + reg.x;
+        INDEX(base, v->w);
+        break;
+
+    case MODE_ABSOLUTE_Y:
+        base = READ_W(reg.pc), reg.pc += 2;
+        v->w = base + reg.y;
+        INDEX(base, v->w);
+        break;
+
+    case MODE_ZERO_PAGE_X:
+        v->w = READ(reg.pc++);
+        DUMMY(v->w);
+        v->w = (uint8_t)(v->w + reg.x);
+        break;
+
+    case MODE_ZERO_PAGE_Y:
+        v->w = READ(reg.pc++);
+        DUMMY(v->w);
+        v->w = (uint8_t)(v->w + reg.y);
+        break;
+
+    case MODE_ZERO_PAGE_INDIRECT_X:
+        v->w = READ(reg.pc++);
+        DUMMY(v->w);
+        v->w = READ_ZP_W(v->w + reg.x);
+        break;
+
+    case MODE_ZERO_PAGE_INDIRECT_Y:
+        base = READ_ZP_W(READ(reg.pc++));
+        v->w = base + reg.y;
+        INDEX(base, v->w);
+        break;
+
+#if ENGINE_CMOS
+    case MODE_ZERO_PAGE_INDIRECT:
+        v->w = READ_ZP_W(READ(reg.pc++));
+        break;
+
+    case MODE_ABSOLUTE_INDIRECT_X:
+        base = READ_W(reg.pc), reg.pc += 2;
+        DUMMY(reg.pc-1);
+        v->w = READ_W(base + reg.x);
+        break;
+
+    /* leaves pc on the branch offset */
+    case MODE_ZERO_PAGE_RELATIVE:
+        v->w = READ(reg.pc++);
+        break;
+#endif
+    }
+
+    if(cmd_options.verbose >= 2) {
+        if(mode == MODE_IMMEDIATE)
+            printf("read value: $%02x\n", v->b);
+        else
+            printf("read address: $%04x\n", v->w);
+    }
+}
+
+static void ENGINE_FN(cpu_mode_get_value)(mem_val_t *v,
+                                          enum instr_address_mode mode) {
+    switch(mode) {
+    case MODE_ACCUMULATOR:
+        v->b = reg.a;
+        break;
+
+    case MODE_IMPLIED:
+        fprintf(stderr, "[Error] Trying to get the value of an implied"
+                " argument\n");
+        break;
+
+    case MODE_IMMEDIATE:
+        break;
+
+    case MODE_ABSOLUTE_INDIRECT:
+        fprintf(stderr, "[Error] Trying to get the value of an absolute"
+                " indirect argument\n");
+        break;
+
+    default:
+        v->b = READ(v->w);
+        if(cmd_options.verbose >= 2)
+            printf("read value: $%02x\n", v->b);
+        break;
+    }
+}
+
+static void ENGINE_FN(cpu_mode_set_value)(mem_val_t *v,
+                                          enum instr_address_mode mode,
+                                          uint8_t val) {
+    switch(mode) {
+    case MODE_ACCUMULATOR:
+        alu_load(&reg.a, val);
+        break;
+
+    case MODE_IMPLIED:
+        fprintf(stderr, "[Error] Trying to write to an implied argument\n");
+        break;
+
+    case MODE_IMMEDIATE:
+        fprintf(stderr, "[Error] Trying to set immediate value\n");
+        break;
+
+    case MODE_ABSOLUTE_INDIRECT:
+        fprintf(stderr, "[Error] Trying to set absolute indirect value\n");
+        break;
+
+    default:
+        WRITE(v->w, val);
+        if(cmd_options.verbose >= 2)
+            printf("wrote value to address: $%02x -> $%04x\n", val, v->w);
+        break;
+    }
+}
+
+#if ENGINE_BUS
+static void ENGINE_CAT(cpu_bus_exec_, ENGINE)(uint8_t opcode) {
+    machine_t *m = current_machine;
+    uint64_t start = m->cycles;
+    enum bus_access access = bus_access(ENGINE_TABLE[opcode].type);
+#else
+static void ENGINE_CAT(cpu_exec_, ENGINE)(uint8_t opcode) {
+    enum bus_access access = BUS_READ;
+#endif
+    const instr_t *instr = &ENGINE_TABLE[opcode];
+    mem_val_t v, tmp;
+
+#if ENGINE_BUS
+    /* the opcode fetch */
+    bus_tick(m);
+#else
+    current_machine->cycles += ENGINE_CYCLES[opcode];
+    STAT_ADD(cycles, ENGINE_CYCLES[opcode]);
+#endif
+    STAT_INC(instructions);
+    PERF_NOTE(opcode);
+
+    if(cmd_options.verbose >= 2)
+        printf("-----\n$%04x: %s %s\n", reg.pc-1,
+               instr_type_str(instr->type), instr_mode_str(instr->mode));
+
+#if ENGINE_BUS
+    /* JSR reads the high byte of its target after the pushes, the one
+     * cycle NOPs of the 65C02 read nothing after the opcode */
+    if(instr->type != OP_JSR && ENGINE_CYCLES[opcode] > 1)
+#endif
+    ENGINE_FN(cpu_mode_get_addr)(&v, instr->mode, access);
+
+#define GETVAL()    ENGINE_FN(cpu_mode_get_value)(&v, instr->mode)
+#define GETTMPVAL() tmp.w = v.w, ENGINE_FN(cpu_mode_get_value)(&tmp, instr->mode)
+#define SETVAL(val) ENGINE_FN(cpu_mode_set_value)(&v, instr->mode, val)
+/* the write of the unchanged value, a read on the 65C02 */
+#if !ENGINE_BUS
+#define RMW_DUMMY(addr, val) ((void)0)
+#elif ENGINE_CMOS
+#define RMW_DUMMY(addr, val) \
+        (instr->mode == MODE_ACCUMULATOR ? (void)0 : DUMMY(addr))
+#else
+#define RMW_DUMMY(addr, val) \
+        (instr->mode == MODE_ACCUMULATOR ? (void)0 : WRITE((addr), (val)))
+#endif
+/* stores leave the flags alone, read-modify-writes set N and Z */
+#define SETNZ(val)  tmp.b = (val), SETVAL(tmp.b), alu_nz(tmp.b)
+#define MODVAL(op)  tmp.w = v.w, ENGINE_FN(cpu_mode_get_value)(&v, instr->mode), \
+        RMW_DUMMY(tmp.w, v.b), v.b = (op), \
+        ENGINE_FN(cpu_mode_set_value)(&tmp, instr->mode, v.b), alu_nz(v.b)
+/* store to memory without touching flags, the result stays in tmp.b */
+#define RMW(op)     GETTMPVAL(), RMW_DUMMY(v.w, tmp.b), tmp.b = (op), \
+        WRITE(v.w, tmp.b)
+/* a taken branch reads the next opcode, and again when crossing pages */
+#if ENGINE_BUS
+#define BRANCH(cond) if(cond) {                                  \
+            DUMMY(reg.pc);                                     \
+            if((reg.pc ^ v.w) & 0xff00)                        \
+                DUMMY((reg.pc & 0xff00) | (v.w & 0xff));       \
+            reg.pc = v.w;                                      \
+        }
+#else
+#define BRANCH(cond) if(cond) reg.pc = v.w
+#endif
+/* the 65C02 takes a cycle longer in decimal mode to get N and Z right */
+#if !ENGINE_CMOS
+#define DECIMAL_CYCLE() ((void)0)
+#elif ENGINE_BUS
+#define DECIMAL_CYCLE() if(HAS_FLAG(FLAGS_DECIMAL)) bus_tick(m)
+#else
+#define DECIMAL_CYCLE() if(HAS_FLAG(FLAGS_DECIMAL)) {            \
+            current_machine->cycles++;                         \
+            STAT_INC(cycles);                                  \
+        }
+#endif
+/* high byte of the indexed base address plus one, for SHA and friends */
+#define HIGH1(i)    (uint8_t)(((uint16_t)(v.w - (i)) >> 8) + 1)
+#define BIT_N()     (1 << (opcode>>4 & 7))
+    switch(instr->type) {
+    default:
+        cpu_illegal(opcode);
+        break;
+
+    /* trapped routine, see hle.c */
+    case OP_HLE:
+        if(hle_trap()) break;
+#if ENGINE_CMOS
+        /* NOP # */
+        reg.pc++;
+#else
+        cpu_illegal(opcode);
+#endif
+        break;
+
+    /* load and store */
+    case OP_LDA: GETVAL(); alu_load(&reg.a, v.b); break;
+    case OP_LDX: GETVAL(); alu_load(&reg.x, v.b); break;
+    case OP_LDY: GETVAL(); alu_load(&reg.y, v.b); break;
+
+    case OP_STA: SETVAL(reg.a); break;
+    case OP_STX: SETVAL(reg.x); break;
+    case OP_STY: SETVAL(reg.y); break;
+
+    /* arithmetic */
+    case OP_ADC: GETVAL(); ENGINE_ADC(v.b); DECIMAL_CYCLE(); break;
+    case OP_SBC: GETVAL(); ENGINE_SBC(v.b); DECIMAL_CYCLE(); break;
+
+    /* increment and decrement */
+    case OP_INC: MODVAL(v.b+1); break;
+    case OP_INX: alu_load(&reg.x, reg.x+1); break;
+    case OP_INY: alu_load(&reg.y, reg.y+1); break;
+
+    case OP_DEC: MODVAL(v.b-1); break;
+    case OP_DEX: alu_load(&reg.x, reg.x-1); break;
+    case OP_DEY: alu_load(&reg.y, reg.y-1); break;
+
+    /* shift and rotate */
+    case OP_ASL: GETTMPVAL(); RMW_DUMMY(v.w, tmp.b); SETNZ(alu_asl(tmp.b));
+        break;
+    case OP_LSR: GETTMPVAL(); RMW_DUMMY(v.w, tmp.b); SETNZ(alu_lsr(tmp.b));
+        break;
+    case OP_ROL: GETTMPVAL(); RMW_DUMMY(v.w, tmp.b); SETNZ(alu_rol(tmp.b));
+        break;
+    case OP_ROR: GETTMPVAL(); RMW_DUMMY(v.w, tmp.b); SETNZ(alu_ror(tmp.b));
+        break;
+
+    /* logic */
+    case OP_AND: GETVAL(); alu_load(&reg.a, reg.a&v.b); break;
+    case OP_ORA: GETVAL(); alu_load(&reg.a, reg.a|v.b); break;
+    case OP_EOR: GETVAL(); alu_load(&reg.a, reg.a^v.b); break;
+
+    /* compare and test bit */
+    case OP_CMP: GETVAL(); alu_compare(reg.a, v.b); break;
+    case OP_CPX: GETVAL(); alu_compare(reg.x, v.b); break;
+    case OP_CPY: GETVAL(); alu_compare(reg.y, v.b); break;
+    case OP_BIT:
+        GETVAL();
+#if ENGINE_CMOS
+        /* BIT # only sets Z */
+        if(instr->mode == MODE_IMMEDIATE) {
+            CONDITIONAL_FLAG(!(v.b&reg.a), FLAGS_ZERO);
+            break;
+        }
+#endif
+        alu_bit(v.b);
+        break;
+
+    /* branch */
+    case OP_BCC: BRANCH(!HAS_FLAG(FLAGS_CARRY)); break;
+    case OP_BCS: BRANCH(HAS_FLAG(FLAGS_CARRY)); break;
+    case OP_BNE: BRANCH(!HAS_FLAG(FLAGS_ZERO)); break;
+    case OP_BEQ: BRANCH(HAS_FLAG(FLAGS_ZERO)); break;
+    case OP_BPL: BRANCH(!HAS_FLAG(FLAGS_NEGATIVE)); break;
+    case OP_BMI: BRANCH(HAS_FLAG(FLAGS_NEGATIVE)); break;
+    case OP_BVC: BRANCH(!HAS_FLAG(FLAGS_OVERFLOW)); break;
+    case OP_BVS: BRANCH(HAS_FLAG(FLAGS_OVERFLOW)); break;
+
+    /* transfer */
+    case OP_TAX: alu_load(&reg.x, reg.a); break;
+    case OP_TXA: alu_load(&reg.a, reg.x); break;
+    case OP_TAY: alu_load(&reg.y, reg.a); break;
+    case OP_TYA: alu_load(&reg.a, reg.y); break;
+    case OP_TSX: alu_load(&reg.x, reg.s); break;
+    /* NOTE: TXS does not set any flags */
+    case OP_TXS: reg.s = reg.x; break;
+
+    /* stack */
+    /* pulls first read the stack while S is incremented */
+    case OP_PHA: PUSH(reg.a); break;
+    case OP_PLA: DUMMY(0x100 + reg.s); alu_load(&reg.a, PULL()); break;
+    case OP_PHP: PUSH(reg.p); break;
+    case OP_PLP: DUMMY(0x100 + reg.s); reg.p = PULL(); break;
+
+    /* subroutines and jump */
+    case OP_JMP: reg.pc = v.w; break;
+    case OP_JSR:
+#if ENGINE_BUS
+        tmp.b = READ(reg.pc++);
+        DUMMY(0x100 + reg.s);
+        PUSH(reg.pc >> 8);
+        PUSH(reg.pc & 0xff);
+        v.w = tmp.b | READ(reg.pc)<<8;
+#else
+        /* pushes the address of its last byte */
+        PUSH((reg.pc-1) >> 8);
+        PUSH((reg.pc-1) & 0xff);
+#endif
+        reg.pc = v.w;
+        break;
+    case OP_RTS:
+        DUMMY(0x100 + reg.s);
+        tmp.b = PULL();
+        reg.pc = tmp.b | PULL()<<8;
+        DUMMY(reg.pc);
+        reg.pc++;
+        break;
+    case OP_RTI:
+        DUMMY(0x100 + reg.s);
+        reg.p = PULL();
+        tmp.b = PULL();
+        reg.pc = tmp.b | PULL()<<8;
+        break;
+
+    /* set and clear */
+    case OP_CLC: reg.p &= ~FLAGS_CARRY; break;
+    case OP_SEC: reg.p |=  FLAGS_CARRY; break;
+    case OP_CLD: reg.p &= ~FLAGS_DECIMAL; break;
+    case OP_SED: reg.p |=  FLAGS_DECIMAL; break;
+    case OP_CLI: reg.p &= ~FLAGS_INTERRUPT; break;
+    case OP_SEI: reg.p |=  FLAGS_INTERRUPT; break;
+    case OP_CLV: reg.p &= ~FLAGS_OVERFLOW; break;
+
+    /* miscellaneous */
+    case OP_BRK:
+        /* the byte after BRK is skipped on return */
+        PUSH((reg.pc+1) >> 8);
+        PUSH((reg.pc+1) & 0xff);
+        PUSH(reg.p|FLAGS_BREAK);
+        reg.p |= FLAGS_BREAK|FLAGS_INTERRUPT;
+#if ENGINE_CMOS
+        reg.p &= ~FLAGS_DECIMAL;
+#endif
+        reg.pc = READ_W(BRK_VECTOR);
+        break;
+
+    case OP_NOP:
+#if ENGINE_BUS
+        /* the undocumented ones with an operand still read it */
+        if(instr->mode != MODE_IMPLIED && instr->mode != MODE_IMMEDIATE)
+            GETVAL();
+#endif
+        break;
+
+#if ENGINE_CMOS
+    /* 65C02 */
+    case OP_BRA: BRANCH(1); break;
+    case OP_STZ: WRITE(v.w, 0); break;
+    case OP_TSB:
+        GETTMPVAL();
+        RMW_DUMMY(v.w, tmp.b);
+        CONDITIONAL_FLAG(!(tmp.b&reg.a), FLAGS_ZERO);
+        WRITE(v.w, tmp.b|reg.a);
+        break;
+    case OP_TRB:
+        GETTMPVAL();
+        RMW_DUMMY(v.w, tmp.b);
+        CONDITIONAL_FLAG(!(tmp.b&reg.a), FLAGS_ZERO);
+        WRITE(v.w, tmp.b&~reg.a);
+        break;
+
+    case OP_PHX: PUSH(reg.x); break;
+    case OP_PHY: PUSH(reg.y); break;
+    case OP_PLX: DUMMY(0x100 + reg.s); alu_load(&reg.x, PULL()); break;
+    case OP_PLY: DUMMY(0x100 + reg.s); alu_load(&reg.y, PULL()); break;
+
+    /* bit n of a zero page byte, n in the high nibble of the opcode */
+    case OP_RMB: GETTMPVAL(); RMW_DUMMY(v.w, tmp.b);
+        WRITE(v.w, tmp.b&~BIT_N()); break;
+    case OP_SMB: GETTMPVAL(); RMW_DUMMY(v.w, tmp.b);
+        WRITE(v.w, tmp.b|BIT_N()); break;
+    case OP_BBR:
+    case OP_BBS:
+        GETVAL();
+        tmp.b = READ(reg.pc++);
+        if(!(v.b&BIT_N()) == (instr->type == OP_BBR))
+            reg.pc += (int8_t)tmp.b;
+        break;
+
+    /* nothing raises interrupts, so WAI would never wake up either */
+    case OP_WAI:
+    case OP_STP: cpu_halt = HALT_DEVICE; break;
+#else
+    /* undocumented NMOS */
+    case OP_SLO: RMW(alu_asl(tmp.b)); alu_load(&reg.a, reg.a|tmp.b); break;
+    case OP_RLA: RMW(alu_rol(tmp.b)); alu_load(&reg.a, reg.a&tmp.b); break;
+    case OP_SRE: RMW(alu_lsr(tmp.b)); alu_load(&reg.a, reg.a^tmp.b); break;
+    case OP_RRA: RMW(alu_ror(tmp.b)); ENGINE_ADC(tmp.b); break;
+    case OP_DCP: RMW(tmp.b-1); alu_compare(reg.a, tmp.b); break;
+    case OP_ISC: RMW(tmp.b+1); ENGINE_SBC(tmp.b); break;
+
+    case OP_SAX: WRITE(v.w, reg.a&reg.x); break;
+    case OP_LAX: GETVAL(); alu_load(&reg.a, v.b); reg.x = reg.a; break;
+    case OP_LAS:
+        GETVAL();
+        alu_load(&reg.a, v.b&reg.s);
+        reg.x = reg.s = reg.a;
+        break;
+
+    /* ANE and LXA depend on the chip, these are the usual constants */
+    case OP_ANE: GETVAL(); alu_load(&reg.a, (reg.a|0xee)&reg.x&v.b); break;
+    case OP_LXA: GETVAL(); alu_load(&reg.a, (reg.a|0xee)&v.b); reg.x = reg.a;
+        break;
+
+    case OP_ANC:
+        GETVAL();
+        alu_load(&reg.a, reg.a&v.b);
+        CONDITIONAL_FLAG(reg.a&0x80, FLAGS_CARRY);
+        break;
+    case OP_ALR: GETVAL(); alu_load(&reg.a, alu_lsr(reg.a&v.b)); break;
+    case OP_ARR:
+        GETVAL();
+        alu_load(&reg.a, alu_ror(reg.a&v.b));
+        CONDITIONAL_FLAG(reg.a&0x40, FLAGS_CARRY);
+        CONDITIONAL_FLAG((reg.a^reg.a>>1)&0x20, FLAGS_OVERFLOW);
+        break;
+    case OP_SBX:
+        GETVAL();
+        alu_compare(reg.a&reg.x, v.b);
+        reg.x = (reg.a&reg.x) - v.b;
+        break;
+
+    case OP_SHA: WRITE(v.w, reg.a&reg.x&HIGH1(reg.y)); break;
+    case OP_SHX: WRITE(v.w, reg.x&HIGH1(reg.y)); break;
+    case OP_SHY: WRITE(v.w, reg.y&HIGH1(reg.x)); break;
+    case OP_TAS:
+        reg.s = reg.a&reg.x;
+        WRITE(v.w, reg.s&HIGH1(reg.y));
+        break;
+
+    case OP_JAM: cpu_illegal(opcode); break;
+#endif
+    }
+#undef GETVAL
+#undef GETTMPVAL
+#undef SETVAL
+#undef SETNZ
+#undef RMW_DUMMY
+#undef MODVAL
+#undef RMW
+#undef BRANCH
+#undef DECIMAL_CYCLE
+#undef HIGH1
+#undef BIT_N
+
+#if ENGINE_BUS
+    while(m->cycles - start < ENGINE_CYCLES[opcode]) bus_tick(m);
+    STAT_ADD(cycles, m->cycles - start);
+#endif
+}
+
+#undef ENGINE_FN
+#undef READ
+#undef WRITE
+#undef READ_W
+#undef READ_ZP_W
+#undef READ_W_PAGE
+#undef DUMMY
+#undef PUSH
+#undef PULL
+#undef INDEX
+
+#if ENGINE_BUS
+const cpu_variant_t ENGINE_CAT(cpu_, ENGINE) = {
+    .name = ENGINE_NAME,
+    .table = ENGINE_TABLE,
+    .cycles = ENGINE_CYCLES,
+    .exec = ENGINE_CAT(cpu_exec_, ENGINE),
+    .exec_bus = ENGINE_CAT(cpu_bus_exec_, ENGINE),
+};
+#endif
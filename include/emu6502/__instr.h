@@ -55,3 +55,38 @@ T(BEQ,     53)
 T(SED,     54)
 T(PLA,     55)
 T(BVS,     56)
+T(SLO,     57)
+T(RLA,     58)
+T(SRE,     59)
+T(RRA,     60)
+T(SAX,     61)
+T(LAX,     62)
+T(DCP,     63)
+T(ISC,     64)
+T(ANC,     65)
+T(ALR,     66)
+T(ARR,     67)
+T(ANE,     68)
+T(LXA,     69)
+T(SBX,     70)
+T(LAS,     71)
+T(SHA,     72)
+T(SHX,     73)
+T(SHY,     74)
+T(TAS,     75)
+T(JAM,     76)
+T(BRA,     77)
+T(STZ,     78)
+T(TRB,     79)
+T(TSB,     80)
+T(PHX,     81)
+T(PHY,     82)
+T(PLX,     83)
+T(PLY,     84)
+T(RMB,     85)
+T(SMB,     86)
+T(BBR,     87)
+T(BBS,     88)
+T(WAI,     89)
+T(STP,     90)
+T(HLE,     91)
@@ -0,0 +1,398 @@
+/* Every opcode of every CPU variant, X-macros for decoding.c:
+ *   D(opcode, type, mode, NMOS cycles, 65C02 cycles) on all of them
+ *   N(opcode, type, mode, cycles) NMOS and 2A03, undocumented
+ *   C(opcode, type, mode, cycles) 65C02
+ * Cycles are base cycles, without page crossings and taken branches. */
+
+/* 0x00 */
+D(0x00, BRK, i, 7, 7)
+D(0x01, ORA, zp_x_IN, 6, 6)
+D(0x05, ORA, zp, 3, 3)
+D(0x06, ASL, zp, 5, 5)
+D(0x08, PHP, i, 3, 3)
+D(0x09, ORA, IMM, 2, 2)
+D(0x0a, ASL, A, 2, 2)
+D(0x0d, ORA, a, 4, 4)
+D(0x0e, ASL, a, 6, 6)
+N(0x02, HLE, i, 2)
+N(0x03, SLO, zp_x_IN, 8)
+N(0x04, NOP, zp, 3)
+N(0x07, SLO, zp, 5)
+N(0x0b, ANC, IMM, 2)
+N(0x0c, NOP, a, 4)
+N(0x0f, SLO, a, 6)
+C(0x02, HLE, i, 2)
+C(0x03, NOP, i, 1)
+C(0x04, TSB, zp, 5)
+C(0x07, RMB, zp, 5)
+C(0x0b, NOP, i, 1)
+C(0x0c, TSB, a, 6)
+C(0x0f, BBR, zp_r, 5)
+
+/* 0x10 */
+D(0x10, BPL, r, 2, 2)
+D(0x11, ORA, zp_y_IN, 5, 5)
+D(0x15, ORA, zp_x, 4, 4)
+D(0x16, ASL, zp_x, 6, 6)
+D(0x18, CLC, i, 2, 2)
+D(0x19, ORA, a_y, 4, 4)
+D(0x1d, ORA, a_x, 4, 4)
+D(0x1e, ASL, a_x, 7, 6)
+N(0x12, JAM, i, 2)
+N(0x13, SLO, zp_y_IN, 8)
+N(0x14, NOP, zp_x, 4)
+N(0x17, SLO, zp_x, 6)
+N(0x1a, NOP, i, 2)
+N(0x1b, SLO, a_y, 7)
+N(0x1c, NOP, a_x, 4)
+N(0x1f, SLO, a_x, 7)
+C(0x12, ORA, zp_IN, 5)
+C(0x13, NOP, i, 1)
+C(0x14, TRB, zp, 5)
+C(0x17, RMB, zp, 5)
+C(0x1a, INC, A, 2)
+C(0x1b, NOP, i, 1)
+C(0x1c, TRB, a, 6)
+C(0x1f, BBR, zp_r, 5)
+
+/* 0x20 */
+D(0x20, JSR, a, 6, 6)
+D(0x21, AND, zp_x_IN, 6, 6)
+D(0x24, BIT, zp, 3, 3)
+D(0x25, AND, zp, 3, 3)
+D(0x26, ROL, zp, 5, 5)
+D(0x28, PLP, i, 4, 4)
+D(0x29, AND, IMM, 2, 2)
+D(0x2a, ROL, A, 2, 2)
+D(0x2c, BIT, a, 4, 4)
+D(0x2d, AND, a, 4, 4)
+D(0x2e, ROL, a, 6, 6)
+N(0x22, JAM, i, 2)
+N(0x23, RLA, zp_x_IN, 8)
+N(0x27, RLA, zp, 5)
+N(0x2b, ANC, IMM, 2)
+N(0x2f, RLA, a, 6)
+C(0x22, NOP, IMM, 2)
+C(0x23, NOP, i, 1)
+C(0x27, RMB, zp, 5)
+C(0x2b, NOP, i, 1)
+C(0x2f, BBR, zp_r, 5)
+
+/* 0x30 */
+D(0x30, BMI, r, 2, 2)
+D(0x31, AND, zp_y_IN, 5, 5)
+D(0x35, AND, zp_x, 4, 4)
+D(0x36, ROL, zp_x, 6, 6)
+D(0x38, SEC, i, 2, 2)
+D(0x39, AND, a_y, 4, 4)
+D(0x3d, AND, a_x, 4, 4)
+D(0x3e, ROL, a_x, 7, 6)
+N(0x32, JAM, i, 2)
+N(0x33, RLA, zp_y_IN, 8)
+N(0x34, NOP, zp_x, 4)
+N(0x37, RLA, zp_x, 6)
+N(0x3a, NOP, i, 2)
+N(0x3b, RLA, a_y, 7)
+N(0x3c, NOP, a_x, 4)
+N(0x3f, RLA, a_x, 7)
+C(0x32, AND, zp_IN, 5)
+C(0x33, NOP, i, 1)
+C(0x34, BIT, zp_x, 4)
+C(0x37, RMB, zp, 5)
+C(0x3a, DEC, A, 2)
+C(0x3b, NOP, i, 1)
+C(0x3c, BIT, a_x, 4)
+C(0x3f, BBR, zp_r, 5)
+
+/* 0x40 */
+D(0x40, RTI, i, 6, 6)
+D(0x41, EOR, zp_x_IN, 6, 6)
+D(0x45, EOR, zp, 3, 3)
+D(0x46, LSR, zp, 5, 5)
+D(0x48, PHA, i, 3, 3)
+D(0x49, EOR, IMM, 2, 2)
+D(0x4a, LSR, A, 2, 2)
+D(0x4c, JMP, a, 3, 3)
+D(0x4d, EOR, a, 4, 4)
+D(0x4e, LSR, a, 6, 6)
+N(0x42, JAM, i, 2)
+N(0x43, SRE, zp_x_IN, 8)
+N(0x44, NOP, zp, 3)
+N(0x47, SRE, zp, 5)
+N(0x4b, ALR, IMM, 2)
+N(0x4f, SRE, a, 6)
+C(0x42, NOP, IMM, 2)
+C(0x43, NOP, i, 1)
+C(0x44, NOP, zp, 3)
+C(0x47, RMB, zp, 5)
+C(0x4b, NOP, i, 1)
+C(0x4f, BBR, zp_r, 5)
+
+/* 0x50 */
+D(0x50, BVC, r, 2, 2)
+D(0x51, EOR, zp_y_IN, 5, 5)
+D(0x55, EOR, zp_x, 4, 4)
+D(0x56, LSR, zp_x, 6, 6)
+D(0x58, CLI, i, 2, 2)
+D(0x59, EOR, a_y, 4, 4)
+D(0x5d, EOR, a_x, 4, 4)
+D(0x5e, LSR, a_x, 7, 6)
+N(0x52, JAM, i, 2)
+N(0x53, SRE, zp_y_IN, 8)
+N(0x54, NOP, zp_x, 4)
+N(0x57, SRE, zp_x, 6)
+N(0x5a, NOP, i, 2)
+N(0x5b, SRE, a_y, 7)
+N(0x5c, NOP, a_x, 4)
+N(0x5f, SRE, a_x, 7)
+C(0x52, EOR, zp_IN, 5)
+C(0x53, NOP, i, 1)
+C(0x54, NOP, zp_x, 4)
+C(0x57, RMB, zp, 5)
+C(0x5a, PHY, i, 3)
+C(0x5b, NOP, i, 1)
+C(0x5c, NOP, a, 8)
+C(0x5f, BBR, zp_r, 5)
+
+/* 0x60 */
+D(0x60, RTS, i, 6, 6)
+D(0x61, ADC, zp_x_IN, 6, 6)
+D(0x65, ADC, zp, 3, 3)
+D(0x66, ROR, zp, 5, 5)
+D(0x68, PLA, i, 4, 4)
+D(0x69, ADC, IMM, 2, 2)
+D(0x6a, ROR, A, 2, 2)
+D(0x6c, JMP, a_IN, 5, 6)
+D(0x6d, ADC, a, 4, 4)
+D(0x6e, ROR, a, 6, 6)
+N(0x62, JAM, i, 2)
+N(0x63, RRA, zp_x_IN, 8)
+N(0x64, NOP, zp, 3)
+N(0x67, RRA, zp, 5)
+N(0x6b, ARR, IMM, 2)
+N(0x6f, RRA, a, 6)
+C(0x62, NOP, IMM, 2)
+C(0x63, NOP, i, 1)
+C(0x64, STZ, zp, 3)
+C(0x67, RMB, zp, 5)
+C(0x6b, NOP, i, 1)
+C(0x6f, BBR, zp_r, 5)
+
+/* 0x70 */
+D(0x70, BVS, r, 2, 2)
+D(0x71, ADC, zp_y_IN, 5, 5)
+D(0x75, ADC, zp_x, 4, 4)
+D(0x76, ROR, zp_x, 6, 6)
+D(0x78, SEI, i, 2, 2)
+D(0x79, ADC, a_y, 4, 4)
+D(0x7d, ADC, a_x, 4, 4)
+D(0x7e, ROR, a_x, 7, 6)
+N(0x72, JAM, i, 2)
+N(0x73, RRA, zp_y_IN, 8)
+N(0x74, NOP, zp_x, 4)
+N(0x77, RRA, zp_x, 6)
+N(0x7a, NOP, i, 2)
+N(0x7b, RRA, a_y, 7)
+N(0x7c, NOP, a_x, 4)
+N(0x7f, RRA, a_x, 7)
+C(0x72, ADC, zp_IN, 5)
+C(0x73, NOP, i, 1)
+C(0x74, STZ, zp_x, 4)
+C(0x77, RMB, zp, 5)
+C(0x7a, PLY, i, 4)
+C(0x7b, NOP, i, 1)
+C(0x7c, JMP, a_x_IN, 6)
+C(0x7f, BBR, zp_r, 5)
+
+/* 0x80 */
+D(0x81, STA, zp_x_IN, 6, 6)
+D(0x84, STY, zp, 3, 3)
+D(0x85, STA, zp, 3, 3)
+D(0x86, STX, zp, 3, 3)
+D(0x88, DEY, i, 2, 2)
+D(0x8a, TXA, i, 2, 2)
+D(0x8c, STY, a, 4, 4)
+D(0x8d, STA, a, 4, 4)
+D(0x8e, STX, a, 4, 4)
+N(0x80, NOP, IMM, 2)
+N(0x82, NOP, IMM, 2)
+N(0x83, SAX, zp_x_IN, 6)
+N(0x87, SAX, zp, 3)
+N(0x89, NOP, IMM, 2)
+N(0x8b, ANE, IMM, 2)
+N(0x8f, SAX, a, 4)
+C(0x80, BRA, r, 3)
+C(0x82, NOP, IMM, 2)
+C(0x83, NOP, i, 1)
+C(0x87, SMB, zp, 5)
+C(0x89, BIT, IMM, 2)
+C(0x8b, NOP, i, 1)
+C(0x8f, BBS, zp_r, 5)
+
+/* 0x90 */
+D(0x90, BCC, r, 2, 2)
+D(0x91, STA, zp_y_IN, 6, 6)
+D(0x94, STY, zp_x, 4, 4)
+D(0x95, STA, zp_x, 4, 4)
+D(0x96, STX, zp_y, 4, 4)
+D(0x98, TYA, i, 2, 2)
+D(0x99, STA, a_y, 5, 5)
+D(0x9a, TXS, i, 2, 2)
+D(0x9d, STA, a_x, 5, 5)
+N(0x92, JAM, i, 2)
+N(0x93, SHA, zp_y_IN, 6)
+N(0x97, SAX, zp_y, 4)
+N(0x9b, TAS, a_y, 5)
+N(0x9c, SHY, a_x, 5)
+N(0x9e, SHX, a_y, 5)
+N(0x9f, SHA, a_y, 5)
+C(0x92, STA, zp_IN, 5)
+C(0x93, NOP, i, 1)
+C(0x97, SMB, zp, 5)
+C(0x9b, NOP, i, 1)
+C(0x9c, STZ, a, 4)
+C(0x9e, STZ, a_x, 5)
+C(0x9f, BBS, zp_r, 5)
+
+/* 0xa0 */
+D(0xa0, LDY, IMM, 2, 2)
+D(0xa1, LDA, zp_x_IN, 6, 6)
+D(0xa2, LDX, IMM, 2, 2)
+D(0xa4, LDY, zp, 3, 3)
+D(0xa5, LDA, zp, 3, 3)
+D(0xa6, LDX, zp, 3, 3)
+D(0xa8, TAY, i, 2, 2)
+D(0xa9, LDA, IMM, 2, 2)
+D(0xaa, TAX, i, 2, 2)
+D(0xac, LDY, a, 4, 4)
+D(0xad, LDA, a, 4, 4)
+D(0xae, LDX, a, 4, 4)
+N(0xa3, LAX, zp_x_IN, 6)
+N(0xa7, LAX, zp, 3)
+N(0xab, LXA, IMM, 2)
+N(0xaf, LAX, a, 4)
+C(0xa3, NOP, i, 1)
+C(0xa7, SMB, zp, 5)
+C(0xab, NOP, i, 1)
+C(0xaf, BBS, zp_r, 5)
+
+/* 0xb0 */
+D(0xb0, BCS, r, 2, 2)
+D(0xb1, LDA, zp_y_IN, 5, 5)
+D(0xb4, LDY, zp_x, 4, 4)
+D(0xb5, LDA, zp_x, 4, 4)
+D(0xb6, LDX, zp_y, 4, 4)
+D(0xb8, CLV, i, 2, 2)
+D(0xb9, LDA, a_y, 4, 4)
+D(0xba, TSX, i, 2, 2)
+D(0xbc, LDY, a_x, 4, 4)
+D(0xbd, LDA, a_x, 4, 4)
+D(0xbe, LDX, a_y, 4, 4)
+N(0xb2, JAM, i, 2)
+N(0xb3, LAX, zp_y_IN, 5)
+N(0xb7, LAX, zp_y, 4)
+N(0xbb, LAS, a_y, 4)
+N(0xbf, LAX, a_y, 4)
+C(0xb2, LDA, zp_IN, 5)
+C(0xb3, NOP, i, 1)
+C(0xb7, SMB, zp, 5)
+C(0xbb, NOP, i, 1)
+C(0xbf, BBS, zp_r, 5)
+
+/* 0xc0 */
+D(0xc0, CPY, IMM, 2, 2)
+D(0xc1, CMP, zp_x_IN, 6, 6)
+D(0xc4, CPY, zp, 3, 3)
+D(0xc5, CMP, zp, 3, 3)
+D(0xc6, DEC, zp, 5, 5)
+D(0xc8, INY, i, 2, 2)
+D(0xc9, CMP, IMM, 2, 2)
+D(0xca, DEX, i, 2, 2)
+D(0xcc, CPY, a, 4, 4)
+D(0xcd, CMP, a, 4, 4)
+D(0xce, DEC, a, 6, 6)
+N(0xc2, NOP, IMM, 2)
+N(0xc3, DCP, zp_x_IN, 8)
+N(0xc7, DCP, zp, 5)
+N(0xcb, SBX, IMM, 2)
+N(0xcf, DCP, a, 6)
+C(0xc2, NOP, IMM, 2)
+C(0xc3, NOP, i, 1)
+C(0xc7, SMB, zp, 5)
+C(0xcb, WAI, i, 3)
+C(0xcf, BBS, zp_r, 5)
+
+/* 0xd0 */
+D(0xd0, BNE, r, 2, 2)
+D(0xd1, CMP, zp_y_IN, 5, 5)
+D(0xd5, CMP, zp_x, 4, 4)
+D(0xd6, DEC, zp_x, 6, 6)
+D(0xd8, CLD, i, 2, 2)
+D(0xd9, CMP, a_y, 4, 4)
+D(0xdd, CMP, a_x, 4, 4)
+D(0xde, DEC, a_x, 7, 7)
+N(0xd2, JAM, i, 2)
+N(0xd3, DCP, zp_y_IN, 8)
+N(0xd4, NOP, zp_x, 4)
+N(0xd7, DCP, zp_x, 6)
+N(0xda, NOP, i, 2)
+N(0xdb, DCP, a_y, 7)
+N(0xdc, NOP, a_x, 4)
+N(0xdf, DCP, a_x, 7)
+C(0xd2, CMP, zp_IN, 5)
+C(0xd3, NOP, i, 1)
+C(0xd4, NOP, zp_x, 4)
+C(0xd7, SMB, zp, 5)
+C(0xda, PHX, i, 3)
+C(0xdb, STP, i, 3)
+C(0xdc, NOP, a, 4)
+C(0xdf, BBS, zp_r, 5)
+
+/* 0xe0 */
+D(0xe0, CPX, IMM, 2, 2)
+D(0xe1, SBC, zp_x_IN, 6, 6)
+D(0xe4, CPX, zp, 3, 3)
+D(0xe5, SBC, zp, 3, 3)
+D(0xe6, INC, zp, 5, 5)
+D(0xe8, INX, i, 2, 2)
+D(0xe9, SBC, IMM, 2, 2)
+D(0xea, NOP, i, 2, 2)
+D(0xec, CPX, a, 4, 4)
+D(0xed, SBC, a, 4, 4)
+D(0xee, INC, a, 6, 6)
+N(0xe2, NOP, IMM, 2)
+N(0xe3, ISC, zp_x_IN, 8)
+N(0xe7, ISC, zp, 5)
+N(0xeb, SBC, IMM, 2)
+N(0xef, ISC, a, 6)
+C(0xe2, NOP, IMM, 2)
+C(0xe3, NOP, i, 1)
+C(0xe7, SMB, zp, 5)
+C(0xeb, NOP, i, 1)
+C(0xef, BBS, zp_r, 5)
+
+/* 0xf0 */
+D(0xf0, BEQ, r, 2, 2)
+D(0xf1, SBC, zp_y_IN, 5, 5)
+D(0xf5, SBC, zp_x, 4, 4)
+D(0xf6, INC, zp_x, 6, 6)
+D(0xf8, SED, i, 2, 2)
+D(0xf9, SBC, a_y, 4, 4)
+D(0xfd, SBC, a_x, 4, 4)
+D(0xfe, INC, a_x, 7, 7)
+N(0xf2, JAM, i, 2)
+N(0xf3, ISC, zp_y_IN, 8)
+N(0xf4, NOP, zp_x, 4)
+N(0xf7, ISC, zp_x, 6)
+N(0xfa, NOP, i, 2)
+N(0xfb, ISC, a_y, 7)
+N(0xfc, NOP, a_x, 4)
+N(0xff, ISC, a_x, 7)
+C(0xf2, SBC, zp_IN, 5)
+C(0xf3, NOP, i, 1)
+C(0xf4, NOP, zp_x, 4)
+C(0xf7, SMB, zp, 5)
+C(0xfa, PLX, i, 4)
+C(0xfb, NOP, i, 1)
+C(0xfc, NOP, a, 4)
+C(0xff, BBS, zp_r, 5)
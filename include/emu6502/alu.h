@@ -0,0 +1,113 @@
+#ifndef EMU6502_ALU_H_
+#define EMU6502_ALU_H_
+
+/* Flag and arithmetic helpers shared by the interpreter and by code emitted
+ * by the static recompiler, so both always agree on instruction semantics. */
+
+#include <emu6502/machine.h>
+#include <stdint.h>
+
+#define CONDITIONAL_FLAG(cond, flag) do { \
+            if(cond) cpu_reg.p |= (flag); \
+            else cpu_reg.p &= ~(flag);    \
+        } while(0)
+#define HAS_FLAG(flag) ((cpu_reg.p&(flag))==(flag))
+
+static inline void alu_nz(uint8_t val) {
+    CONDITIONAL_FLAG((int8_t)val < 0, FLAGS_NEGATIVE);
+    CONDITIONAL_FLAG(val == 0, FLAGS_ZERO);
+}
+
+static inline void alu_load(uint8_t *r, int8_t val) {
+    *(int8_t *)r = val;
+    alu_nz(val);
+}
+
+/* unsigned, N and Z come from the difference */
+static inline void alu_compare(uint8_t l, uint8_t r) {
+    CONDITIONAL_FLAG(l >= r, FLAGS_CARRY);
+    alu_nz(l - r);
+}
+
+/* binary mode, V is set when the sign of the result is wrong */
+static inline void alu_adc(uint8_t val) {
+    uint16_t w = cpu_reg.a + val + HAS_FLAG(FLAGS_CARRY);
+    CONDITIONAL_FLAG(w > 0xff, FLAGS_CARRY);
+    CONDITIONAL_FLAG(~(cpu_reg.a^val) & (cpu_reg.a^w) & 0x80, FLAGS_OVERFLOW);
+    alu_load(&cpu_reg.a, w&0xff);
+}
+
+/* the carry is an inverted borrow, so this is adding the complement */
+static inline void alu_sbc(uint8_t val) {
+    alu_adc(~val);
+}
+
+/* Decimal mode by [carry][accumulator][operand], with the result in the
+ * low byte and N, V, Z and C in the high one. See bcd.c. */
+typedef uint16_t bcd_table_t[2][0x100][0x100];
+
+extern bcd_table_t bcd_adc_nmos, bcd_sbc_nmos, bcd_adc_65c02, bcd_sbc_65c02;
+
+void bcd_init(void);
+
+static inline void alu_bcd(bcd_table_t table, uint8_t val) {
+    uint16_t e = table[HAS_FLAG(FLAGS_CARRY)][cpu_reg.a][val];
+    cpu_reg.p = (cpu_reg.p & ~(FLAGS_NEGATIVE|FLAGS_OVERFLOW|FLAGS_ZERO
+                               |FLAGS_CARRY)) | e>>8;
+    cpu_reg.a = (uint8_t)e;
+}
+
+/* ADC and SBC of the variants that have decimal mode */
+static inline void alu_adc_nmos(uint8_t val) {
+    if(HAS_FLAG(FLAGS_DECIMAL)) alu_bcd(bcd_adc_nmos, val);
+    else alu_adc(val);
+}
+
+static inline void alu_sbc_nmos(uint8_t val) {
+    if(HAS_FLAG(FLAGS_DECIMAL)) alu_bcd(bcd_sbc_nmos, val);
+    else alu_sbc(val);
+}
+
+/* the cycle longer the 65C02 takes for them is the engine's, see
+ * DECIMAL_CYCLE() in __cpu_engine.h */
+static inline void alu_adc_65c02(uint8_t val) {
+    if(HAS_FLAG(FLAGS_DECIMAL)) alu_bcd(bcd_adc_65c02, val);
+    else alu_adc(val);
+}
+
+static inline void alu_sbc_65c02(uint8_t val) {
+    if(HAS_FLAG(FLAGS_DECIMAL)) alu_bcd(bcd_sbc_65c02, val);
+    else alu_sbc(val);
+}
+
+static inline void alu_bit(uint8_t val) {
+    CONDITIONAL_FLAG(val&0x80, FLAGS_NEGATIVE);
+    CONDITIONAL_FLAG(val&0x40, FLAGS_OVERFLOW);
+    CONDITIONAL_FLAG(!(val&cpu_reg.a), FLAGS_ZERO);
+}
+
+/* TODO: I have literally no idea how the flags for these instructions
+ * should work */
+static inline uint8_t alu_asl(uint8_t val) {
+    CONDITIONAL_FLAG(val&0x80, FLAGS_CARRY);
+    return val<<1;
+}
+
+static inline uint8_t alu_lsr(uint8_t val) {
+    CONDITIONAL_FLAG(val&0x01, FLAGS_CARRY);
+    return val>>1;
+}
+
+static inline uint8_t alu_rol(uint8_t val) {
+    uint8_t out = val<<1 | HAS_FLAG(FLAGS_CARRY);
+    CONDITIONAL_FLAG(val&0x80, FLAGS_CARRY);
+    return out;
+}
+
+static inline uint8_t alu_ror(uint8_t val) {
+    uint8_t out = val>>1 | HAS_FLAG(FLAGS_CARRY)<<7;
+    CONDITIONAL_FLAG(val&0x01, FLAGS_CARRY);
+    return out;
+}
+
+#endif /* EMU6502_ALU_H_ */
@@ -4,6 +4,55 @@
 extern struct cmd_options {
     unsigned verbose;
     int step;
+    int pair_profile;
+    int flat;
+    int rom_flags;
+    const struct mapper *mapper;
+    /* NULL for the default */
+    const struct cpu_variant *variant;
+    /* layout instead of the default one, see config.c */
+    const struct machine_config *machine;
+    int bus_accurate;
+    const char *hle_path;
+    /* routines to memoize, NULL to find them */
+    int memo;
+    const char *memo_path;
+    /* control flow file, NULL for the default next to the first rom */
+    int flow;
+    const char *flow_path;
+    const char **shm;
+    unsigned n_shm;
+    const char *doorbell;
+    int stats;
+    const char *stats_path;
+    unsigned stats_interval;
+    /* host counters around the run, see perf.c */
+    int perf;
+    /* check the run in segments on another engine, see verify.c */
+    int verify;
+    int verify_engine;
+    unsigned long verify_segment;
+    unsigned verify_threads;
+    int server;
+    const char *server_path;
+    /* interactive sessions, 0 threads for one per core */
+    const char *sessions_path;
+    unsigned session_threads;
+    unsigned cpus;
+    unsigned long quantum;
+    unsigned long shared_addr, shared_size;
+    /* coverage file merged into, and reports written from it */
+    const char *cover_path;
+    const char *cover_listing;
+    const char *cover_lcov;
+    /* heatmap image, the report goes to stderr */
+    const char *heat_path;
+    unsigned heat_top;
 } cmd_options;
 
+/* load roms given on the command line into the current machine */
+int load_segment(const char *);
+int load_cartridge(const char *);
+int load_extras(void);
+
 #endif /* EMU6502_ARGS_H_ */
@@ -0,0 +1,18 @@
+#ifndef EMU6502_BOARD_H_
+#define EMU6502_BOARD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BOARD_MAX_CPUS 8
+
+typedef struct board board_t;
+
+/* loads a CPU's ROMs and devices into the current machine, 0 or -1 */
+typedef int (*board_setup_fn)(unsigned);
+
+board_t *board_new(unsigned, uint64_t, uint16_t, size_t, board_setup_fn);
+int board_run(board_t *);
+void board_free(board_t *);
+
+#endif /* EMU6502_BOARD_H_ */
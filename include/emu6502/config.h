@@ -0,0 +1,49 @@
+#ifndef EMU6502_CONFIG_H_
+#define EMU6502_CONFIG_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+struct rom_image;
+struct mapper;
+struct cpu_variant;
+
+enum config_kind {
+    CONFIG_RAM,
+    CONFIG_PRG,
+    CONFIG_ROM,
+    CONFIG_CARTRIDGE,
+    CONFIG_IO,
+    CONFIG_DMA,
+    CONFIG_TIMER,
+    CONFIG_SHARED,
+};
+
+/* One line of a machine description, taking addr up to end. */
+typedef struct config_region {
+    enum config_kind kind;
+    uint32_t addr, end;
+    /* RAM repeats every size bytes, ROMs map size bytes from off */
+    size_t size, off;
+    int flags;
+    struct rom_image *img;
+    const struct mapper *mapper;
+    /* SRC@ADDR,SIZE for shm_map() */
+    char *spec;
+    unsigned line;
+} config_region_t;
+
+/* A validated machine description, see config.c. Loaded once per path and
+ * kept for the life of the process. */
+typedef struct machine_config {
+    char *path;
+    /* NULL to keep the default */
+    const struct cpu_variant *variant;
+    config_region_t *regions;
+    unsigned n_regions;
+} machine_config_t;
+
+const machine_config_t *config_get(const char *);
+int config_apply(const machine_config_t *);
+
+#endif /* EMU6502_CONFIG_H_ */
@@ -0,0 +1,28 @@
+#ifndef EMU6502_COVER_H_
+#define EMU6502_COVER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* One bit per address. exec marks opcode fetches, taken and not_taken the
+ * directions seen at each branch site. */
+typedef struct cover {
+    uint8_t exec[0x2000];
+    uint8_t read[0x2000];
+    uint8_t write[0x2000];
+    uint8_t taken[0x2000];
+    uint8_t not_taken[0x2000];
+} cover_t;
+
+#define COVER_SET(map, addr) ((map)[(addr)>>3] |= 1<<((addr)&7))
+#define COVER_GET(map, addr) ((map)[(addr)>>3] >> ((addr)&7) & 1)
+
+cover_t *cover_enable(void);
+int cover_load(cover_t *, const char *);
+int cover_save(const cover_t *, const char *);
+void cover_branch(uint16_t, uint8_t);
+void cover_step(void);
+void cover_listing(FILE *);
+void cover_lcov(FILE *, const char *);
+
+#endif /* EMU6502_COVER_H_ */
@@ -12,10 +12,35 @@
 #define FLAGS_OVERFLOW   (1<<6)
 #define FLAGS_NEGATIVE   (1<<7)
 
-extern int cpu_halt;
+typedef struct cpu_reg {
+    uint8_t a, x, y;
+    uint16_t pc;
+    uint8_t s, p;
+} cpu_reg_t;
 
+struct instr;
+
+/* A CPU model with an interpreter of its own, see __cpu_engine.h */
+typedef struct cpu_variant {
+    const char *name;
+    const struct instr *table;
+    const uint8_t *cycles;
+    void (*exec)(uint8_t);
+    /* cycle by cycle, for machines with MACHINE_BUS_ACCURATE */
+    void (*exec_bus)(uint8_t);
+} cpu_variant_t;
+
+extern const cpu_variant_t cpu_nmos, cpu_65c02, cpu_2a03;
+
+const cpu_variant_t *cpu_variant_find(const char *);
+void cpu_map_io(void);
+void cpu_map_io_at(uint16_t);
 void cpu_init(void);
 void cpu_step(void);
+void cpu_run(void);
+const char *cpu_engine(void);
+void cpu_run_for(uint64_t);
+void cpu_exec(uint8_t);
 void cpu_dump(void);
 
 #endif /* EMU6502_CPU_H_ */
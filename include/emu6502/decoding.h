@@ -23,6 +23,10 @@ MODE_ZERO_PAGE_X,
 MODE_ZERO_PAGE_Y,
 MODE_ZERO_PAGE_INDIRECT_X,
 MODE_ZERO_PAGE_INDIRECT_Y,
+/* 65C02 */
+MODE_ZERO_PAGE_INDIRECT,
+MODE_ABSOLUTE_INDIRECT_X,
+MODE_ZERO_PAGE_RELATIVE,
 
 /* shorthand because lazy */
 MODE_A = 0,
@@ -38,6 +42,9 @@ MODE_zp_x,
 MODE_zp_y,
 MODE_zp_x_IN,
 MODE_zp_y_IN,
+MODE_zp_IN,
+MODE_a_x_IN,
+MODE_zp_r,
 };
 
 typedef struct instr {
@@ -45,9 +52,18 @@ typedef struct instr {
     enum instr_address_mode mode;
 } instr_t;
 
+/* documented opcodes only, which every variant decodes the same way */
 extern const instr_t instruction_table[0x100];
+/* NMOS timings, which the documented opcodes have on the 2A03 as well */
+extern const uint8_t instruction_cycles[0x100];
+
+/* complete tables of the CPU variants, see cpu.h */
+extern const instr_t instruction_table_nmos[0x100];
+extern const instr_t instruction_table_65c02[0x100];
+extern const uint8_t instruction_cycles_65c02[0x100];
 
 const char *instr_type_str(enum instr_type);
 const char *instr_mode_str(enum instr_address_mode);
+unsigned instr_mode_len(enum instr_address_mode);
 
 #endif /* EMU6502_DECODING_H_ */
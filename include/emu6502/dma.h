@@ -0,0 +1,23 @@
+#ifndef EMU6502_DMA_H_
+#define EMU6502_DMA_H_
+
+#include <stdint.h>
+
+/* where the controller is in the default layout */
+#define DMA_ADDR 0x3fd0
+
+/* control register */
+#define DMA_START     (1<<0)
+#define DMA_FIXED_SRC (1<<1) /* read every byte from src */
+#define DMA_FIXED_DST (1<<2) /* write every byte to dst */
+
+/* registers of the DMA controller of a machine, see dma.c */
+typedef struct dma {
+    uint16_t src, dst, len;
+    uint8_t ctrl;
+} dma_t;
+
+void dma_map(void);
+void dma_map_at(uint16_t);
+
+#endif /* EMU6502_DMA_H_ */
@@ -0,0 +1,130 @@
+#ifndef EMU6502_EMU6502_H_
+#define EMU6502_EMU6502_H_
+
+/* Public interface of libemu6502, for running the emulator inside another
+ * process. Nothing else under include/emu6502 is part of it and none of it
+ * may be relied on from outside. Nothing here touches stdin, stdout or
+ * stderr unless EMU6502_STDIO is passed to emu6502_new().
+ *
+ * Every call operates on the machine it is passed, and a machine may only
+ * be used by one thread at a time. Device callbacks run on the thread that
+ * called emu6502_step()/emu6502_run_for(). */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define EMU6502_API __attribute__((visibility("default")))
+#else
+#define EMU6502_API
+#endif
+
+/* bumped on incompatible changes */
+#define EMU6502_API_VERSION 1
+
+/* emu6502_new() flags */
+#define EMU6502_STDIO         (1<<0) /* console at $3ff0 on stdin/stdout */
+#define EMU6502_READ_ONLY_ROM (1<<1) /* ignore writes to ROM */
+#define EMU6502_CPU_65C02     (1<<2) /* 65C02 instead of an NMOS 6502 */
+#define EMU6502_CPU_2A03      (1<<3) /* NMOS without decimal mode */
+#define EMU6502_BUS_ACCURATE  (1<<4) /* every bus cycle of real hardware */
+
+typedef struct emu6502 emu6502_t;
+
+enum emu6502_stop {
+    EMU6502_STOP_NONE = 0, /* emu6502_step() ran one instruction */
+    EMU6502_STOP_CYCLES,   /* emu6502_run_for() used up its cycles */
+    EMU6502_STOP_HALT,     /* the program wrote 1 to $3fff */
+    EMU6502_STOP_ILLEGAL,  /* illegal opcode, pc is past it */
+    EMU6502_STOP_USER,     /* emu6502_request_stop() */
+};
+
+typedef struct emu6502_regs {
+    uint8_t a, x, y, s, p;
+    uint16_t pc;
+} emu6502_regs_t;
+
+/* Memory-mapped device callbacks. The address is the full bus address. */
+typedef uint8_t (*emu6502_read_fn)(void *user, uint16_t addr);
+typedef void (*emu6502_write_fn)(void *user, uint16_t addr, uint8_t val);
+
+/* Called after every cycle of an EMU6502_BUS_ACCURATE machine with the
+ * number of cycles so far. */
+typedef void (*emu6502_cycle_fn)(void *user, uint64_t cycle);
+
+/* Native replacement for a routine, entered with pc on its first byte.
+ * Returning 0 returns from the routine like RTS, nonzero runs the 6502
+ * code after all. */
+typedef int (*emu6502_trap_fn)(emu6502_t *, void *user);
+
+EMU6502_API unsigned emu6502_api_version(void);
+
+EMU6502_API emu6502_t *emu6502_new(unsigned flags);
+EMU6502_API void emu6502_free(emu6502_t *);
+
+/* Map an image at addr, which must be at or above $4020. The file version
+ * shares the mapping of the file, the memory version takes a copy. Both
+ * return 0 or -1. */
+EMU6502_API int emu6502_load_file(emu6502_t *, const char *path,
+                                  uint16_t addr);
+EMU6502_API int emu6502_load_mem(emu6502_t *, const void *data, size_t size,
+                                 uint16_t addr);
+
+/* Back size bytes from addr with mem, which the caller keeps alive and may
+ * share with other machines or processes. Accesses go straight to it, so
+ * the machine and the host see each other's writes right away. addr and
+ * size have to be multiples of 256. Returns 0 or -1. */
+EMU6502_API int emu6502_map_shared(emu6502_t *, void *mem, size_t size,
+                                   uint16_t addr);
+
+/* Route size bytes from addr to a device, in 16 byte blocks. Either
+ * callback may be NULL: reads then return the last value on the bus and
+ * writes are dropped. Returns 0 or -1. */
+EMU6502_API int emu6502_map_device(emu6502_t *, uint16_t addr, uint32_t size,
+                                   emu6502_read_fn, emu6502_write_fn,
+                                   void *user);
+
+/* Replace the routine at pc, which has to be in RAM or a loaded image,
+ * with fn. Returns 0 or -1. */
+EMU6502_API int emu6502_trap(emu6502_t *, uint16_t pc, emu6502_trap_fn fn,
+                             void *user);
+
+/* Set or, with NULL, clear the cycle callback. Only EMU6502_BUS_ACCURATE
+ * machines call it. */
+EMU6502_API void emu6502_on_cycle(emu6502_t *, emu6502_cycle_fn fn,
+                                  void *user);
+
+/* Load pc from the reset vector and clear any halt. Needed once after
+ * loading images and before running. */
+EMU6502_API void emu6502_reset(emu6502_t *);
+
+EMU6502_API enum emu6502_stop emu6502_step(emu6502_t *);
+/* Run until at least cycles cycles have passed or the machine stops. */
+EMU6502_API enum emu6502_stop emu6502_run_for(emu6502_t *, uint64_t cycles);
+/* Make the running emu6502_step()/emu6502_run_for() return
+ * EMU6502_STOP_USER, for use from device callbacks. */
+EMU6502_API void emu6502_request_stop(emu6502_t *);
+
+EMU6502_API uint64_t emu6502_cycles(const emu6502_t *);
+EMU6502_API void emu6502_get_regs(const emu6502_t *, emu6502_regs_t *);
+EMU6502_API void emu6502_set_regs(emu6502_t *, const emu6502_regs_t *);
+
+/* bus accesses, so these reach devices like the CPU's would */
+EMU6502_API uint8_t emu6502_read(emu6502_t *, uint16_t addr);
+EMU6502_API void emu6502_write(emu6502_t *, uint16_t addr, uint8_t val);
+/* len of them from addr on, wrapping at $ffff, with plain memory copied
+ * a page at a time */
+EMU6502_API void emu6502_read_block(emu6502_t *, uint16_t addr, uint8_t *dst,
+                                    size_t len);
+EMU6502_API void emu6502_write_block(emu6502_t *, uint16_t addr,
+                                     const uint8_t *src, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EMU6502_EMU6502_H_ */
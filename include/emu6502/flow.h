@@ -0,0 +1,67 @@
+#ifndef EMU6502_FLOW_H_
+#define EMU6502_FLOW_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* how a basic block ends */
+enum flow_end {
+    FLOW_FALL,      /* into the leader at next */
+    FLOW_BRANCH,    /* to target or next */
+    FLOW_JUMP,      /* to target, BRA included */
+    FLOW_CALL,      /* JSR to target, returning to next */
+    FLOW_INDIRECT,  /* JMP through a pointer */
+    FLOW_RETURN,    /* RTS or RTI */
+    FLOW_STOP,      /* BRK, a jam or into bytes that aren't code */
+};
+
+/* Straight-line code from start to end inclusive. */
+typedef struct flow_block {
+    uint16_t start, end;
+    enum flow_end kind;
+    uint16_t target, next;
+} flow_block_t;
+
+/* Control flow of the ROM of a machine, see flow.c. The maps have one bit
+ * per address: walk roots, instruction starts, instruction bytes and
+ * block starts. */
+typedef struct flow {
+    /* of the PRG contents and the CPU it was found for */
+    uint32_t hash;
+    uint8_t entry[0x2000];
+    uint8_t code[0x2000];
+    uint8_t body[0x2000];
+    uint8_t leader[0x2000];
+    flow_block_t *blocks;
+    unsigned n_blocks;
+    /* entries the file didn't have */
+    int dirty;
+    unsigned long refs;
+} flow_t;
+
+#define FLOW_SET(map, addr) ((map)[(addr)>>3] |= 1<<((addr)&7))
+#define FLOW_GET(map, addr) ((map)[(addr)>>3] >> ((addr)&7) & 1)
+
+struct instr;
+
+/* A walk through the code reachable from somewhere, see flow_follow().
+ * visit gets every instruction found with its length and, for branches
+ * and absolute jumps and calls, its target. It returns nonzero to not go
+ * on to the next instruction. */
+typedef struct flow_walker {
+    /* where the code is read from, memory_peek() or memory_peek_prg() */
+    int (*peek)(uint16_t, uint8_t *);
+    /* one bit per instruction start found, walks stop at ones set */
+    uint8_t *seen;
+    int (*visit)(void *, uint16_t, const struct instr *, unsigned, uint16_t);
+    void *data;
+} flow_walker_t;
+
+flow_t *flow_open(const char *);
+int flow_update(flow_t *, const char *);
+flow_t *flow_ref(flow_t *);
+void flow_unref(flow_t *);
+void flow_report(FILE *);
+void flow_follow(const flow_walker_t *, uint16_t);
+
+#endif /* EMU6502_FLOW_H_ */
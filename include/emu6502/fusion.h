@@ -0,0 +1,13 @@
+#ifndef EMU6502_FUSION_H_
+#define EMU6502_FUSION_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+void fusion_run(void);
+void fusion_run_until(uint64_t);
+int fusion_decoded(uint16_t);
+void fusion_profile_run(void);
+void fusion_profile_dump(FILE *, unsigned);
+
+#endif /* EMU6502_FUSION_H_ */
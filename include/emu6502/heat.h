@@ -0,0 +1,44 @@
+#ifndef EMU6502_HEAT_H_
+#define EMU6502_HEAT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* runs shorter than this aren't recorded */
+#define HEAT_MIN_RUN 4
+
+/* accesses with a constant stride, one per direction */
+typedef struct heat_stream {
+    uint16_t last, start;
+    int32_t stride;
+    uint32_t len;
+} heat_stream_t;
+
+/* runs that started at an address */
+typedef struct heat_run {
+    uint32_t count;
+    uint32_t len;
+    int32_t stride;
+} heat_run_t;
+
+/* Access counts of the current machine, see heat.c. Data reads and
+ * instruction fetches are counted apart. */
+typedef struct heat {
+    uint32_t fetches[0x10000];
+    uint32_t reads[0x10000];
+    uint32_t writes[0x10000];
+    /* lowest S seen on a stack access */
+    uint8_t min_s;
+    int stack_seen;
+    heat_stream_t stream[2];
+    heat_run_t runs[2][0x10000];
+    /* accesses in runs by kind: polls, sequential, strided */
+    uint64_t run_accesses[3];
+} heat_t;
+
+heat_t *heat_enable(void);
+void heat_access(heat_t *, uint16_t, int);
+int heat_write_image(FILE *);
+void heat_report(FILE *, unsigned);
+
+#endif /* EMU6502_HEAT_H_ */
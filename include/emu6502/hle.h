@@ -0,0 +1,36 @@
+#ifndef EMU6502_HLE_H_
+#define EMU6502_HLE_H_
+
+#include <stdint.h>
+
+/* Placed over the first byte of every trapped routine. It jams an NMOS
+ * 6502, so no working program executes it. */
+#define HLE_OPCODE 0x02
+
+/* Native replacement for a routine. Runs with the machine selected and
+ * returns 0 to return from the routine, positive to run it after all, or
+ * negative when it ran part of the routine itself and execution goes on
+ * at pc. */
+typedef int (*hle_fn_t)(void *);
+
+typedef struct hle_trap {
+    uint16_t pc;
+    uint8_t opcode;
+    hle_fn_t fn;
+    void *user;
+} hle_trap_t;
+
+/* traps of one machine, with a bitmap of trap sites per page */
+typedef struct hle {
+    uint32_t *pages[0x100];
+    hle_trap_t *traps;
+    unsigned n_traps;
+} hle_t;
+
+int hle_add(uint16_t, hle_fn_t, void *);
+int hle_load(const char *);
+int hle_trap(void);
+hle_t *hle_copy(const hle_t *);
+void hle_free(hle_t *);
+
+#endif /* EMU6502_HLE_H_ */
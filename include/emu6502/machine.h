@@ -0,0 +1,110 @@
+#ifndef EMU6502_MACHINE_H_
+#define EMU6502_MACHINE_H_
+
+#include <emu6502/cpu.h>
+#include <emu6502/dma.h>
+#include <emu6502/memory.h>
+#include <emu6502/rom.h>
+#include <stdint.h>
+
+/* page_flags */
+#define PAGE_READ     (1<<0) /* reads go straight to page_data */
+#define PAGE_WRITE    (1<<1) /* writes go straight to page_data */
+#define PAGE_PRIVATE  (1<<2) /* page_data belongs to this machine */
+#define PAGE_ALLOC    (1<<3) /* page_data was allocated for this machine */
+#define PAGE_READONLY (1<<4) /* drop writes instead of copying the page */
+/* PAGE_READ/PAGE_WRITE held back while accesses are traced for coverage
+ * or the heatmap */
+#define PAGE_TRACE_READ  (1<<5)
+#define PAGE_TRACE_WRITE (1<<6)
+
+/* flags */
+#define MACHINE_STDIO        (1<<0) /* console and diagnostics on stdio */
+#define MACHINE_TRAP_ILLEGAL (1<<1) /* halt on illegal opcodes */
+#define MACHINE_BUS_ACCURATE (1<<2) /* run the variant's exec_bus */
+
+/* halt */
+#define HALT_DEVICE  1 /* 1 written to $3fff */
+#define HALT_ILLEGAL 2 /* illegal opcode with MACHINE_TRAP_ILLEGAL */
+#define HALT_USER    3 /* asked to stop from outside */
+
+/* Everything one emulated machine owns. ROM contents live in shared
+ * rom_image_t buffers, so the private footprint is the RAM, the page
+ * tables and whatever PRG pages were written to. */
+typedef struct machine {
+    cpu_reg_t cpu;
+    const cpu_variant_t *variant;
+    int halt;
+    unsigned flags;
+    /* base cycles of everything executed since the machine was created,
+     * with MACHINE_BUS_ACCURATE the actual cycles */
+    uint64_t cycles;
+    uint8_t data_bus;
+
+    uint8_t page_flags[0x100];
+    uint8_t *page_data[0x100];
+    /* shared default layout until memory_map_page() changes it */
+    const memory_map_entry_t **map;
+    /* images pages may point into */
+    rom_image_t **roms;
+    unsigned n_roms;
+    /* lazy devices in map and the earliest of their next events */
+    memory_device_t **lazy;
+    unsigned n_lazy;
+    uint64_t next_event;
+    /* bank-switching hardware decoding PRG writes, if any */
+    struct cartridge *cart;
+    /* flat host view from memory_flat_enable(), NULL if there is none */
+    uint8_t *flat;
+    uint8_t *flat_prg;
+    uint16_t flat_fold;
+    /* RAM of a machine description, NULL in the default layout */
+    uint8_t *xram;
+    /* socket behind the doorbell at $3ff1, -1 for none, not owned */
+    int doorbell;
+    /* registers of the DMA controller, see dma.c */
+    dma_t dma;
+    /* native routines, see hle.c */
+    struct hle *hle;
+    /* see cover.c, NULL unless coverage is on */
+    struct cover *cover;
+    /* see heat.c, NULL unless profiling memory accesses */
+    struct heat *heat;
+    /* see flow.c, NULL unless the ROM was analysed */
+    struct flow *flow;
+    /* see memo.c, memo_rec only while a call is being recorded */
+    struct memo *memo;
+    struct memo_rec *memo_rec;
+    /* console at $3ff0 when it isn't on stdio */
+    uint8_t (*console_in)(void *);
+    void (*console_out)(void *, uint8_t);
+    void *console;
+    /* called after every cycle with MACHINE_BUS_ACCURATE, may be NULL */
+    void (*cycle_hook)(void *, uint64_t);
+    void *cycle_data;
+
+    uint8_t ram[0x800];
+} machine_t;
+
+/* the machine the cpu_* and memory_* functions operate on */
+extern __thread machine_t *current_machine;
+
+#define cpu_reg  (current_machine->cpu)
+#define cpu_halt (current_machine->halt)
+
+void machine_init(machine_t *);
+void machine_release(machine_t *);
+int machine_copy(machine_t *, const machine_t *);
+machine_t *machine_new(void);
+void machine_free(machine_t *);
+
+static inline void machine_select(machine_t *m) {
+    current_machine = m;
+}
+
+/* where addr lives in the flat view, RAM mirrors folded */
+static inline uint8_t *machine_flat(machine_t *m, uint16_t addr) {
+    return m->flat + (addr < 0x2000 ? addr & m->flat_fold : addr);
+}
+
+#endif /* EMU6502_MACHINE_H_ */
@@ -0,0 +1,35 @@
+#ifndef EMU6502_MAPPER_H_
+#define EMU6502_MAPPER_H_
+
+#include <emu6502/rom.h>
+#include <stdint.h>
+
+struct cartridge;
+
+/* Bank-switching hardware on a cartridge. Banks are window pages (of 256
+ * bytes) long, and switching one only repoints the page table at another
+ * part of the image. */
+typedef struct mapper {
+    const char *name;
+    unsigned window;
+    void (*reset)(struct cartridge *);
+    /* returns nonzero if the write hit one of the mapper's registers */
+    int (*write)(struct cartridge *, uint16_t, uint8_t);
+} mapper_t;
+
+typedef struct cartridge {
+    const mapper_t *mapper;
+    rom_image_t *img;
+    unsigned banks;
+} cartridge_t;
+
+const mapper_t *mapper_find(const char *);
+const char *mapper_names(void);
+
+int cartridge_insert(rom_image_t *, const mapper_t *);
+cartridge_t *cartridge_copy(const cartridge_t *);
+void cartridge_free(cartridge_t *);
+void cartridge_switch(cartridge_t *, uint16_t, unsigned);
+int cartridge_write(cartridge_t *, uint16_t, uint8_t);
+
+#endif /* EMU6502_MAPPER_H_ */
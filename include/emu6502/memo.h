@@ -0,0 +1,81 @@
+#ifndef EMU6502_MEMO_H_
+#define EMU6502_MEMO_H_
+
+#include <emu6502/cpu.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* calls remembered per routine, the oldest goes when it is full */
+#define MEMO_ENTRIES 1024
+#define MEMO_BUCKETS 256
+/* sets of inputs per routine, calls with yet another aren't kept */
+#define MEMO_SIGS 8
+
+/* registers in memo masks, above the flags of P */
+#define MEMO_A (1<<8)
+#define MEMO_X (1<<9)
+#define MEMO_Y (1<<10)
+#define MEMO_S (1<<11)
+
+/* A byte a call read before writing it, or what it left there. Stack
+ * bytes are offsets from S at the call. */
+typedef struct memo_byte {
+    uint16_t addr;
+    uint8_t val;
+    uint8_t stack;
+} memo_byte_t;
+
+/* What calls that took the same path read: registers and flags in
+ * in_mask and the bytes in reads, whose values go unused. */
+typedef struct memo_sig {
+    uint16_t in_mask;
+    unsigned n_reads;
+    memo_byte_t *reads;
+} memo_sig_t;
+
+/* one recorded call, up to the RTS that ends it */
+typedef struct memo_entry {
+    /* next in its hash bucket */
+    struct memo_entry *next;
+    uint32_t hash;
+    unsigned sig;
+    cpu_reg_t in, out;
+    uint16_t out_mask;
+    uint32_t cycles;
+    /* values of the reads of sig, then the bytes written */
+    uint8_t *in_vals;
+    memo_byte_t *writes;
+    unsigned n_writes;
+} memo_entry_t;
+
+typedef struct memo_routine {
+    uint16_t pc;
+    /* the first opcode, under the trap */
+    uint8_t opcode;
+    /* touched I/O or did something else that can't be replayed */
+    int impure;
+    memo_sig_t sigs[MEMO_SIGS];
+    unsigned n_sigs;
+    /* MEMO_ENTRIES once something is kept */
+    memo_entry_t *entries;
+    memo_entry_t *buckets[MEMO_BUCKETS];
+    unsigned n_entries, next;
+    uint64_t hits, misses;
+} memo_routine_t;
+
+/* Memoized routines of a machine, shared with its copies like ROM images,
+ * so copies have to run on the same thread. */
+typedef struct memo {
+    memo_routine_t **routines;
+    unsigned n_routines;
+    unsigned long refs;
+} memo_t;
+
+int memo_add(uint16_t);
+int memo_load(const char *);
+void memo_access(uint16_t, int, int);
+memo_t *memo_ref(memo_t *);
+void memo_unref(memo_t *);
+void memo_report(FILE *);
+
+#endif /* EMU6502_MEMO_H_ */
@@ -4,18 +4,75 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+struct memory_map_entry;
+
+/* A device that is only brought up to date when it is accessed or when
+ * its next event comes due, instead of being advanced every instruction.
+ * Every machine it is mapped into has its own, made by the lazy callback
+ * of its map entry, and machine copies get theirs from copy. catch_up runs
+ * the device from synced to the given cycle and may move next_event,
+ * UINT64_MAX when nothing is due. diff is nonzero when two states of the
+ * device differ, for checking runs against each other. Devices put this
+ * first in a struct of their state and find it with memory_device(). */
+typedef struct memory_device {
+    void (*catch_up)(struct memory_device *, uint64_t);
+    struct memory_device *(*copy)(const struct memory_device *);
+    void (*free)(struct memory_device *);
+    int (*diff)(const struct memory_device *, const struct memory_device *);
+    /* the entry it was made for, set by memory.c */
+    const struct memory_map_entry *entry;
+    uint64_t synced;
+    uint64_t next_event;
+} memory_device_t;
+
 typedef struct memory_map_entry {
     void (*read)(uint8_t *, uint16_t);
     void (*write)(uint8_t *, uint16_t);
+    /* makes the state of the device for a machine, caught up before read
+     * and write, NULL for devices without timing */
+    memory_device_t *(*lazy)(void);
+    /* for reports, may be NULL */
+    const char *name;
 } memory_map_entry_t;
 
+struct machine;
+struct rom_image;
+
+/* memory_map_rom() flags */
+#define MEMORY_ROM_READONLY (1<<0)
+
 void memory_map_page(const memory_map_entry_t *const, uint16_t);
+void memory_map_default_page(const memory_map_entry_t *const, uint16_t);
+void memory_map_rom(struct rom_image *, uint16_t, int);
+void memory_map_rom_segment(struct rom_image *, size_t, size_t, uint16_t, int);
+void memory_map_bank(const uint8_t *, uint16_t, unsigned);
+uint8_t *memory_flat_enable(void);
+int memory_patch(uint16_t, uint8_t);
+int memory_map_shared(uint8_t *, uint16_t, size_t);
+int memory_map_clear(void);
+int memory_map_ram(uint16_t, size_t, uint32_t);
+void memory_map_prg(uint16_t, uint32_t);
+void memory_machine_init(struct machine *);
+void memory_machine_release(struct machine *);
+int memory_machine_copy(struct machine *, const struct machine *);
+int memory_machine_shared(const struct machine *);
 void memory_init(void);
 uint8_t memory_read(uint16_t);
+int memory_peek(uint16_t, uint8_t *);
+int memory_peek_prg(uint16_t, uint8_t *);
 uint16_t memory_read_w(uint16_t);
+uint16_t memory_read_zp_w(uint8_t);
+uint16_t memory_read_w_page(uint16_t);
 void memory_write(uint16_t, uint8_t);
 void memory_write_w(uint16_t, uint16_t);
-void memory_load_rom(uint8_t *, size_t);
-void memory_load_rom_addr(uint8_t *, size_t, uint16_t);
+void memory_read_block(uint16_t, uint8_t *, size_t);
+void memory_write_block(uint16_t, const uint8_t *, size_t);
+memory_device_t *memory_device(const memory_map_entry_t *);
+const memory_map_entry_t *memory_device_diff(const struct machine *,
+                                             const struct machine *);
+void memory_schedule(memory_device_t *, uint64_t);
+void memory_sync_due(void);
+void memory_load_rom(const uint8_t *, size_t);
+void memory_load_rom_addr(const uint8_t *, size_t, uint16_t);
 
 #endif /* EMU6502_MEMORY_H_ */
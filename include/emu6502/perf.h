@@ -0,0 +1,26 @@
+#ifndef EMU6502_PERF_H_
+#define EMU6502_PERF_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* The opcode this thread is running and how many of each it ran, which
+ * the engines note for the host counters of perf.c to be charged to, only
+ * while they count. Instrumentation like the stats, and compiled out with
+ * them. */
+extern __thread uint8_t perf_opcode;
+extern __thread uint64_t *perf_ops;
+
+#ifdef EMU6502_NO_STATS
+#define PERF_NOTE(opcode) ((void)0)
+#else
+#define PERF_NOTE(opcode) do {                               \
+            if(perf_ops) perf_ops[perf_opcode = (opcode)]++; \
+        } while(0)
+#endif
+
+int perf_start(void);
+void perf_stop(void);
+void perf_report(FILE *, const char *);
+
+#endif /* EMU6502_PERF_H_ */
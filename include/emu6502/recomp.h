@@ -0,0 +1,102 @@
+#ifndef EMU6502_RECOMP_H_
+#define EMU6502_RECOMP_H_
+
+/* Runtime interface for C code emitted by emu6502-recomp. Every routine is
+ * compiled to a function that runs with the CPU state in cpu_reg and returns
+ * to the dispatcher in runtime.c whenever control leaves the code it knows
+ * about.
+ *
+ * Every instruction adds its cycles before it runs, like the interpreter,
+ * so devices see the same time when they are accessed. Events that come
+ * due without an access are only caught up at the labels of the code,
+ * which every loop passes through, a few instructions later than the
+ * interpreter would. */
+
+#include <emu6502/machine.h>
+#include <emu6502/alu.h>
+#include <emu6502/memory.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*recomp_fn_t)(void);
+
+/* provided by the generated file */
+extern const recomp_fn_t recomp_table[0x10000];
+extern const uint8_t recomp_image[];
+extern const size_t recomp_image_size;
+extern const uint16_t recomp_image_addr;
+/* the CPU variant the code was translated for, see cpu_variant_find() */
+extern const char recomp_cpu[];
+
+/* native call depth after which JSR unwinds to the dispatcher instead */
+#define RECOMP_MAX_DEPTH 256
+
+extern unsigned recomp_depth;
+
+/* leave the routine if a store halted or reset the CPU */
+#define RC_SYNC(next) \
+    if(cpu_halt || cpu_reg.pc != (next)) return
+
+/* catch up the devices whose events are due before the instruction at
+ * addr, and leave if one of them halted the CPU */
+#define RC_DUE(addr) \
+    if(current_machine->cycles >= current_machine->next_event) { \
+        memory_sync_due();                                      \
+        if(cpu_halt) {                                          \
+            cpu_reg.pc = (addr);                                \
+            return;                                             \
+        }                                                       \
+    }
+
+#define RC_CYCLES(n) (current_machine->cycles += (n))
+/* the cycle more ADC and SBC take in decimal mode on the 65C02 */
+#define RC_DECIMAL_CYCLE() \
+    if(HAS_FLAG(FLAGS_DECIMAL)) current_machine->cycles++
+
+#define RC_PUSH(v)  memory_write(0x100 + (uint8_t)(cpu_reg.s--), (v))
+#define RC_PULL()   memory_read(0x100 + (uint8_t)(++cpu_reg.s))
+
+/* stores leave the flags alone, read-modify-writes set N and Z from what
+ * they write back, like the interpreter */
+#define RC_ST(ea, v) memory_write((ea), (v))
+#define RC_RMW(ea, op) do {       \
+            uint16_t ea_ = (ea);  \
+            uint8_t v_ = op(memory_read(ea_)); \
+            memory_write(ea_, v_); \
+            alu_nz(v_);           \
+        } while(0)
+#define RC_INC_(v) ((uint8_t)((v)+1))
+#define RC_DEC_(v) ((uint8_t)((v)-1))
+
+/* the stack wraps within page 1, so words on it go a byte at a time */
+#define RC_JSR(ret) do {                   \
+            RC_PUSH(((ret)-1) >> 8);       \
+            RC_PUSH(((ret)-1) & 0xff);     \
+        } while(0)
+#define RC_CALL(fn, target, ret) do {         \
+            cpu_reg.pc = (target);              \
+            if(recomp_depth >= RECOMP_MAX_DEPTH) return; \
+            ++recomp_depth, fn(), --recomp_depth; \
+            RC_SYNC(ret);                       \
+        } while(0)
+#define RC_RTS() do {                          \
+            uint8_t l_ = RC_PULL();            \
+            cpu_reg.pc = (l_ | RC_PULL()<<8) + 1; \
+        } while(0)
+#define RC_RTI() do {                          \
+            uint8_t l_;                        \
+            cpu_reg.p = RC_PULL();             \
+            l_ = RC_PULL();                    \
+            cpu_reg.pc = l_ | RC_PULL()<<8;    \
+        } while(0)
+#define RC_BRK() do {                                  \
+            RC_PUSH((cpu_reg.pc+1) >> 8);              \
+            RC_PUSH((cpu_reg.pc+1) & 0xff);            \
+            RC_PUSH(cpu_reg.p|FLAGS_BREAK);            \
+            cpu_reg.p |= FLAGS_BREAK|FLAGS_INTERRUPT;  \
+            cpu_reg.pc = memory_read_w(0xfffe);        \
+        } while(0)
+
+void recomp_run(void);
+
+#endif /* EMU6502_RECOMP_H_ */
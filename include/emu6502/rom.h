@@ -0,0 +1,24 @@
+#ifndef EMU6502_ROM_H_
+#define EMU6502_ROM_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Read-only ROM image, shared by every machine that maps it. Machines only
+ * hold references; pages they write to are copied on write. Images loaded
+ * from files are mmap'd, so they are never copied at all and may be larger
+ * than the address space for bank switching. */
+typedef struct rom_image {
+    const uint8_t *data;
+    size_t size;
+    unsigned long refs;
+    /* the mapping backing data, NULL when data is malloc'd with the image */
+    void *map;
+} rom_image_t;
+
+rom_image_t *rom_image_new(const uint8_t *, size_t);
+rom_image_t *rom_image_load(const char *);
+rom_image_t *rom_image_ref(rom_image_t *);
+void rom_image_unref(rom_image_t *);
+
+#endif /* EMU6502_ROM_H_ */
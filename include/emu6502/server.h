@@ -0,0 +1,6 @@
+#ifndef EMU6502_SERVER_H_
+#define EMU6502_SERVER_H_
+
+int server_run(const char *);
+
+#endif /* EMU6502_SERVER_H_ */
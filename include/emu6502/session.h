@@ -0,0 +1,8 @@
+#ifndef EMU6502_SESSION_H_
+#define EMU6502_SESSION_H_
+
+struct machine;
+
+int session_run(const char *, const struct machine *, unsigned);
+
+#endif /* EMU6502_SESSION_H_ */
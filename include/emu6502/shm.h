@@ -0,0 +1,11 @@
+#ifndef EMU6502_SHM_H_
+#define EMU6502_SHM_H_
+
+#include <stdint.h>
+
+int shm_map(const char *);
+int shm_doorbell_connect(const char *);
+uint8_t shm_doorbell_read(void);
+void shm_doorbell_write(uint8_t);
+
+#endif /* EMU6502_SHM_H_ */
@@ -0,0 +1,41 @@
+#ifndef EMU6502_STATS_H_
+#define EMU6502_STATS_H_
+
+#include <stdint.h>
+
+/* the main thread and the most threads any mode runs at once, the
+ * session workers, the verify threads or the CPUs of a board */
+#define STATS_MAX_THREADS 65
+
+/* Counters for one thread at a time. Only the thread owning them writes
+ * them, the dumps read them racily, which is fine for monitoring. */
+typedef struct stats {
+    uint64_t instructions;
+    uint64_t cycles;
+    uint64_t reads, writes;
+    /* accesses that went through memory_map, per 16 byte block */
+    uint64_t device_reads[0x1000];
+    uint64_t device_writes[0x1000];
+    uint64_t illegal;
+    uint64_t fuse_hits, fuse_misses;
+    uint64_t memo_hits, memo_misses;
+    uint64_t resets;
+    /* lazy devices brought up to date */
+    uint64_t device_syncs;
+} stats_t;
+
+/* Threads share the first slot until they call stats_thread_init(). */
+extern __thread stats_t *stats_local;
+
+#ifdef EMU6502_NO_STATS
+#define STAT_ADD(field, n) ((void)0)
+#else
+#define STAT_ADD(field, n) (stats_local->field += (n))
+#endif
+#define STAT_INC(field) STAT_ADD(field, 1)
+
+int stats_thread_init(void);
+int stats_enable(const char *, unsigned);
+void stats_dump(int);
+
+#endif /* EMU6502_STATS_H_ */
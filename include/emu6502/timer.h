@@ -0,0 +1,15 @@
+#ifndef EMU6502_TIMER_H_
+#define EMU6502_TIMER_H_
+
+#include <stdint.h>
+
+/* control register */
+#define TIMER_CONTINUOUS (1<<0) /* reload from the latch on running out */
+#define TIMER_HALT       (1<<1) /* stop the machine on running out */
+
+/* status register */
+#define TIMER_DONE (1<<7) /* ran out since the last read */
+
+void timer_map_at(uint16_t);
+
+#endif /* EMU6502_TIMER_H_ */
@@ -0,0 +1,16 @@
+#ifndef EMU6502_VERIFY_H_
+#define EMU6502_VERIFY_H_
+
+#include <stdint.h>
+
+struct machine;
+
+/* what segments of the recorded run are replayed on */
+enum verify_engine {
+    VERIFY_STEP,    /* the plain interpreter, one instruction at a time */
+    VERIFY_FUSED,   /* the engine that recorded them */
+};
+
+int verify_run(struct machine *, enum verify_engine, uint64_t, unsigned);
+
+#endif /* EMU6502_VERIFY_H_ */
@@ -0,0 +1,66 @@
+#include <emu6502/alu.h>
+#include <pthread.h>
+
+/* Decimal mode as the chips do it, including what they make of digits
+ * above 9, after Bruce Clark's "Decimal Mode" tutorial on 6502.org.
+ * Everything is worked out once for every carry, accumulator and operand,
+ * so ADC and SBC in decimal mode cost a table lookup like binary ones. */
+
+bcd_table_t bcd_adc_nmos, bcd_sbc_nmos, bcd_adc_65c02, bcd_sbc_65c02;
+
+static pthread_once_t bcd_once = PTHREAD_ONCE_INIT;
+
+static uint16_t bcd_entry(unsigned a, unsigned n, unsigned v, unsigned z,
+                          unsigned c) {
+    return (a & 0xff)
+        | (n ? FLAGS_NEGATIVE : 0) << 8 | (v ? FLAGS_OVERFLOW : 0) << 8
+        | (z ? FLAGS_ZERO : 0) << 8 | (c ? FLAGS_CARRY : 0) << 8;
+}
+
+static void bcd_fill(void) {
+    int c, a, b;
+
+    for(c = 0; c < 2; ++c)
+        for(a = 0; a < 0x100; ++a)
+            for(b = 0; b < 0x100; ++b) {
+                int lo, sum, sig, bin, diff;
+
+                /* ADC: N and V come from the sum before the high digit is
+                 * adjusted, Z from the binary sum on NMOS */
+                lo = (a&0x0f) + (b&0x0f) + c;
+                if(lo >= 0x0a) lo = ((lo + 0x06) & 0x0f) + 0x10;
+                sum = (a&0xf0) + (b&0xf0) + lo;
+                sig = (int8_t)(a&0xf0) + (int8_t)(b&0xf0) + lo;
+                if(sum >= 0xa0) sum += 0x60;
+                bin = a + b + c;
+                bcd_adc_nmos[c][a][b] = bcd_entry(sum, sig&0x80,
+                                                  sig < -128 || sig > 127,
+                                                  !(bin&0xff), sum >= 0x100);
+                bcd_adc_65c02[c][a][b] = bcd_entry(sum, sum&0x80,
+                                                   sig < -128 || sig > 127,
+                                                   !(sum&0xff), sum >= 0x100);
+
+                /* SBC: the flags are those of the binary difference, except
+                 * for N and Z on the 65C02 */
+                bin = a - b - !c;
+                lo = (a&0x0f) - (b&0x0f) - !c;
+                if(lo < 0) lo = ((lo - 0x06) & 0x0f) - 0x10;
+                diff = (a&0xf0) - (b&0xf0) + lo;
+                if(diff < 0) diff -= 0x60;
+                bcd_sbc_nmos[c][a][b] = bcd_entry(diff, bin&0x80,
+                                                  (a^b) & (a^bin) & 0x80,
+                                                  !(bin&0xff), bin >= 0);
+
+                diff = bin;
+                if(diff < 0) diff -= 0x60;
+                if((a&0x0f) - (b&0x0f) - !c < 0) diff -= 0x06;
+                bcd_sbc_65c02[c][a][b] = bcd_entry(diff, diff&0x80,
+                                                   (a^b) & (a^bin) & 0x80,
+                                                   !(diff&0xff), bin >= 0);
+            }
+}
+
+/* safe to call from any thread, fills the tables the first time */
+void bcd_init(void) {
+    (void)pthread_once(&bcd_once, bcd_fill);
+}
@@ -0,0 +1,260 @@
+#define _POSIX_C_SOURCE 200809L
+#include <emu6502/board.h>
+#include <emu6502/cpu.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/stats.h>
+#include <emu6502/utils.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Several CPUs, each a machine of its own on a host thread, that share a
+ * RAM window and exchange bytes through mailboxes. They run in quanta of
+ * a fixed number of cycles. Within a quantum every CPU sees the shared
+ * window as it was at the start plus its own writes. At the barrier the
+ * bytes each CPU changed are merged in CPU order, so a later CPU wins
+ * when two wrote the same byte. Mail and console output are published at
+ * the barrier too. Results therefore don't depend on how the host
+ * schedules the threads.
+ *
+ * Mailbox registers at $3fe0:
+ *   $3fe0 read   number of this CPU
+ *   $3fe1 read   messages waiting, at most 255
+ *   $3fe2 read   next message, 0 if there is none
+ *   $3fe3 read   CPU that sent the last message read
+ *   $3fe8+n      write to send a byte to CPU n
+ * Messages are read lowest sender first. */
+
+#if BOARD_MAX_CPUS >= STATS_MAX_THREADS
+#error "board CPUs need a stats slot each"
+#endif
+
+#define MAILBOX_ADDR 0x3fe0
+#define MAILBOX_SIZE 0x100
+
+/* Single producer, single consumer ring. Only the sender moves tail and
+ * only the receiver moves head. Each side looks at the other's index as
+ * of the last barrier, so no locks are needed. */
+typedef struct mailbox {
+    uint8_t data[MAILBOX_SIZE];
+    unsigned head, tail;
+    unsigned head_seen, tail_seen;
+} mailbox_t;
+
+typedef struct board_cpu {
+    struct board *board;
+    machine_t *m;
+    unsigned id;
+    uint8_t *view;
+    uint8_t *out;
+    size_t out_len, out_cap;
+    uint8_t last_from;
+    int reported;
+    pthread_t thread;
+} board_cpu_t;
+
+struct board {
+    unsigned n;
+    uint64_t quantum, end;
+    uint16_t shared_addr;
+    size_t shared_size;
+    uint8_t *master, *base;
+    board_cpu_t cpus[BOARD_MAX_CPUS];
+    /* [from][to] */
+    mailbox_t mail[BOARD_MAX_CPUS][BOARD_MAX_CPUS];
+    pthread_barrier_t barrier;
+    int done;
+};
+
+static __thread board_cpu_t *board_self = NULL;
+
+static void mailbox_read(uint8_t *bus, uint16_t addr) {
+    board_cpu_t *cpu = board_self;
+    unsigned from, count = 0;
+    if(!cpu) return;
+
+    switch(addr) {
+    case MAILBOX_ADDR:
+        *bus = cpu->id;
+        break;
+
+    case MAILBOX_ADDR+1:
+        for(from = 0; from < cpu->board->n; ++from) {
+            const mailbox_t *box = &cpu->board->mail[from][cpu->id];
+            count += box->tail_seen - box->head;
+        }
+        *bus = count > 0xff ? 0xff : count;
+        break;
+
+    case MAILBOX_ADDR+2:
+        *bus = 0;
+        for(from = 0; from < cpu->board->n; ++from) {
+            mailbox_t *box = &cpu->board->mail[from][cpu->id];
+            if(box->head == box->tail_seen) continue;
+            *bus = box->data[box->head++ % MAILBOX_SIZE];
+            cpu->last_from = from;
+            break;
+        }
+        break;
+
+    case MAILBOX_ADDR+3:
+        *bus = cpu->last_from;
+        break;
+    }
+}
+
+static void mailbox_write(uint8_t *bus, uint16_t addr) {
+    board_cpu_t *cpu = board_self;
+    unsigned to = addr - (MAILBOX_ADDR+8);
+    mailbox_t *box;
+    if(!cpu || addr < MAILBOX_ADDR+8 || to >= cpu->board->n) return;
+    box = &cpu->board->mail[cpu->id][to];
+    /* dropped when full */
+    if(box->tail - box->head_seen < MAILBOX_SIZE)
+        box->data[box->tail++ % MAILBOX_SIZE] = *bus;
+}
+
+static const memory_map_entry_t mailbox_entry = {
+    .read = mailbox_read,
+    .write = mailbox_write,
+    .name = "mailbox",
+};
+
+/* only the first CPU gets stdin, the rest would race for it */
+static uint8_t board_console_in(void *data) {
+    board_cpu_t *cpu = data;
+    return cpu->id ? 0xff : (uint8_t)getchar();
+}
+
+static void board_console_out(void *data, uint8_t val) {
+    board_cpu_t *cpu = data;
+    if(cpu->out_len == cpu->out_cap) {
+        size_t cap = cpu->out_cap ? cpu->out_cap*2 : 0x100;
+        if(!(cpu->out = realloc(cpu->out, cap)))
+            die("[Error] Out of memory\n");
+        cpu->out_cap = cap;
+    }
+    cpu->out[cpu->out_len++] = val;
+}
+
+/* between quanta, on the first CPU's thread while the others wait */
+static void board_sync(board_t *b) {
+    unsigned i, j, halted = 0;
+    size_t k;
+
+    for(i = 0; i < b->n; ++i)
+        for(k = 0; k < b->shared_size; ++k)
+            if(b->cpus[i].view[k] != b->base[k])
+                b->master[k] = b->cpus[i].view[k];
+    (void)memcpy(b->base, b->master, b->shared_size);
+    for(i = 0; i < b->n; ++i)
+        (void)memcpy(b->cpus[i].view, b->master, b->shared_size);
+
+    for(i = 0; i < b->n; ++i)
+        for(j = 0; j < b->n; ++j) {
+            b->mail[i][j].tail_seen = b->mail[i][j].tail;
+            b->mail[i][j].head_seen = b->mail[i][j].head;
+        }
+
+    for(i = 0; i < b->n; ++i) {
+        board_cpu_t *cpu = &b->cpus[i];
+        (void)fwrite(cpu->out, 1, cpu->out_len, stdout);
+        cpu->out_len = 0;
+        if(cpu->m->halt == HALT_ILLEGAL && !cpu->reported) {
+            fprintf(stderr, "[Error] CPU %u: Illegal opcode at $%04x\n",
+                    i, (uint16_t)(cpu->m->cpu.pc-1));
+            cpu->reported = 1;
+        }
+        halted += !!cpu->m->halt;
+    }
+    (void)fflush(stdout);
+    b->done = halted == b->n;
+    b->end += b->quantum;
+}
+
+static void *board_worker(void *data) {
+    board_cpu_t *cpu = data;
+    board_t *b = cpu->board;
+
+    (void)stats_thread_init();
+    machine_select(cpu->m);
+    board_self = cpu;
+    for(;;) {
+        /* quanta end at fixed cycle counts, not wherever the last one
+         * overshot to */
+        if(!cpu->m->halt && cpu->m->cycles < b->end)
+            cpu_run_for(b->end - cpu->m->cycles);
+        (void)pthread_barrier_wait(&b->barrier);
+        if(cpu->id == 0) board_sync(b);
+        (void)pthread_barrier_wait(&b->barrier);
+        if(b->done) break;
+    }
+    return NULL;
+}
+
+/* n CPUs, each set up by setup, sharing size bytes from addr */
+board_t *board_new(unsigned n, uint64_t quantum, uint16_t addr, size_t size,
+                   board_setup_fn setup) {
+    board_t *b;
+    unsigned i;
+
+    if(!n || n > BOARD_MAX_CPUS || !quantum
+       || (addr | size) & 0xff || (uint32_t)addr + size > 0x10000)
+        return NULL;
+    if(!(b = calloc(1, sizeof *b))) return NULL;
+    b->n = n;
+    b->quantum = b->end = quantum;
+    b->shared_addr = addr;
+    b->shared_size = size;
+    if(!(b->master = calloc(1, size)) || !(b->base = calloc(1, size)))
+        die("[Error] Out of memory\n");
+
+    for(i = 0; i < n; ++i) {
+        board_cpu_t *cpu = &b->cpus[i];
+        cpu->board = b;
+        cpu->id = i;
+        if(!(cpu->m = machine_new()) || !(cpu->view = calloc(1, size)))
+            die("[Error] Out of memory\n");
+        machine_select(cpu->m);
+        cpu->m->flags = MACHINE_TRAP_ILLEGAL;
+        cpu->m->console_in = board_console_in;
+        cpu->m->console_out = board_console_out;
+        cpu->m->console = cpu;
+        if(setup(i)) {
+            board_free(b);
+            return NULL;
+        }
+        if(size) (void)memory_map_shared(cpu->view, addr, size);
+        memory_map_page(&mailbox_entry, MAILBOX_ADDR);
+        cpu_init();
+    }
+    return b;
+}
+
+int board_run(board_t *b) {
+    unsigned i;
+
+    if(pthread_barrier_init(&b->barrier, NULL, b->n)) return -1;
+    for(i = 0; i < b->n; ++i)
+        if(pthread_create(&b->cpus[i].thread, NULL, board_worker, &b->cpus[i]))
+            die("[Error] Cannot create thread\n");
+    for(i = 0; i < b->n; ++i)
+        (void)pthread_join(b->cpus[i].thread, NULL);
+    (void)pthread_barrier_destroy(&b->barrier);
+    return 0;
+}
+
+void board_free(board_t *b) {
+    unsigned i;
+    if(!b) return;
+    for(i = 0; i < b->n; ++i) {
+        machine_free(b->cpus[i].m);
+        free(b->cpus[i].view);
+        free(b->cpus[i].out);
+    }
+    free(b->master);
+    free(b->base);
+    free(b);
+}
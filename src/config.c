@@ -0,0 +1,322 @@
+#define _POSIX_C_SOURCE 200809L
+#include <emu6502/config.h>
+#include <emu6502/cpu.h>
+#include <emu6502/dma.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/rom.h>
+#include <emu6502/mapper.h>
+#include <emu6502/shm.h>
+#include <emu6502/timer.h>
+#include <emu6502/utils.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Machine descriptions, replacing the default layout of RAM at
+ * $0000-$1fff, DMA at $3fd0, I/O at $3ff0 and PRG from $4020. Lines are
+ * one of
+ *
+ *   cpu NAME                              nmos, 65c02 or 2a03
+ *   ram ADDR SIZE [mirror END]            RAM repeated up to END inclusive
+ *   prg ADDR SIZE                         space command line roms map into
+ *   rom FILE ADDR [OFFSET [SIZE]] [readonly]
+ *   cartridge FILE MAPPER                 bank-switched at $8000-$ffff
+ *   io ADDR                               console, doorbell and halt
+ *   dma ADDR                              DMA controller, see dma.c
+ *   timer ADDR                            countdown timer, see timer.c
+ *   shared SRC ADDR SIZE                  like --shm=SRC@ADDR,SIZE
+ *
+ * with # starting a comment and numbers in C syntax or $hex. Images are
+ * loaded and every region is checked against the others when the file is
+ * read, so a bad description fails at startup and not in a machine.
+ *
+ * Applying one builds the same map and page table the default layout has:
+ * RAM and ROM pages point straight at their memory, mirrors included, and
+ * only device blocks have callbacks. */
+
+#define MAX_TOKENS 8
+
+static machine_config_t **configs = NULL;
+static unsigned n_configs = 0;
+
+static int config_num(const char *s, unsigned long max, unsigned long *out) {
+    char *end;
+    *out = *s == '$' ? strtoul(s+1, &end, 16) : strtoul(s, &end, 0);
+    return end == s || *end || *out > max ? -1 : 0;
+}
+
+static void config_free(machine_config_t *cfg) {
+    unsigned i;
+    for(i = 0; i < cfg->n_regions; ++i) {
+        if(cfg->regions[i].img) rom_image_unref(cfg->regions[i].img);
+        free(cfg->regions[i].spec);
+    }
+    free(cfg->regions);
+    free(cfg->path);
+    free(cfg);
+}
+
+/* fill in r from the tokens of a line, without the directive */
+static int config_region(config_region_t *r, char **tok, unsigned n,
+                         const char *path) {
+    unsigned long addr, size, end, off = 0;
+
+    switch(r->kind) {
+    case CONFIG_RAM:
+        if((n != 2 && (n != 4 || strcmp(tok[2], "mirror")))
+           || config_num(tok[0], 0xffff, &addr)
+           || config_num(tok[1], 0x10000, &size)
+           || (n == 4 && config_num(tok[3], 0xffff, &end))) return -1;
+        r->addr = addr;
+        r->size = size;
+        r->end = n == 4 ? end + 1 : addr + size;
+        if((addr | size | r->end) & 0xff || !size || r->end < addr + size) {
+            fprintf(stderr, "[Error] %s:%u: RAM has to be whole pages\n",
+                    path, r->line);
+            return 1;
+        }
+        return 0;
+
+    case CONFIG_PRG:
+        if(n != 2 || config_num(tok[0], 0xffff, &addr)
+           || config_num(tok[1], 0x10000 - addr, &size) || !size) return -1;
+        r->addr = addr;
+        r->end = addr + size;
+        return 0;
+
+    case CONFIG_ROM:
+        if(n < 2) return -1;
+        if(!strcmp(tok[n-1], "readonly")) {
+            r->flags |= MEMORY_ROM_READONLY;
+            n--;
+        }
+        size = (unsigned long)-1;
+        if(n < 2 || n > 4 || config_num(tok[1], 0xffff, &addr)
+           || (n > 2 && config_num(tok[2], (unsigned long)-1, &off))
+           || (n > 3 && config_num(tok[3], (unsigned long)-1, &size)))
+            return -1;
+        if(!(r->img = rom_image_load(tok[0]))) {
+            perror(tok[0]);
+            return 1;
+        }
+        if(off >= r->img->size) {
+            fprintf(stderr, "[Error] %s:%u: '%s' is only %zu bytes\n",
+                    path, r->line, tok[0], r->img->size);
+            return 1;
+        }
+        if(size > r->img->size - off) size = r->img->size - off;
+        if(size > 0x10000 - addr) {
+            fprintf(stderr, "[Error] %s:%u: '%s' doesn't fit at $%04lx\n",
+                    path, r->line, tok[0], addr);
+            return 1;
+        }
+        r->addr = addr;
+        r->end = addr + size;
+        r->size = size;
+        r->off = off;
+        return 0;
+
+    case CONFIG_CARTRIDGE:
+        if(n != 2) return -1;
+        if(!(r->mapper = mapper_find(tok[1]))) {
+            fprintf(stderr, "[Error] %s:%u: unknown mapper '%s', try one of "
+                    "%s\n", path, r->line, tok[1], mapper_names());
+            return 1;
+        }
+        if(!(r->img = rom_image_load(tok[0]))) {
+            perror(tok[0]);
+            return 1;
+        }
+        if(r->img->size < (size_t)r->mapper->window<<8) {
+            fprintf(stderr, "[Error] %s:%u: '%s' is too small for mapper "
+                    "%s\n", path, r->line, tok[0], r->mapper->name);
+            return 1;
+        }
+        r->addr = 0x8000;
+        r->end = 0x10000;
+        return 0;
+
+    case CONFIG_IO:
+    case CONFIG_DMA:
+    case CONFIG_TIMER:
+        if(n != 1 || config_num(tok[0], 0xffff, &addr) || addr & 0xf)
+            return -1;
+        r->addr = addr;
+        r->end = addr + 0x10;
+        return 0;
+
+    case CONFIG_SHARED:
+        if(n != 3 || config_num(tok[1], 0xffff, &addr)
+           || config_num(tok[2], 0x10000 - addr, &size)) return -1;
+        if((addr | size) & 0xff || !size) {
+            fprintf(stderr, "[Error] %s:%u: shared windows have to be whole "
+                    "pages\n", path, r->line);
+            return 1;
+        }
+        if(!(r->spec = malloc(strlen(tok[0]) + 16)))
+            die("[Error] Out of memory\n");
+        (void)sprintf(r->spec, "%s@%lu,%lu", tok[0], addr, size);
+        r->addr = addr;
+        r->end = addr + size;
+        return 0;
+    }
+    return -1;
+}
+
+/* every 16 byte block belongs to at most one region */
+static int config_check(const machine_config_t *cfg) {
+    static unsigned owner[0x1000];
+    uint32_t block;
+    unsigned i;
+
+    (void)memset(owner, 0, sizeof owner);
+    for(i = 0; i < cfg->n_regions; ++i) {
+        const config_region_t *r = &cfg->regions[i];
+        for(block = r->addr>>4; block < (r->end+0xf)>>4; ++block) {
+            if(owner[block]) {
+                fprintf(stderr, "[Error] %s:%u: $%04x-$%04x overlaps line "
+                        "%u\n", cfg->path, r->line, (unsigned)r->addr,
+                        (unsigned)r->end - 1,
+                        cfg->regions[owner[block]-1].line);
+                return -1;
+            }
+            owner[block] = i + 1;
+        }
+    }
+    return 0;
+}
+
+static machine_config_t *config_load(const char *path) {
+    static const char *kinds[] = {
+        [CONFIG_RAM] = "ram", [CONFIG_PRG] = "prg", [CONFIG_ROM] = "rom",
+        [CONFIG_CARTRIDGE] = "cartridge", [CONFIG_IO] = "io",
+        [CONFIG_DMA] = "dma", [CONFIG_TIMER] = "timer",
+        [CONFIG_SHARED] = "shared",
+    };
+    machine_config_t *cfg;
+    char line[512];
+    unsigned lineno = 0;
+    FILE *f;
+    int ret = 0;
+
+    if(!(f = fopen(path, "r"))) {
+        perror(path);
+        return NULL;
+    }
+    if(!(cfg = calloc(1, sizeof *cfg)) || !(cfg->path = strdup(path)))
+        die("[Error] Out of memory\n");
+
+    while(!ret && fgets(line, sizeof line, f)) {
+        char *tok[MAX_TOKENS+1], *s, *save, *end;
+        config_region_t *r;
+        unsigned n = 0, k;
+
+        ++lineno;
+        if((end = strchr(line, '#'))) *end = '\0';
+        for(s = strtok_r(line, " \t\r\n", &save); s && n <= MAX_TOKENS;
+            s = strtok_r(NULL, " \t\r\n", &save))
+            tok[n++] = s;
+        if(!n) continue;
+
+        if(!strcmp(tok[0], "cpu")) {
+            if(n != 2 || !(cfg->variant = cpu_variant_find(tok[1]))) {
+                fprintf(stderr, "[Error] %s:%u: expected 'cpu NAME' with one "
+                        "of nmos, 65c02, 2a03\n", path, lineno);
+                ret = -1;
+            }
+            continue;
+        }
+        for(k = 0; k < sizeof kinds / sizeof *kinds; ++k)
+            if(!strcmp(kinds[k], tok[0])) break;
+        if(k == sizeof kinds / sizeof *kinds) {
+            fprintf(stderr, "[Error] %s:%u: unknown directive '%s'\n",
+                    path, lineno, tok[0]);
+            ret = -1;
+            break;
+        }
+
+        if(!(r = realloc(cfg->regions, (cfg->n_regions+1) * sizeof *r)))
+            die("[Error] Out of memory\n");
+        cfg->regions = r;
+        r += cfg->n_regions++;
+        (void)memset(r, 0, sizeof *r);
+        r->kind = k;
+        r->line = lineno;
+        if(n > MAX_TOKENS) ret = -1;
+        else ret = config_region(r, tok+1, n-1, path);
+        if(ret < 0)
+            fprintf(stderr, "[Error] %s:%u: bad '%s' line\n",
+                    path, lineno, tok[0]);
+    }
+    (void)fclose(f);
+
+    if(ret || config_check(cfg)) {
+        config_free(cfg);
+        return NULL;
+    }
+    return cfg;
+}
+
+/* the description at path, read and checked the first time it is asked
+ * for, NULL if it is bad */
+const machine_config_t *config_get(const char *path) {
+    machine_config_t **list, *cfg;
+    unsigned i;
+
+    for(i = 0; i < n_configs; ++i)
+        if(!strcmp(configs[i]->path, path)) return configs[i];
+    if(!(cfg = config_load(path))) return NULL;
+    if(!(list = realloc(configs, (n_configs+1) * sizeof *list)))
+        die("[Error] Out of memory\n");
+    configs = list;
+    configs[n_configs++] = cfg;
+    return cfg;
+}
+
+/* lay the current machine out like cfg says, before anything else is
+ * mapped into it */
+int config_apply(const machine_config_t *cfg) {
+    machine_t *m = current_machine;
+    unsigned i;
+
+    if(memory_map_clear()) {
+        fprintf(stderr, "[Error] %s: a flat memory view can't be laid out\n",
+                cfg->path);
+        return -1;
+    }
+    if(cfg->variant) m->variant = cfg->variant;
+    for(i = 0; i < cfg->n_regions; ++i) {
+        const config_region_t *r = &cfg->regions[i];
+        switch(r->kind) {
+        case CONFIG_RAM:
+            (void)memory_map_ram(r->addr, r->size, r->end);
+            break;
+        case CONFIG_PRG:
+            memory_map_prg(r->addr, r->end);
+            break;
+        case CONFIG_ROM:
+            memory_map_prg(r->addr, r->end);
+            memory_map_rom_segment(r->img, r->off, r->size, r->addr, r->flags);
+            break;
+        case CONFIG_CARTRIDGE:
+            memory_map_prg(r->addr, r->end);
+            if(cartridge_insert(r->img, r->mapper))
+                die("[Error] Out of memory\n");
+            break;
+        case CONFIG_IO:
+            cpu_map_io_at(r->addr);
+            break;
+        case CONFIG_DMA:
+            dma_map_at(r->addr);
+            break;
+        case CONFIG_TIMER:
+            timer_map_at(r->addr);
+            break;
+        case CONFIG_SHARED:
+            if(shm_map(r->spec)) return -1;
+            break;
+        }
+    }
+    return 0;
+}
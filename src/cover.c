@@ -0,0 +1,251 @@
+#include <emu6502/cover.h>
+#include <emu6502/cpu.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/decoding.h>
+#include <emu6502/flow.h>
+#include <emu6502/utils.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Code coverage of the current machine.
+ *
+ * While coverage is on no page is accessed on the fast path, so every
+ * read and write reaches the slower one in memory.c, which sets the bit of
+ * its address. cover_step() and the loop and fused handlers in fusion.c mark
+ * each opcode they fetch and, through cover_branch(), which way
+ * conditional branches went. All of it is fixed size bitmaps hanging off
+ * the machine.
+ *
+ * Files are the magic followed by the bitmaps, saving ORs in what the
+ * file already has so that runs of a test suite accumulate. */
+
+#define reg cpu_reg
+
+static const char cover_magic[8] = "E6502COV";
+
+/* instruction starts and bytes found by cover_walk() */
+static uint8_t code_start[0x2000];
+static uint8_t code_body[0x2000];
+
+cover_t *cover_enable(void) {
+    machine_t *m = current_machine;
+    if(m->cover) return m->cover;
+    if(!(m->cover = calloc(1, sizeof *m->cover)))
+        die("[Error] Out of memory\n");
+    memory_init();
+    return m->cover;
+}
+
+int cover_load(cover_t *c, const char *path) {
+    uint8_t magic[sizeof cover_magic];
+    cover_t *in;
+    size_t i;
+    FILE *f;
+
+    if(!(f = fopen(path, "rb"))) return -1;
+    if(!(in = malloc(sizeof *in))) die("[Error] Out of memory\n");
+    if(fread(magic, sizeof magic, 1, f) != 1
+       || memcmp(magic, cover_magic, sizeof magic)
+       || fread(in, sizeof *in, 1, f) != 1) {
+        free(in);
+        (void)fclose(f);
+        return -1;
+    }
+    for(i = 0; i < sizeof *in; ++i)
+        ((uint8_t *)c)[i] |= ((uint8_t *)in)[i];
+    free(in);
+    (void)fclose(f);
+    return 0;
+}
+
+/* merges with an existing file, c isn't changed */
+int cover_save(const cover_t *c, const char *path) {
+    cover_t *out;
+    FILE *f;
+    int ret = 0;
+
+    if(!(out = malloc(sizeof *out))) die("[Error] Out of memory\n");
+    *out = *c;
+    (void)cover_load(out, path);
+    if(!(f = fopen(path, "wb"))) ret = -1;
+    else {
+        if(fwrite(cover_magic, sizeof cover_magic, 1, f) != 1
+           || fwrite(out, sizeof *out, 1, f) != 1) ret = -1;
+        if(fclose(f)) ret = -1;
+    }
+    free(out);
+    return ret;
+}
+
+/* conditional branches, BRA always goes the same way */
+static int cover_is_branch(const instr_t *in) {
+    return (in->mode == MODE_RELATIVE && in->type != OP_BRA)
+        || in->mode == MODE_ZERO_PAGE_RELATIVE;
+}
+
+/* after the instruction at pc ran, note which way it went if it was a
+ * conditional branch */
+void cover_branch(uint16_t pc, uint8_t opcode) {
+    machine_t *m = current_machine;
+    const instr_t *in = &m->variant->table[opcode];
+    if(!cover_is_branch(in)) return;
+    if(reg.pc == (uint16_t)(pc + instr_mode_len(in->mode)))
+        COVER_SET(m->cover->not_taken, pc);
+    else
+        COVER_SET(m->cover->taken, pc);
+}
+
+void cover_step(void) {
+    machine_t *m = current_machine;
+    uint16_t pc = reg.pc;
+    uint8_t opcode;
+
+    if(m->cycles >= m->next_event) memory_sync_due();
+    COVER_SET(m->cover->exec, pc);
+    opcode = memory_read(reg.pc++);
+    cpu_exec(opcode);
+    cover_branch(pc, opcode);
+}
+
+static uint16_t cover_target(uint16_t addr, const instr_t *in) {
+    uint8_t off = 0;
+    unsigned len = instr_mode_len(in->mode);
+    (void)memory_peek(addr + len-1, &off);
+    return addr + len + (int8_t)off;
+}
+
+/* instruction bytes, and no falling through from an executed instruction
+ * to one that wasn't */
+static int cover_mark(void *data, uint16_t pc, const instr_t *in,
+                      unsigned len, uint16_t target) {
+    const cover_t *c = data;
+    unsigned i;
+    (void)target;
+
+    for(i = 0; i < len; ++i) COVER_SET(code_body, (uint16_t)(pc+i));
+    return COVER_GET(c->exec, pc) && !cover_is_branch(in)
+        && !COVER_GET(c->exec, (uint16_t)(pc+len));
+}
+
+/* Find the instructions reachable from the vectors and from everything
+ * that was executed, following both ways of branches and static jumps.
+ * Execution that went on past an instruction marked the next one, so
+ * falling through from an executed instruction to one that wasn't only
+ * happens at a halt and isn't followed. Vectors into RAM are taken to be
+ * unset. Entries of a --flow analysis are followed too, so code only ever
+ * reached through pointers is listed in runs that didn't execute it. The
+ * listing and lcov report what this finds, executed or not. */
+static void cover_walk(const cover_t *c) {
+    const machine_t *m = current_machine;
+    const flow_walker_t w = {memory_peek, code_start, cover_mark, (void *)c};
+    uint32_t addr;
+    unsigned i;
+
+    memset(code_start, 0, sizeof code_start);
+    memset(code_body, 0, sizeof code_body);
+    for(i = 0xfffa; i < 0x10000; i += 2) {
+        uint8_t l, h;
+        if(memory_peek(i, &l) && memory_peek(i+1, &h) && h >= 0x20)
+            flow_follow(&w, l | h<<8);
+    }
+    for(addr = 0; addr < 0x10000; ++addr)
+        if(COVER_GET(c->exec, addr)
+           || (m->flow && FLOW_GET(m->flow->entry, addr)))
+            flow_follow(&w, addr);
+}
+
+static const char *cover_branch_str(const cover_t *c, uint16_t addr) {
+    static const char *names[] = {"never", "taken", "not taken", "both"};
+    return names[COVER_GET(c->taken, addr) | COVER_GET(c->not_taken, addr)<<1];
+}
+
+/* Disassembly of the code cover_walk() finds plus the data that was
+ * touched. Executed instructions are marked '*', untouched gaps are
+ * elided. */
+void cover_listing(FILE *f) {
+    const machine_t *m = current_machine;
+    const cover_t *c = m->cover;
+    uint32_t addr = 0;
+    int gap = 0, any = 0;
+
+    cover_walk(c);
+    while(addr < 0x10000) {
+        if(COVER_GET(code_start, addr)) {
+            const instr_t *in;
+            char bytes[12] = "";
+            uint8_t opcode, b;
+            unsigned len, i;
+
+            (void)memory_peek(addr, &opcode);
+            in = &m->variant->table[opcode];
+            len = instr_mode_len(in->mode);
+            for(i = 0; i < len && addr+i < 0x10000; ++i) {
+                (void)memory_peek(addr+i, &b);
+                (void)sprintf(bytes + 3*i, "%02x ", b);
+            }
+            fprintf(f, "%s  $%04x  %-9s %s %-6s", gap ? "\n" : "",
+                    (unsigned)addr, bytes, instr_type_str(in->type),
+                    instr_mode_str(in->mode));
+            fprintf(f, "  %c", COVER_GET(c->exec, addr) ? '*' : ' ');
+            if(cover_is_branch(in))
+                fprintf(f, " $%04x %s", cover_target(addr, in),
+                        cover_branch_str(c, addr));
+            fputc('\n', f);
+            gap = 0, any = 1;
+            addr += len;
+        } else if(!COVER_GET(code_body, addr)
+                  && (COVER_GET(c->read, addr) || COVER_GET(c->write, addr))) {
+            uint8_t b;
+            fprintf(f, "%s  $%04x  ", gap ? "\n" : "", (unsigned)addr);
+            if(memory_peek(addr, &b)) fprintf(f, "%02x", b);
+            else fputs("--", f);
+            fprintf(f, "        data   %c%c\n",
+                    COVER_GET(c->read, addr) ? 'r' : ' ',
+                    COVER_GET(c->write, addr) ? 'w' : ' ');
+            gap = 0, any = 1;
+            ++addr;
+        } else {
+            gap = any;
+            ++addr;
+        }
+    }
+}
+
+/* lcov tracefile with addresses as line numbers of source, one line per
+ * instruction and a pair of branches per conditional branch */
+void cover_lcov(FILE *f, const char *source) {
+    const cover_t *c = current_machine->cover;
+    unsigned lf = 0, lh = 0, brf = 0, brh = 0;
+    uint32_t addr;
+
+    cover_walk(c);
+    fprintf(f, "TN:\nSF:%s\n", source);
+    for(addr = 0; addr < 0x10000; ++addr) {
+        const instr_t *in;
+        uint8_t opcode;
+        int hit;
+
+        if(!COVER_GET(code_start, addr)) continue;
+        hit = COVER_GET(c->exec, addr);
+        fprintf(f, "DA:%u,%d\n", (unsigned)addr, hit);
+        lf++, lh += hit;
+
+        (void)memory_peek(addr, &opcode);
+        in = &current_machine->variant->table[opcode];
+        if(!cover_is_branch(in)) continue;
+        if(hit) {
+            int t = COVER_GET(c->taken, addr), n = COVER_GET(c->not_taken, addr);
+            fprintf(f, "BRDA:%u,0,0,%d\nBRDA:%u,0,1,%d\n",
+                    (unsigned)addr, t, (unsigned)addr, n);
+            brh += t + n;
+        } else
+            fprintf(f, "BRDA:%u,0,0,-\nBRDA:%u,0,1,-\n",
+                    (unsigned)addr, (unsigned)addr);
+        brf += 2;
+    }
+    fprintf(f, "LF:%u\nLH:%u\nBRF:%u\nBRH:%u\nend_of_record\n",
+            lf, lh, brf, brh);
+}
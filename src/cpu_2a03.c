@@ -0,0 +1,13 @@
+/* Ricoh 2A03, an NMOS core without decimal mode */
+#define ENGINE        2a03
+#define ENGINE_NAME   "2a03"
+#define ENGINE_TABLE  instruction_table_nmos
+#define ENGINE_CYCLES instruction_cycles
+#define ENGINE_ADC    alu_adc
+#define ENGINE_SBC    alu_sbc
+#define ENGINE_CMOS   0
+#define ENGINE_BUS    0
+#include <emu6502/__cpu_engine.h>
+#undef ENGINE_BUS
+#define ENGINE_BUS    1
+#include <emu6502/__cpu_engine.h>
@@ -0,0 +1,13 @@
+/* 65C02 with the Rockwell and WDC bit instructions */
+#define ENGINE        65c02
+#define ENGINE_NAME   "65c02"
+#define ENGINE_TABLE  instruction_table_65c02
+#define ENGINE_CYCLES instruction_cycles_65c02
+#define ENGINE_ADC    alu_adc_65c02
+#define ENGINE_SBC    alu_sbc_65c02
+#define ENGINE_CMOS   1
+#define ENGINE_BUS    0
+#include <emu6502/__cpu_engine.h>
+#undef ENGINE_BUS
+#define ENGINE_BUS    1
+#include <emu6502/__cpu_engine.h>
@@ -0,0 +1,13 @@
+/* NMOS 6502 with its undocumented opcodes */
+#define ENGINE        nmos
+#define ENGINE_NAME   "nmos"
+#define ENGINE_TABLE  instruction_table_nmos
+#define ENGINE_CYCLES instruction_cycles
+#define ENGINE_ADC    alu_adc_nmos
+#define ENGINE_SBC    alu_sbc_nmos
+#define ENGINE_CMOS   0
+#define ENGINE_BUS    0
+#include <emu6502/__cpu_engine.h>
+#undef ENGINE_BUS
+#define ENGINE_BUS    1
+#include <emu6502/__cpu_engine.h>
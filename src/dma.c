@@ -0,0 +1,116 @@
+#include <emu6502/dma.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/stats.h>
+
+/* A DMA controller that copies between any two places on the bus while
+ * the CPU waits. Its registers, from DMA_ADDR in the default layout:
+ *
+ *   +0 +1  source, low byte first
+ *   +2 +3  destination
+ *   +4 +5  length, 0 for nothing
+ *   +6     control, see dma.h; writing DMA_START runs the transfer
+ *
+ * A transfer is done by the time the write that started it returns, and
+ * the CPU is stalled DMA_CYCLES_PER_BYTE cycles for every byte, a read
+ * and a write. It behaves like the byte by byte forward copy the hardware
+ * makes, overlapping ranges included, and leaves source and destination
+ * past what it moved and the length at 0, so transfers can be chained.
+ *
+ * Plain memory is moved with memory_read_block() and memory_write_block(),
+ * devices still see every byte. Lazy devices see all of them at the cycle
+ * the transfer started. */
+
+#define DMA_CYCLES_PER_BYTE 2
+/* bytes moved at once */
+#define DMA_CHUNK 256
+
+static void dma_read(uint8_t *, uint16_t);
+static void dma_write(uint8_t *, uint16_t);
+
+static const memory_map_entry_t dma_entry = {
+    .read = dma_read,
+    .write = dma_write,
+    .name = "dma",
+};
+
+/* the CPU waits, cycle by cycle like bus_tick() on a bus-accurate machine,
+ * whose instruction counts them in the stats */
+static void dma_stall(machine_t *m, uint64_t cycles) {
+    if(!(m->flags & MACHINE_BUS_ACCURATE)) {
+        m->cycles += cycles;
+        STAT_ADD(cycles, cycles);
+        return;
+    }
+    while(cycles--) {
+        m->cycles++;
+        if(m->cycles >= m->next_event) memory_sync_due();
+        if(m->cycle_hook) m->cycle_hook(m->cycle_data, m->cycles);
+    }
+}
+
+static void dma_run(machine_t *m) {
+    dma_t *d = &m->dma;
+    uint8_t buf[DMA_CHUNK];
+    uint32_t len = d->len;
+
+    while(d->len) {
+        size_t n = d->len < DMA_CHUNK ? d->len : DMA_CHUNK, i;
+        uint16_t gap = d->dst - d->src;
+        /* a destination just ahead of the source reads what was written */
+        if(!(d->ctrl & (DMA_FIXED_SRC|DMA_FIXED_DST)) && gap && gap < n)
+            n = gap;
+
+        if(d->ctrl & DMA_FIXED_SRC)
+            for(i = 0; i < n; ++i) buf[i] = memory_read(d->src);
+        else memory_read_block(d->src, buf, n);
+        if(d->ctrl & DMA_FIXED_DST)
+            for(i = 0; i < n; ++i) memory_write(d->dst, buf[i]);
+        else memory_write_block(d->dst, buf, n);
+
+        if(!(d->ctrl & DMA_FIXED_SRC)) d->src += n;
+        if(!(d->ctrl & DMA_FIXED_DST)) d->dst += n;
+        d->len -= n;
+    }
+    dma_stall(m, (uint64_t)len * DMA_CYCLES_PER_BYTE);
+}
+
+static void dma_read(uint8_t *bus, uint16_t addr) {
+    dma_t *d = &current_machine->dma;
+    switch(addr & 0xf) {
+    case 0x0: *bus = d->src; break;
+    case 0x1: *bus = d->src>>8; break;
+    case 0x2: *bus = d->dst; break;
+    case 0x3: *bus = d->dst>>8; break;
+    case 0x4: *bus = d->len; break;
+    case 0x5: *bus = d->len>>8; break;
+    /* never busy, the CPU only runs again once it's done */
+    case 0x6: *bus = d->ctrl & ~DMA_START; break;
+    }
+}
+
+static void dma_write(uint8_t *bus, uint16_t addr) {
+    dma_t *d = &current_machine->dma;
+    switch(addr & 0xf) {
+    case 0x0: d->src = (d->src & 0xff00) | *bus; break;
+    case 0x1: d->src = (d->src & 0x00ff) | *bus<<8; break;
+    case 0x2: d->dst = (d->dst & 0xff00) | *bus; break;
+    case 0x3: d->dst = (d->dst & 0x00ff) | *bus<<8; break;
+    case 0x4: d->len = (d->len & 0xff00) | *bus; break;
+    case 0x5: d->len = (d->len & 0x00ff) | *bus<<8; break;
+    case 0x6:
+        d->ctrl = *bus;
+        if(d->ctrl & DMA_START) dma_run(current_machine);
+        break;
+    }
+}
+
+/* in the default layout, like the I/O page, see cpu_map_io() */
+void dma_map(void) {
+    memory_map_default_page(&dma_entry, DMA_ADDR);
+}
+
+/* somewhere else in the current machine, for config.c */
+void dma_map_at(uint16_t addr) {
+    memory_map_page(&dma_entry, addr);
+}
@@ -0,0 +1,407 @@
+#include <emu6502/flow.h>
+#include <emu6502/cpu.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/decoding.h>
+#include <emu6502/fusion.h>
+#include <emu6502/utils.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Control flow of the ROM, found before the machine runs.
+ *
+ * The walk starts from the NMI, reset and BRK vectors and follows
+ * fallthrough, branches, absolute jumps and calls through PRG, so code
+ * in RAM and whatever is only reached through a pointer aren't found. The
+ * latter is made up for after a run: instructions the interpreter decoded
+ * that the walk missed become entries of their own, and the next load
+ * walks from those too. Basic blocks start at every entry, target and
+ * instruction after a branch or a call.
+ *
+ * Results go to a text file next to the ROM:
+ *
+ *   cpu NAME
+ *   hash HASH                   of the PRG contents
+ *   entry ADDR                  where walks start
+ *   block START END KIND [TARGET] [NEXT]
+ *   data START END              PRG bytes no instruction covers
+ *
+ * Loading only needs the entries, the blocks and data are for tools and
+ * cheap to find again. A file whose cpu or hash doesn't match what is
+ * mapped is taken to be for a different image and rewritten. */
+
+static const char *kind_names[] = {
+    [FLOW_FALL] = "fall", [FLOW_BRANCH] = "branch", [FLOW_JUMP] = "jump",
+    [FLOW_CALL] = "call", [FLOW_INDIRECT] = "indirect",
+    [FLOW_RETURN] = "return", [FLOW_STOP] = "stop",
+};
+
+static uint32_t flow_hash(void) {
+    const machine_t *m = current_machine;
+    uint32_t h = 2166136261u, addr;
+    const char *s;
+    uint8_t b;
+
+    for(s = m->variant->name; *s; ++s) h = (h ^ (uint8_t)*s) * 16777619u;
+    for(addr = 0; addr < 0x10000; ++addr)
+        if(memory_peek_prg(addr, &b)) {
+            h = (h ^ (addr & 0xff)) * 16777619u;
+            h = (h ^ b) * 16777619u;
+        }
+    return h;
+}
+
+/* the opcode at addr if all of its instruction can be peeked */
+static const instr_t *flow_decode_from(int (*peek)(uint16_t, uint8_t *),
+                                       uint16_t addr, unsigned *len) {
+    const instr_t *in;
+    uint8_t opcode, b;
+    unsigned i;
+
+    if(!peek(addr, &opcode)) return NULL;
+    in = &current_machine->variant->table[opcode];
+    if(in->type == OP_UNKNOWN) return NULL;
+    *len = instr_mode_len(in->mode);
+    for(i = 1; i < *len; ++i)
+        if(!peek(addr+i, &b)) return NULL;
+    return in;
+}
+
+/* the same, from PRG */
+static const instr_t *flow_decode(uint16_t addr, unsigned *len) {
+    return flow_decode_from(memory_peek_prg, addr, len);
+}
+
+static int flow_is_branch(const instr_t *in) {
+    return in->mode == MODE_RELATIVE || in->mode == MODE_ZERO_PAGE_RELATIVE;
+}
+
+/* branches and absolute jumps and calls */
+static int flow_has_target(const instr_t *in) {
+    return flow_is_branch(in) || (in->mode == MODE_ABSOLUTE
+                                  && (in->type == OP_JMP
+                                      || in->type == OP_JSR));
+}
+
+static uint16_t flow_target_from(int (*peek)(uint16_t, uint8_t *),
+                                 uint16_t addr, const instr_t *in,
+                                 unsigned len) {
+    uint8_t l = 0, h = 0;
+    (void)peek(addr+1, &l);
+    (void)peek(addr+2, &h);
+    if(flow_is_branch(in))
+        return addr + len + (int8_t)(len == 3 ? h : l);
+    return l | h<<8;
+}
+
+static uint16_t flow_target(uint16_t addr, const instr_t *in, unsigned len) {
+    return flow_target_from(memory_peek_prg, addr, in, len);
+}
+
+static int flow_ends(const instr_t *in) {
+    switch(in->type) {
+    case OP_JMP: case OP_BRA: case OP_RTS: case OP_RTI: case OP_BRK:
+    case OP_JAM: case OP_STP: case OP_HLE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Follow the code reachable from pc: fallthrough, both ways of branches
+ * and absolute jumps and calls. The walk of the ROM, the coverage listing
+ * and the memo scan are all this with their own peek and visit. Walks
+ * run on the threads of sessions and verify at once, so each has a stack
+ * of its own. */
+void flow_follow(const flow_walker_t *w, uint16_t pc) {
+    uint16_t *stack;
+    unsigned sp = 0;
+
+    if(!(stack = malloc(0x10000 * sizeof *stack)))
+        die("[Error] Out of memory\n");
+
+    stack[sp++] = pc;
+    while(sp) {
+        pc = stack[--sp];
+        while(!FLOW_GET(w->seen, pc)) {
+            const instr_t *in;
+            uint16_t target = 0;
+            unsigned len;
+
+            if(!(in = flow_decode_from(w->peek, pc, &len))) break;
+            FLOW_SET(w->seen, pc);
+            if(flow_has_target(in)) {
+                target = flow_target_from(w->peek, pc, in, len);
+                if(sp < 0x10000) stack[sp++] = target;
+            }
+            if(w->visit && w->visit(w->data, pc, in, len, target)) break;
+            if(flow_ends(in)) break;
+            pc += len;
+        }
+    }
+    free(stack);
+}
+
+/* bytes of the instruction and blocks starting after it */
+static int flow_mark(void *data, uint16_t pc, const instr_t *in,
+                     unsigned len, uint16_t target) {
+    flow_t *f = data;
+    unsigned i;
+
+    for(i = 0; i < len; ++i) FLOW_SET(f->body, (uint16_t)(pc+i));
+    if(flow_has_target(in)) {
+        FLOW_SET(f->leader, target);
+        if(in->type != OP_BRA && in->type != OP_JMP)
+            FLOW_SET(f->leader, (uint16_t)(pc+len));
+    }
+    return 0;
+}
+
+/* mark what can be reached from pc */
+static void flow_walk_from(flow_t *f, uint16_t pc) {
+    const flow_walker_t w = {memory_peek_prg, f->code, flow_mark, f};
+    FLOW_SET(f->leader, pc);
+    flow_follow(&w, pc);
+}
+
+static void flow_walk(flow_t *f) {
+    uint32_t addr;
+
+    (void)memset(f->code, 0, sizeof f->code);
+    (void)memset(f->body, 0, sizeof f->body);
+    (void)memset(f->leader, 0, sizeof f->leader);
+    for(addr = 0; addr < 0x10000; ++addr)
+        if(FLOW_GET(f->entry, addr)) flow_walk_from(f, addr);
+}
+
+static void flow_add_block(flow_t *f, const flow_block_t *b) {
+    flow_block_t *list;
+    if(!(f->n_blocks & (f->n_blocks-1))) {
+        if(!(list = realloc(f->blocks, (f->n_blocks ? 2*f->n_blocks : 64)
+                                       * sizeof *list)))
+            die("[Error] Out of memory\n");
+        f->blocks = list;
+    }
+    f->blocks[f->n_blocks++] = *b;
+}
+
+/* cut the instructions the walk found into blocks, in address order */
+static void flow_split(flow_t *f) {
+    static uint8_t done[0x2000];
+    uint32_t addr;
+
+    (void)memset(done, 0, sizeof done);
+    f->n_blocks = 0;
+    for(addr = 0; addr < 0x10000; ++addr) {
+        flow_block_t b;
+        uint16_t pc = addr;
+
+        if(!FLOW_GET(f->code, addr) || FLOW_GET(done, addr)) continue;
+        (void)memset(&b, 0, sizeof b);
+        b.start = addr;
+        for(;;) {
+            unsigned len;
+            const instr_t *in = flow_decode(pc, &len);
+            uint32_t next = pc + len;
+
+            FLOW_SET(done, pc);
+            b.end = next - 1;
+            b.next = next;
+            if(flow_is_branch(in) && in->type != OP_BRA)
+                b.kind = FLOW_BRANCH;
+            else if(in->type == OP_JSR)
+                b.kind = FLOW_CALL;
+            else if(in->type == OP_BRA
+                    || (in->type == OP_JMP && in->mode == MODE_ABSOLUTE))
+                b.kind = FLOW_JUMP;
+            else if(in->type == OP_JMP)
+                b.kind = FLOW_INDIRECT;
+            else if(in->type == OP_RTS || in->type == OP_RTI)
+                b.kind = FLOW_RETURN;
+            else if(flow_ends(in) || next > 0xffff
+                    || !FLOW_GET(f->code, next))
+                b.kind = FLOW_STOP;
+            else if(FLOW_GET(f->leader, next) || FLOW_GET(done, next))
+                b.kind = FLOW_FALL;
+            else {
+                pc = next;
+                continue;
+            }
+            if(b.kind == FLOW_BRANCH || b.kind == FLOW_CALL
+               || b.kind == FLOW_JUMP)
+                b.target = flow_target(pc, in, len);
+            break;
+        }
+        flow_add_block(f, &b);
+    }
+}
+
+static void flow_vectors(flow_t *f) {
+    uint32_t v;
+    for(v = 0xfffa; v < 0x10000; v += 2) {
+        uint8_t l, h, b;
+        if(memory_peek_prg(v, &l) && memory_peek_prg(v+1, &h)
+           && memory_peek_prg(l | h<<8, &b))
+            FLOW_SET(f->entry, l | h<<8);
+    }
+}
+
+/* take the entries of the file at path, -1 if there is none for what is
+ * mapped */
+static int flow_read(flow_t *f, const char *path) {
+    static uint8_t entry[0x2000];
+    const char *cpu = current_machine->variant->name;
+    char line[256], name[32];
+    int have_cpu = 0, have_hash = 0, ret = 0;
+    unsigned long n;
+    FILE *in;
+    size_t i;
+
+    if(!(in = fopen(path, "r"))) return -1;
+    (void)memset(entry, 0, sizeof entry);
+    while(!ret && fgets(line, sizeof line, in)) {
+        char *s = line, *end;
+
+        if((end = strchr(s, '#'))) *end = '\0';
+        s += strspn(s, " \t\r\n");
+        if(!*s) continue;
+        if(sscanf(s, "cpu %31s", name) == 1) {
+            have_cpu = !strcmp(name, cpu);
+            ret = have_cpu ? 0 : -1;
+        } else if(sscanf(s, "hash %lx", &n) == 1) {
+            have_hash = n == f->hash;
+            ret = have_hash ? 0 : -1;
+        } else if(!strncmp(s, "entry", 5)) {
+            s += 5 + strspn(s+5, " \t$");
+            n = strtoul(s, &end, 16);
+            if(end == s || n > 0xffff) ret = -1;
+            else FLOW_SET(entry, n);
+        } else if(strncmp(s, "block", 5) && strncmp(s, "data", 4))
+            ret = -1;
+    }
+    (void)fclose(in);
+    if(ret || !have_cpu || !have_hash) return -1;
+    for(i = 0; i < sizeof entry; ++i) f->entry[i] |= entry[i];
+    return 0;
+}
+
+static int flow_save(const flow_t *f, const char *path) {
+    char *tmp;
+    uint32_t addr, start = 0;
+    unsigned i;
+    int in_data = 0, ret = 0;
+    FILE *out;
+
+    /* readers never see half a file */
+    if(!(tmp = malloc(strlen(path) + 5))) die("[Error] Out of memory\n");
+    (void)sprintf(tmp, "%s.tmp", path);
+    if(!(out = fopen(tmp, "w"))) {
+        free(tmp);
+        return -1;
+    }
+    fprintf(out, "# control flow found by emu6502, see flow.c\n"
+            "cpu %s\nhash %08lx\n", current_machine->variant->name,
+            (unsigned long)f->hash);
+    for(addr = 0; addr < 0x10000; ++addr)
+        if(FLOW_GET(f->entry, addr))
+            fprintf(out, "entry $%04x\n", (unsigned)addr);
+    for(i = 0; i < f->n_blocks; ++i) {
+        const flow_block_t *b = &f->blocks[i];
+        fprintf(out, "block $%04x $%04x %s", b->start, b->end,
+                kind_names[b->kind]);
+        if(b->kind == FLOW_BRANCH || b->kind == FLOW_CALL
+           || b->kind == FLOW_JUMP)
+            fprintf(out, " $%04x", b->target);
+        if(b->kind == FLOW_BRANCH || b->kind == FLOW_CALL
+           || b->kind == FLOW_FALL)
+            fprintf(out, " $%04x", b->next);
+        fputc('\n', out);
+    }
+    for(addr = 0; addr <= 0x10000; ++addr) {
+        uint8_t b;
+        int data = addr < 0x10000 && !FLOW_GET(f->body, addr)
+                   && memory_peek_prg(addr, &b);
+        if(data && !in_data) start = addr;
+        else if(!data && in_data)
+            fprintf(out, "data $%04x $%04x\n", (unsigned)start,
+                    (unsigned)addr - 1);
+        in_data = data;
+    }
+    if(fclose(out)) ret = -1;
+    if(!ret && rename(tmp, path)) ret = -1;
+    if(ret) (void)remove(tmp);
+    free(tmp);
+    return ret;
+}
+
+/* Analyse the PRG of the current machine, with the entries of the file at
+ * path if it is for the same image, and write the file if it wasn't. Runs
+ * before HLE traps are patched in. */
+flow_t *flow_open(const char *path) {
+    machine_t *m = current_machine;
+    flow_t *f;
+
+    if(!(f = calloc(1, sizeof *f))) die("[Error] Out of memory\n");
+    f->refs = 1;
+    f->hash = flow_hash();
+    flow_vectors(f);
+    if(flow_read(f, path)) f->dirty = 1;
+    flow_walk(f);
+    flow_split(f);
+    if(f->dirty) {
+        if(flow_save(f, path)) perror(path);
+        f->dirty = 0;
+    }
+    flow_unref(m->flow);
+    m->flow = f;
+    return f;
+}
+
+/* After a run, make the instructions the interpreter decoded in PRG that
+ * the walk didn't find entries and write the file again if there were
+ * any. Nothing is learnt when PRG changed since it was analysed, HLE
+ * traps included. */
+int flow_update(flow_t *f, const char *path) {
+    uint32_t addr;
+    uint8_t b;
+
+    if(flow_hash() != f->hash) return 0;
+    /* what a new entry reaches needs no entry of its own */
+    for(addr = 0; addr < 0x10000; ++addr)
+        if(fusion_decoded(addr) && !FLOW_GET(f->code, addr)
+           && memory_peek_prg(addr, &b)) {
+            FLOW_SET(f->entry, addr);
+            flow_walk_from(f, addr);
+            f->dirty = 1;
+        }
+    if(!f->dirty) return 0;
+    flow_split(f);
+    f->dirty = 0;
+    return flow_save(f, path);
+}
+
+/* machine copies on other threads share it, like ROM images */
+flow_t *flow_ref(flow_t *f) {
+    if(f) __atomic_add_fetch(&f->refs, 1, __ATOMIC_RELAXED);
+    return f;
+}
+
+void flow_unref(flow_t *f) {
+    if(!f || __atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL)) return;
+    free(f->blocks);
+    free(f);
+}
+
+void flow_report(FILE *out) {
+    const flow_t *f = current_machine->flow;
+    unsigned entries = 0, code = 0, i;
+    if(!f) return;
+    for(i = 0; i < 0x10000; ++i) {
+        entries += FLOW_GET(f->entry, i);
+        code += FLOW_GET(f->code, i);
+    }
+    fprintf(out, "Control flow: %u entries, %u blocks, %u instructions\n",
+            entries, f->n_blocks, code);
+}
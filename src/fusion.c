@@ -0,0 +1,315 @@
+#include <emu6502/fusion.h>
+#include <emu6502/cpu.h>
+#include <emu6502/alu.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/decoding.h>
+#include <emu6502/stats.h>
+#include <emu6502/perf.h>
+#include <emu6502/cover.h>
+#include <emu6502/flow.h>
+#include <stdint.h>
+
+#define reg cpu_reg
+
+/* fuse_cache values, fusion ids start at FUSE_FIRST */
+#define FUSE_UNKNOWN 0
+#define FUSE_NONE    1
+#define FUSE_FIRST   2
+
+typedef struct fusion {
+    uint8_t op[3];
+    uint8_t len;
+    void (*run)(void);
+} fusion_t;
+
+/* Decoded fusion per address. This is only a hint: every handler checks the
+ * opcodes it actually fetches, so stale entries after self-modifying code,
+ * remapping or switching machines cost a missed fusion and never change
+ * behaviour. */
+static __thread uint8_t fuse_cache[0x10000] = {0};
+
+/* the analysis fuse_cache was filled from */
+static __thread const flow_t *fuse_flow = NULL;
+
+static uint32_t pair_count[0x100][0x100] = {{0}};
+
+static inline uint8_t fetch(void) {
+    return memory_read(reg.pc++);
+}
+
+static inline uint16_t fetch_w(void) {
+    uint16_t w = memory_read_w(reg.pc);
+    reg.pc += 2;
+    return w;
+}
+
+static inline void branch(int cond) {
+    cover_t *c = current_machine->cover;
+    uint16_t site = reg.pc-1;
+    int8_t off = (int8_t)fetch();
+    if(cond) reg.pc += off;
+    if(c) COVER_SET(cond ? c->taken : c->not_taken, site);
+}
+
+/* The fused opcodes are documented ones that do the same on every
+ * variant, only their timing comes from the variant of the machine. */
+#define FUSE_CYCLES(opcode) (current_machine->variant->cycles[opcode])
+
+/* like STA, the flags stay */
+static inline void store(uint16_t addr, uint8_t val) {
+    memory_write(addr, val);
+}
+
+/* Fetch the next opcode of a fused sequence exactly like cpu_step() would,
+ * devices whose events are due caught up first, and hand it to the
+ * generic path if it is not the one that was decoded. A halt between the
+ * two stops before the fetch. */
+#define FUSE_NEXT(opcode) do {                            \
+            uint16_t pc_ = reg.pc;                        \
+            uint8_t next_;                                \
+            if(cpu_halt) return;                          \
+            if(current_machine->cycles >= current_machine->next_event) \
+                memory_sync_due();                        \
+            if(current_machine->cover)                    \
+                COVER_SET(current_machine->cover->exec, pc_); \
+            if((next_ = fetch()) != (opcode)) {           \
+                cpu_exec(next_);                          \
+                if(current_machine->cover)                \
+                    cover_branch(pc_, next_);             \
+                return;                                   \
+            }                                             \
+            current_machine->cycles += FUSE_CYCLES(opcode); \
+            STAT_INC(instructions);                       \
+            PERF_NOTE(opcode);                            \
+            STAT_ADD(cycles, FUSE_CYCLES(opcode));        \
+        } while(0)
+
+/* LDA a,x; BEQ r -- the string loop in hello.asm */
+static void fuse_lda_ax_beq(void) {
+    alu_load(&reg.a, memory_read(fetch_w() + reg.x));
+    FUSE_NEXT(0xf0);
+    branch(reg.a == 0);
+}
+
+/* STA a; INX; BNE r */
+static void fuse_sta_a_inx_bne(void) {
+    store(fetch_w(), reg.a);
+    FUSE_NEXT(0xe8);
+    alu_load(&reg.x, reg.x+1);
+    FUSE_NEXT(0xd0);
+    branch(reg.x != 0);
+}
+
+/* LDA #; STA a */
+static void fuse_lda_imm_sta_a(void) {
+    alu_load(&reg.a, fetch());
+    FUSE_NEXT(0x8d);
+    store(fetch_w(), reg.a);
+}
+
+/* LDA #; STA zp */
+static void fuse_lda_imm_sta_zp(void) {
+    alu_load(&reg.a, fetch());
+    FUSE_NEXT(0x85);
+    store(fetch(), reg.a);
+}
+
+/* LDA zp; STA zp */
+static void fuse_lda_zp_sta_zp(void) {
+    alu_load(&reg.a, memory_read(fetch()));
+    FUSE_NEXT(0x85);
+    store(fetch(), reg.a);
+}
+
+/* INX/DEX/INY/DEY; BNE r */
+#define FUSE_COUNT_BNE(name, r, delta)                        \
+    static void fuse_##name##_bne(void) {                      \
+        alu_load(&reg.r, reg.r + (delta));                     \
+        FUSE_NEXT(0xd0);                                       \
+        branch(reg.r != 0);                                    \
+    }
+FUSE_COUNT_BNE(inx, x,  1)
+FUSE_COUNT_BNE(dex, x, -1)
+FUSE_COUNT_BNE(iny, y,  1)
+FUSE_COUNT_BNE(dey, y, -1)
+#undef FUSE_COUNT_BNE
+
+/* CMP #; Bxx r */
+#define FUSE_CMP_BRANCH(name, opcode, cond)                   \
+    static void fuse_cmp_imm_##name(void) {                    \
+        alu_compare(reg.a, fetch());                           \
+        FUSE_NEXT(opcode);                                     \
+        branch(cond);                                          \
+    }
+FUSE_CMP_BRANCH(bne, 0xd0, !HAS_FLAG(FLAGS_ZERO))
+FUSE_CMP_BRANCH(beq, 0xf0, HAS_FLAG(FLAGS_ZERO))
+FUSE_CMP_BRANCH(bcs, 0xb0, HAS_FLAG(FLAGS_CARRY))
+FUSE_CMP_BRANCH(bcc, 0x90, !HAS_FLAG(FLAGS_CARRY))
+FUSE_CMP_BRANCH(bmi, 0x30, HAS_FLAG(FLAGS_NEGATIVE))
+FUSE_CMP_BRANCH(bpl, 0x10, !HAS_FLAG(FLAGS_NEGATIVE))
+#undef FUSE_CMP_BRANCH
+
+/* TAX; DEX, TXA; PHA and PLA; TAX -- the argument shuffling in fib.asm */
+static void fuse_tax_dex(void) {
+    alu_load(&reg.x, reg.a);
+    FUSE_NEXT(0xca);
+    alu_load(&reg.x, reg.x-1);
+}
+
+static void fuse_txa_pha(void) {
+    alu_load(&reg.a, reg.x);
+    FUSE_NEXT(0x48);
+    memory_write(0x100 + (uint8_t)(reg.s--), reg.a);
+}
+
+static void fuse_pla_tax(void) {
+    alu_load(&reg.a, memory_read(0x100 + (uint8_t)(++reg.s)));
+    FUSE_NEXT(0xaa);
+    alu_load(&reg.x, reg.a);
+}
+
+/* Picked from --pair-profile runs over hello.asm and fib.asm plus the
+ * usual compare-and-branch idioms. Longer sequences come first so that
+ * they win over their prefixes. */
+static const fusion_t fusions[] = {
+{{0x8d, 0xe8, 0xd0}, 3, fuse_sta_a_inx_bne},
+{{0xbd, 0xf0}, 2, fuse_lda_ax_beq},
+{{0xa9, 0x8d}, 2, fuse_lda_imm_sta_a},
+{{0xa9, 0x85}, 2, fuse_lda_imm_sta_zp},
+{{0xa5, 0x85}, 2, fuse_lda_zp_sta_zp},
+{{0xe8, 0xd0}, 2, fuse_inx_bne},
+{{0xca, 0xd0}, 2, fuse_dex_bne},
+{{0xc8, 0xd0}, 2, fuse_iny_bne},
+{{0x88, 0xd0}, 2, fuse_dey_bne},
+{{0xc9, 0xd0}, 2, fuse_cmp_imm_bne},
+{{0xc9, 0xf0}, 2, fuse_cmp_imm_beq},
+{{0xc9, 0xb0}, 2, fuse_cmp_imm_bcs},
+{{0xc9, 0x90}, 2, fuse_cmp_imm_bcc},
+{{0xc9, 0x30}, 2, fuse_cmp_imm_bmi},
+{{0xc9, 0x10}, 2, fuse_cmp_imm_bpl},
+{{0xaa, 0xca}, 2, fuse_tax_dex},
+{{0x8a, 0x48}, 2, fuse_txa_pha},
+{{0x68, 0xaa}, 2, fuse_pla_tax},
+};
+
+/* match the sequence at addr against the fusion table, looking only at
+ * memory that can be read without side effects */
+static uint8_t fuse_decode(uint16_t addr) {
+    const instr_t *table = current_machine->variant->table;
+    uint8_t ops[3];
+    unsigned i, j, n = 0;
+
+    for(n = 0; n < 3; ++n) {
+        if(!memory_peek(addr, &ops[n])) break;
+        addr += instr_mode_len(table[ops[n]].mode);
+    }
+
+    for(i = 0; i < sizeof fusions / sizeof *fusions; ++i) {
+        if(fusions[i].len > n) continue;
+        for(j = 0; j < fusions[i].len && fusions[i].op[j] == ops[j]; ++j);
+        if(j == fusions[i].len) return FUSE_FIRST + i;
+    }
+    return FUSE_NONE;
+}
+
+/* decode every instruction the load-time analysis found up front instead
+ * of on first execution */
+static void fuse_prewarm(const flow_t *f) {
+    uint32_t addr;
+    for(addr = 0; addr < 0x10000; ++addr)
+        if(FLOW_GET(f->code, addr)) fuse_cache[addr] = fuse_decode(addr);
+    fuse_flow = f;
+}
+
+/* whether the instruction at pc ran or was decoded ahead of time */
+int fusion_decoded(uint16_t pc) {
+    return fuse_cache[pc] != FUSE_UNKNOWN;
+}
+
+/* A fused sequence counts as one step, so this can overshoot end by the
+ * rest of the sequence. */
+void fusion_run_until(uint64_t end) {
+    machine_t *m = current_machine;
+    if(m->flow && m->flow != fuse_flow) fuse_prewarm(m->flow);
+    /* fused handlers only do the logical accesses */
+    if(m->flags & MACHINE_BUS_ACCURATE) {
+        while(!m->halt && m->cycles < end) cpu_step();
+        return;
+    }
+    while(!m->halt && m->cycles < end) {
+        uint16_t pc;
+        uint8_t opcode, id;
+
+        if(m->cycles >= m->next_event) memory_sync_due();
+        pc = reg.pc;
+        if(m->cover) COVER_SET(m->cover->exec, pc);
+        opcode = fetch();
+        id = fuse_cache[pc];
+
+        if(id == FUSE_UNKNOWN) {
+            STAT_INC(fuse_misses);
+            id = fuse_cache[pc] = fuse_decode(pc);
+        } else STAT_INC(fuse_hits);
+        if(id != FUSE_NONE && fusions[id-FUSE_FIRST].op[0] == opcode) {
+            m->cycles += FUSE_CYCLES(opcode);
+            STAT_INC(instructions);
+            PERF_NOTE(opcode);
+            STAT_ADD(cycles, FUSE_CYCLES(opcode));
+            fusions[id-FUSE_FIRST].run();
+        } else {
+            m->variant->exec(opcode);
+            if(m->cover) cover_branch(pc, opcode);
+        }
+    }
+}
+
+void fusion_run(void) {
+    fusion_run_until(UINT64_MAX);
+}
+
+/* plain interpretation that counts which opcode follows which */
+void fusion_profile_run(void) {
+    uint8_t last = 0;
+    int first = 1;
+    while(!cpu_halt) {
+        uint16_t pc = reg.pc;
+        uint8_t opcode;
+        if(current_machine->cycles >= current_machine->next_event)
+            memory_sync_due();
+        if(current_machine->cover) COVER_SET(current_machine->cover->exec, pc);
+        opcode = fetch();
+        if(!first) pair_count[last][opcode]++;
+        first = 0, last = opcode;
+        cpu_exec(opcode);
+        if(current_machine->cover) cover_branch(pc, opcode);
+    }
+}
+
+void fusion_profile_dump(FILE *f, unsigned top) {
+    uint64_t total = 0;
+    unsigned i, j, n;
+
+    for(i = 0; i < 0x100; ++i)
+        for(j = 0; j < 0x100; ++j)
+            total += pair_count[i][j];
+    if(!total) return;
+
+    fprintf(f, "-----\nOpcode pairs (%llu total):\n",
+            (unsigned long long)total);
+    for(n = 0; n < top; ++n) {
+        unsigned bi = 0, bj = 0;
+        for(i = 0; i < 0x100; ++i)
+            for(j = 0; j < 0x100; ++j)
+                if(pair_count[i][j] > pair_count[bi][bj]) bi = i, bj = j;
+        if(!pair_count[bi][bj]) break;
+        fprintf(f, "%10lu %5.1f%%  $%02x $%02x  %s %s; %s %s\n",
+                (unsigned long)pair_count[bi][bj],
+                100.0 * pair_count[bi][bj] / total, bi, bj,
+                instr_type_str(instruction_table[bi].type),
+                instr_mode_str(instruction_table[bi].mode),
+                instr_type_str(instruction_table[bj].type),
+                instr_mode_str(instruction_table[bj].mode));
+        pair_count[bi][bj] = 0;
+    }
+}
@@ -0,0 +1,209 @@
+#include <emu6502/heat.h>
+#include <emu6502/cpu.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/utils.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Memory access profile of the current machine.
+ *
+ * Like coverage, this keeps pages off the fast path so that memory.c
+ * hands every access to heat_access(). Accesses to the bytes around pc
+ * are taken to be instruction fetches, everything else is data. Data
+ * accesses outside the stack page also feed a stream per direction that
+ * finds runs of constant stride: stride 0 is polling, +-1 sequential and
+ * anything else strided, like walking a table of records.
+ *
+ * The image is a 256x768 PGM, fetches, reads and writes from the top,
+ * one pixel per address with brightness growing with log2 of the count. */
+
+#define reg cpu_reg
+
+enum { RUN_POLL, RUN_SEQUENTIAL, RUN_STRIDED };
+
+heat_t *heat_enable(void) {
+    machine_t *m = current_machine;
+    if(m->heat) return m->heat;
+    if(!(m->heat = calloc(1, sizeof *m->heat)))
+        die("[Error] Out of memory\n");
+    m->heat->min_s = 0xff;
+    memory_init();
+    return m->heat;
+}
+
+static void heat_run_end(heat_t *h, heat_stream_t *st, int write) {
+    heat_run_t *run = &h->runs[write][st->start];
+    if(st->len < HEAT_MIN_RUN) return;
+    run->count++;
+    run->len += st->len;
+    run->stride = st->stride;
+    h->run_accesses[!st->stride ? RUN_POLL
+                    : abs(st->stride) == 1 ? RUN_SEQUENTIAL
+                    : RUN_STRIDED] += st->len;
+}
+
+/* a run goes on while the distance to the last access stays the same */
+static void heat_stream(heat_t *h, uint16_t addr, int write) {
+    heat_stream_t *st = &h->stream[write];
+    int32_t d = (int16_t)(addr - st->last);
+    if(st->len >= 2 && d == st->stride)
+        st->len++;
+    else if(st->len == 1)
+        st->stride = d, st->len = 2;
+    else if(!st->len)
+        st->start = addr, st->len = 1;
+    else {
+        heat_run_end(h, st, write);
+        st->start = st->last, st->stride = d, st->len = 2;
+    }
+    st->last = addr;
+}
+
+void heat_access(heat_t *h, uint16_t addr, int write) {
+    if(!write && (uint16_t)(addr - reg.pc + 1) <= 2) {
+        h->fetches[addr]++;
+        return;
+    }
+    (write ? h->writes : h->reads)[addr]++;
+    if(addr>>8 == 0x01) {
+        if(reg.s < h->min_s) h->min_s = reg.s;
+        h->stack_seen = 1;
+        return;
+    }
+    heat_stream(h, addr, write);
+}
+
+static unsigned heat_pixel(uint32_t n) {
+    unsigned log = 0;
+    if(!n) return 0;
+    while(n >>= 1) log++;
+    return 31 + 7*log;
+}
+
+int heat_write_image(FILE *f) {
+    const heat_t *h = current_machine->heat;
+    const uint32_t *planes[] = {h->fetches, h->reads, h->writes};
+    unsigned i, addr;
+
+    fprintf(f, "P5\n256 768\n255\n");
+    for(i = 0; i < 3; ++i)
+        for(addr = 0; addr < 0x10000; ++addr)
+            if(fputc(heat_pixel(planes[i][addr]), f) == EOF) return -1;
+    return 0;
+}
+
+/* index of the largest of n counts */
+static unsigned heat_top(uint64_t *counts, unsigned n) {
+    unsigned i, best = 0;
+    for(i = 1; i < n; ++i)
+        if(counts[i] > counts[best]) best = i;
+    return best;
+}
+
+static const char *heat_entry_name(const memory_map_entry_t *entry) {
+    if(!entry) return "open bus";
+    return entry->name ? entry->name : "device";
+}
+
+static void heat_report_devices(FILE *f, const heat_t *h) {
+    const machine_t *m = current_machine;
+    uint32_t block = 0;
+
+    fprintf(f, "Devices:\n");
+    while(block < 0x1000) {
+        const memory_map_entry_t *entry = m->map[block];
+        uint64_t r = 0, w = 0, x = 0;
+        uint32_t start = block, addr;
+        for(; block < 0x1000 && m->map[block] == entry; ++block)
+            for(addr = block<<4; addr < (block+1)<<4; ++addr)
+                x += h->fetches[addr], r += h->reads[addr], w += h->writes[addr];
+        if(r || w || x)
+            fprintf(f, "  $%04x-$%04x %-8s %12llu fetches %12llu reads "
+                    "%12llu writes\n", (unsigned)start<<4,
+                    (unsigned)(block<<4) - 1, heat_entry_name(entry),
+                    (unsigned long long)x, (unsigned long long)r,
+                    (unsigned long long)w);
+    }
+}
+
+static void heat_report_runs(FILE *f, heat_t *h, unsigned top) {
+    static const char *kinds[] = {"polling", "sequential", "strided"};
+    static uint64_t counts[0x20000];
+    unsigned n, i, write;
+
+    for(write = 0; write < 2; ++write) {
+        heat_run_end(h, &h->stream[write], write);
+        h->stream[write].len = 0;
+    }
+    fprintf(f, "Data accesses in runs of %d or more:", HEAT_MIN_RUN);
+    for(i = 0; i < 3; ++i)
+        fprintf(f, " %llu %s", (unsigned long long)h->run_accesses[i],
+                kinds[i]);
+    fputc('\n', f);
+
+    for(write = 0; write < 2; ++write)
+        for(i = 0; i < 0x10000; ++i)
+            counts[write<<16 | i] = h->runs[write][i].len;
+    for(n = 0; n < top; ++n) {
+        unsigned best = heat_top(counts, 0x20000);
+        const heat_run_t *run = &h->runs[best>>16][best&0xffff];
+        if(!counts[best]) break;
+        fprintf(f, "  $%04x %-5s stride %+6d %10lu runs, %6.1f long\n",
+                best & 0xffff, best >> 16 ? "write" : "read",
+                (int)run->stride, (unsigned long)run->count,
+                (double)run->len / run->count);
+        counts[best] = 0;
+    }
+}
+
+/* Top addresses, pages, devices and runs. Data addresses are what zero
+ * page and RAM sizing decisions need, so fetches only show up per page
+ * and device. */
+void heat_report(FILE *f, unsigned top) {
+    heat_t *h = current_machine->heat;
+    static uint64_t counts[0x10000];
+    uint64_t pages[0x100] = {0}, total = 0;
+    uint32_t addr, highest = 0x10000;
+    unsigned n;
+
+    for(addr = 0; addr < 0x10000; ++addr) {
+        counts[addr] = (uint64_t)h->reads[addr] + h->writes[addr];
+        pages[addr>>8] += counts[addr] + h->fetches[addr];
+        total += counts[addr];
+        if(counts[addr] && addr < 0x2000) highest = addr;
+    }
+    if(!total) return;
+
+    fprintf(f, "-----\nData accesses (%llu total):\n",
+            (unsigned long long)total);
+    for(n = 0; n < top; ++n) {
+        unsigned best = heat_top(counts, 0x10000);
+        if(!counts[best]) break;
+        fprintf(f, "  $%04x %10lu reads %10lu writes %5.1f%%%s\n", best,
+                (unsigned long)h->reads[best], (unsigned long)h->writes[best],
+                100.0 * counts[best] / total,
+                best >= 0x100 && best>>8 != 0x01 && best < 0x2000
+                    ? "  zero page candidate" : "");
+        counts[best] = 0;
+    }
+
+    fprintf(f, "Pages:\n");
+    for(n = 0; n < top; ++n) {
+        unsigned best = heat_top(pages, 0x100);
+        if(!pages[best]) break;
+        fprintf(f, "  $%02x00 %12llu\n", best,
+                (unsigned long long)pages[best]);
+        pages[best] = 0;
+    }
+
+    heat_report_devices(f, h);
+    if(h->stack_seen)
+        fprintf(f, "Stack: lowest S $%02x, %u bytes deep\n", h->min_s,
+                0xff - h->min_s);
+    if(highest < 0x2000)
+        fprintf(f, "Highest RAM address used: $%04x\n", (unsigned)highest);
+    heat_report_runs(f, h, top);
+}
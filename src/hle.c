@@ -0,0 +1,178 @@
+#include <emu6502/hle.h>
+#include <emu6502/alu.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/decoding.h>
+#include <emu6502/stats.h>
+#include <emu6502/utils.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define reg cpu_reg
+
+typedef struct hle_native {
+    const char *name;
+    hle_fn_t fn;
+} hle_native_t;
+
+/* print_hex from fib.asm: A as two hex digits and a newline on $3ff0,
+ * leaving the registers, the flags and the byte its PHA leaves below the
+ * stack like the 6502 code does. Its last LSR shifts a 0 into C. */
+static int hle_print_hex(void *user) {
+    static const char hex[] = "0123456789abcdef";
+    (void)user;
+    memory_write(0x100 + reg.s, reg.a);
+    memory_write(0x3ff0, hex[reg.a>>4]);
+    memory_write(0x3ff0, hex[reg.a&0xf]);
+    reg.x = reg.a&0xf;
+    reg.p &= ~FLAGS_CARRY;
+    alu_load(&reg.a, 0x0a);
+    memory_write(0x3ff0, reg.a);
+    return 0;
+}
+
+/* return straight away, for delay loops and the like */
+static int hle_return(void *user) {
+    (void)user;
+    return 0;
+}
+
+static const hle_native_t natives[] = {
+{"print_hex", hle_print_hex},
+{"rts",       hle_return},
+};
+
+static hle_trap_t *hle_find(const hle_t *hle, uint16_t pc) {
+    const uint32_t *bits = hle->pages[pc>>8];
+    unsigned i;
+    if(!bits || !(bits[(pc&0xff)>>5] & 1u<<(pc&0x1f))) return NULL;
+    for(i = 0; i < hle->n_traps; ++i)
+        if(hle->traps[i].pc == pc) return &hle->traps[i];
+    return NULL;
+}
+
+/* Trap the routine at pc in the current machine, which has to be in RAM or
+ * PRG that is mapped already. Returns 0 or -1. */
+int hle_add(uint16_t pc, hle_fn_t fn, void *user) {
+    machine_t *m = current_machine;
+    hle_trap_t *trap;
+    hle_t *hle;
+    int old;
+
+    if(!m->hle && !(m->hle = calloc(1, sizeof *m->hle)))
+        die("[Error] Out of memory\n");
+    hle = m->hle;
+    if((trap = hle_find(hle, pc))) {
+        trap->fn = fn;
+        trap->user = user;
+        return 0;
+    }
+    if((old = memory_patch(pc, HLE_OPCODE)) < 0) return -1;
+
+    if(!hle->pages[pc>>8] && !(hle->pages[pc>>8] = calloc(8, sizeof(uint32_t))))
+        die("[Error] Out of memory\n");
+    if(!(trap = realloc(hle->traps, (hle->n_traps+1) * sizeof *trap)))
+        die("[Error] Out of memory\n");
+    hle->traps = trap;
+    trap += hle->n_traps++;
+    trap->pc = pc;
+    trap->opcode = (uint8_t)old;
+    trap->fn = fn;
+    trap->user = user;
+    hle->pages[pc>>8][(pc&0xff)>>5] |= 1u<<(pc&0x1f);
+    return 0;
+}
+
+/* Lines of "addr native" with the natives above, # starts a comment. */
+int hle_load(const char *path) {
+    char line[256];
+    unsigned lineno = 0, i;
+    FILE *f;
+    int ret = 0;
+
+    if(!(f = fopen(path, "r"))) {
+        perror(path);
+        return -1;
+    }
+    while(!ret && fgets(line, sizeof line, f)) {
+        char *s = line, *end, name[64];
+        unsigned long pc;
+
+        ++lineno;
+        if((end = strchr(s, '#'))) *end = '\0';
+        s += strspn(s, " \t\r\n");
+        if(!*s) continue;
+
+        pc = *s == '$' ? strtoul(s+1, &end, 16) : strtoul(s, &end, 0);
+        if(end == s || pc > 0xffff || sscanf(end, "%63s", name) != 1) {
+            fprintf(stderr, "[Error] %s:%u: expected 'addr native'\n",
+                    path, lineno);
+            ret = -1;
+            break;
+        }
+        for(i = 0; i < sizeof natives / sizeof *natives; ++i)
+            if(!strcmp(natives[i].name, name)) break;
+        if(i == sizeof natives / sizeof *natives) {
+            fprintf(stderr, "[Error] %s:%u: unknown native '%s'\n",
+                    path, lineno, name);
+            ret = -1;
+        } else if(hle_add(pc, natives[i].fn, NULL)) {
+            fprintf(stderr, "[Error] %s:%u: $%04lx isn't RAM or ROM\n",
+                    path, lineno, pc);
+            ret = -1;
+        }
+    }
+    (void)fclose(f);
+    return ret;
+}
+
+/* Called on HLE_OPCODE with pc past it. Returns 0 if there is no trap. */
+int hle_trap(void) {
+    machine_t *m = current_machine;
+    const hle_trap_t *trap;
+    uint8_t opcode;
+    int ret;
+
+    if(!m->hle || !(trap = hle_find(m->hle, reg.pc-1))) return 0;
+    opcode = trap->opcode;
+    if((ret = trap->fn(trap->user)) < 0) return 1;
+    if(ret) {
+        cpu_exec(opcode);
+        return 1;
+    }
+    /* RTS */
+    reg.pc = memory_read_w(0x100 + (uint8_t)(reg.s+1)) + 1;
+    reg.s += 2;
+    m->cycles += instruction_cycles[0x60];
+    STAT_ADD(cycles, instruction_cycles[0x60]);
+    return 1;
+}
+
+hle_t *hle_copy(const hle_t *src) {
+    hle_t *hle;
+    unsigned page;
+
+    if(!src) return NULL;
+    if(!(hle = calloc(1, sizeof *hle))) die("[Error] Out of memory\n");
+    for(page = 0x00; page < 0x100; ++page) {
+        if(!src->pages[page]) continue;
+        if(!(hle->pages[page] = malloc(8 * sizeof(uint32_t))))
+            die("[Error] Out of memory\n");
+        (void)memcpy(hle->pages[page], src->pages[page], 8 * sizeof(uint32_t));
+    }
+    if(!(hle->traps = malloc(src->n_traps * sizeof *hle->traps))
+       && src->n_traps)
+        die("[Error] Out of memory\n");
+    (void)memcpy(hle->traps, src->traps, src->n_traps * sizeof *hle->traps);
+    hle->n_traps = src->n_traps;
+    return hle;
+}
+
+void hle_free(hle_t *hle) {
+    unsigned page;
+    if(!hle) return;
+    for(page = 0x00; page < 0x100; ++page) free(hle->pages[page]);
+    free(hle->traps);
+    free(hle);
+}
@@ -0,0 +1,238 @@
+#include <emu6502/emu6502.h>
+#include <emu6502/args.h>
+#include <emu6502/cpu.h>
+#include <emu6502/hle.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/rom.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_DEVICES 0xff
+
+/* the core reads these, embedders get the quiet defaults */
+struct cmd_options cmd_options = {0};
+
+typedef struct device {
+    emu6502_read_fn read;
+    emu6502_write_fn write;
+    void *user;
+} device_t;
+
+typedef struct trap {
+    emu6502_t *e;
+    emu6502_trap_fn fn;
+    void *user;
+} trap_t;
+
+struct emu6502 {
+    /* first, so that current_machine can be cast back */
+    machine_t m;
+    int rom_flags;
+    /* device per 16 byte block, 0 for none */
+    uint8_t device_idx[0x1000];
+    device_t devices[MAX_DEVICES];
+    unsigned n_devices;
+    trap_t **traps;
+    unsigned n_traps;
+};
+
+static void device_read(uint8_t *bus, uint16_t addr) {
+    emu6502_t *e = (emu6502_t *)current_machine;
+    const device_t *dev = &e->devices[e->device_idx[addr>>4]-1];
+    if(dev->read) *bus = dev->read(dev->user, addr);
+}
+
+static void device_write(uint8_t *bus, uint16_t addr) {
+    emu6502_t *e = (emu6502_t *)current_machine;
+    const device_t *dev = &e->devices[e->device_idx[addr>>4]-1];
+    if(dev->write) dev->write(dev->user, addr, *bus);
+}
+
+static const memory_map_entry_t device_entry = {
+    .read = device_read,
+    .write = device_write,
+    .name = "device",
+};
+
+/* natives see pc on the routine, the core has it past the trap opcode */
+static int trap_call(void *data) {
+    trap_t *trap = data;
+    uint16_t pc = trap->e->m.cpu.pc;
+    int ret;
+    trap->e->m.cpu.pc = pc-1;
+    if((ret = trap->fn(trap->e, trap->user))) trap->e->m.cpu.pc = pc;
+    return ret;
+}
+
+static enum emu6502_stop stop_reason(machine_t *m) {
+    switch(m->halt) {
+    case 0: return EMU6502_STOP_NONE;
+    case HALT_ILLEGAL: return EMU6502_STOP_ILLEGAL;
+    case HALT_USER:
+        /* served, the next run goes on */
+        m->halt = 0;
+        return EMU6502_STOP_USER;
+    default: return EMU6502_STOP_HALT;
+    }
+}
+
+unsigned emu6502_api_version(void) {
+    return EMU6502_API_VERSION;
+}
+
+emu6502_t *emu6502_new(unsigned flags) {
+    emu6502_t *e;
+    if(!(e = calloc(1, sizeof *e))) return NULL;
+    machine_init(&e->m);
+    e->m.flags = MACHINE_TRAP_ILLEGAL;
+    if(flags & EMU6502_STDIO) e->m.flags |= MACHINE_STDIO;
+    if(flags & EMU6502_READ_ONLY_ROM) e->rom_flags |= MEMORY_ROM_READONLY;
+    if(flags & EMU6502_CPU_65C02) e->m.variant = &cpu_65c02;
+    else if(flags & EMU6502_CPU_2A03) e->m.variant = &cpu_2a03;
+    if(flags & EMU6502_BUS_ACCURATE) e->m.flags |= MACHINE_BUS_ACCURATE;
+    return e;
+}
+
+void emu6502_free(emu6502_t *e) {
+    if(!e) return;
+    machine_release(&e->m);
+    while(e->n_traps) free(e->traps[--e->n_traps]);
+    free(e->traps);
+    free(e);
+}
+
+int emu6502_load_file(emu6502_t *e, const char *path, uint16_t addr) {
+    rom_image_t *img;
+    if(addr < 0x4020 || !(img = rom_image_load(path))) return -1;
+    machine_select(&e->m);
+    memory_map_rom(img, addr, e->rom_flags);
+    rom_image_unref(img);
+    return 0;
+}
+
+int emu6502_load_mem(emu6502_t *e, const void *data, size_t size,
+                     uint16_t addr) {
+    rom_image_t *img;
+    if(addr < 0x4020 || !(img = rom_image_new(data, size))) return -1;
+    machine_select(&e->m);
+    memory_map_rom(img, addr, e->rom_flags);
+    rom_image_unref(img);
+    return 0;
+}
+
+int emu6502_map_shared(emu6502_t *e, void *mem, size_t size,
+                       uint16_t addr) {
+    machine_select(&e->m);
+    return memory_map_shared(mem, addr, size);
+}
+
+int emu6502_map_device(emu6502_t *e, uint16_t addr, uint32_t size,
+                       emu6502_read_fn read, emu6502_write_fn write,
+                       void *user) {
+    uint32_t block, end = (uint32_t)addr + size;
+    device_t *dev;
+
+    if(!size || end > 0x10000 || e->n_devices == MAX_DEVICES) return -1;
+    dev = &e->devices[e->n_devices++];
+    dev->read = read;
+    dev->write = write;
+    dev->user = user;
+
+    machine_select(&e->m);
+    for(block = addr>>4; block < (end+0xf)>>4; ++block) {
+        e->device_idx[block] = e->n_devices;
+        memory_map_page(&device_entry, block<<4);
+    }
+    return 0;
+}
+
+int emu6502_trap(emu6502_t *e, uint16_t pc, emu6502_trap_fn fn,
+                 void *user) {
+    trap_t *trap, **traps;
+    if(!(traps = realloc(e->traps, (e->n_traps+1) * sizeof *traps)))
+        return -1;
+    e->traps = traps;
+    if(!(trap = malloc(sizeof *trap))) return -1;
+    trap->e = e;
+    trap->fn = fn;
+    trap->user = user;
+    machine_select(&e->m);
+    if(hle_add(pc, trap_call, trap)) {
+        free(trap);
+        return -1;
+    }
+    e->traps[e->n_traps++] = trap;
+    return 0;
+}
+
+void emu6502_on_cycle(emu6502_t *e, emu6502_cycle_fn fn, void *user) {
+    e->m.cycle_hook = fn;
+    e->m.cycle_data = user;
+}
+
+void emu6502_reset(emu6502_t *e) {
+    machine_select(&e->m);
+    e->m.halt = 0;
+    cpu_init();
+}
+
+enum emu6502_stop emu6502_step(emu6502_t *e) {
+    machine_select(&e->m);
+    if(!e->m.halt) cpu_step();
+    return stop_reason(&e->m);
+}
+
+enum emu6502_stop emu6502_run_for(emu6502_t *e, uint64_t cycles) {
+    machine_select(&e->m);
+    if(!e->m.halt) cpu_run_for(cycles);
+    return e->m.halt ? stop_reason(&e->m) : EMU6502_STOP_CYCLES;
+}
+
+void emu6502_request_stop(emu6502_t *e) {
+    if(!e->m.halt) e->m.halt = HALT_USER;
+}
+
+uint64_t emu6502_cycles(const emu6502_t *e) {
+    return e->m.cycles;
+}
+
+void emu6502_get_regs(const emu6502_t *e, emu6502_regs_t *regs) {
+    regs->a = e->m.cpu.a;
+    regs->x = e->m.cpu.x;
+    regs->y = e->m.cpu.y;
+    regs->s = e->m.cpu.s;
+    regs->p = e->m.cpu.p;
+    regs->pc = e->m.cpu.pc;
+}
+
+void emu6502_set_regs(emu6502_t *e, const emu6502_regs_t *regs) {
+    e->m.cpu.a = regs->a;
+    e->m.cpu.x = regs->x;
+    e->m.cpu.y = regs->y;
+    e->m.cpu.s = regs->s;
+    e->m.cpu.p = regs->p;
+    e->m.cpu.pc = regs->pc;
+}
+
+uint8_t emu6502_read(emu6502_t *e, uint16_t addr) {
+    machine_select(&e->m);
+    return memory_read(addr);
+}
+
+void emu6502_write(emu6502_t *e, uint16_t addr, uint8_t val) {
+    machine_select(&e->m);
+    memory_write(addr, val);
+}
+
+void emu6502_read_block(emu6502_t *e, uint16_t addr, uint8_t *dst,
+                        size_t len) {
+    machine_select(&e->m);
+    memory_read_block(addr, dst, len);
+}
+
+void emu6502_write_block(emu6502_t *e, uint16_t addr, const uint8_t *src,
+                         size_t len) {
+    machine_select(&e->m);
+    memory_write_block(addr, src, len);
+}
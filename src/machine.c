@@ -0,0 +1,72 @@
+#include <emu6502/machine.h>
+#include <emu6502/alu.h>
+#include <emu6502/mapper.h>
+#include <emu6502/hle.h>
+#include <emu6502/cover.h>
+#include <emu6502/heat.h>
+#include <emu6502/memo.h>
+#include <emu6502/flow.h>
+#include <emu6502/utils.h>
+#include <stdlib.h>
+
+__thread machine_t *current_machine = NULL;
+
+/* set up a zeroed machine, for embedding it in a bigger struct */
+void machine_init(machine_t *m) {
+    m->variant = &cpu_nmos;
+    m->flags = MACHINE_STDIO;
+    m->doorbell = -1;
+    cpu_map_io();
+    dma_map();
+    bcd_init();
+    memory_machine_init(m);
+}
+
+void machine_release(machine_t *m) {
+    cartridge_free(m->cart);
+    hle_free(m->hle);
+    free(m->cover);
+    free(m->heat);
+    memo_unref(m->memo);
+    flow_unref(m->flow);
+    memory_machine_release(m);
+    if(current_machine == m) current_machine = NULL;
+}
+
+/* Make dst, fresh or released, a copy of src that runs on independently.
+ * Machines with a flat view can't be copied. */
+int machine_copy(machine_t *dst, const machine_t *src) {
+    if(src->flat) return -1;
+    *dst = *src;
+    (void)memory_machine_copy(dst, src);
+    if(src->cart) dst->cart = cartridge_copy(src->cart);
+    dst->hle = hle_copy(src->hle);
+    /* memoized calls hold for any machine, the copy adds to them too */
+    dst->memo = memo_ref(src->memo);
+    dst->memo_rec = NULL;
+    dst->flow = flow_ref(src->flow);
+    if(src->cover) {
+        if(!(dst->cover = malloc(sizeof *dst->cover)))
+            die("[Error] Out of memory\n");
+        *dst->cover = *src->cover;
+    }
+    if(src->heat) {
+        if(!(dst->heat = malloc(sizeof *dst->heat)))
+            die("[Error] Out of memory\n");
+        *dst->heat = *src->heat;
+    }
+    return 0;
+}
+
+machine_t *machine_new(void) {
+    machine_t *m;
+    if(!(m = calloc(1, sizeof *m))) return NULL;
+    machine_init(m);
+    return m;
+}
+
+void machine_free(machine_t *m) {
+    if(!m) return;
+    machine_release(m);
+    free(m);
+}
@@ -2,26 +2,286 @@
 #include <emu6502/args.h>
 #include <emu6502/cpu.h>
 #include <emu6502/memory.h>
+#include <emu6502/machine.h>
+#include <emu6502/fusion.h>
+#include <emu6502/rom.h>
+#include <emu6502/mapper.h>
+#include <emu6502/server.h>
+#include <emu6502/session.h>
+#include <emu6502/stats.h>
+#include <emu6502/hle.h>
+#include <emu6502/shm.h>
+#include <emu6502/board.h>
+#include <emu6502/cover.h>
+#include <emu6502/heat.h>
+#include <emu6502/config.h>
+#include <emu6502/memo.h>
+#include <emu6502/flow.h>
+#include <emu6502/perf.h>
+#include <emu6502/verify.h>
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define PROGRAM_NAME "emu6502"
 
 struct cmd_options cmd_options = {
     .verbose = 0,
     .step = 0,
+    .pair_profile = 0,
+    .flat = 0,
+    .rom_flags = 0,
+    .mapper = NULL,
+    .variant = NULL,
+    .machine = NULL,
+    .bus_accurate = 0,
+    .hle_path = NULL,
+    .memo = 0,
+    .memo_path = NULL,
+    .flow = 0,
+    .flow_path = NULL,
+    .shm = NULL,
+    .n_shm = 0,
+    .doorbell = NULL,
+    .stats = 0,
+    .stats_path = NULL,
+    .stats_interval = 0,
+    .perf = 0,
+    .verify = 0,
+    .verify_engine = VERIFY_STEP,
+    .verify_segment = 1000000,
+    .verify_threads = 0,
+    .server = 0,
+    .server_path = NULL,
+    .sessions_path = NULL,
+    .session_threads = 0,
+    .cpus = 1,
+    .quantum = 1000,
+    .shared_addr = 0x6000,
+    .shared_size = 0x800,
+    .cover_path = NULL,
+    .cover_listing = NULL,
+    .cover_lcov = NULL,
+    .heat_path = NULL,
+    .heat_top = 16,
 };
 
 const char *help_str = ""
-"Usage: " PROGRAM_NAME " [option]... rom\n"
+"Usage: " PROGRAM_NAME " [option]... rom[@addr[,offset[,size]]]...\n"
+"       " PROGRAM_NAME " [option]... --server[=SOCKET]\n"
+"       " PROGRAM_NAME " [option]... --sessions=SOCKET rom...\n"
+"\n"
+"Maps each rom at addr (default $8000), optionally only size bytes from\n"
+"offset into the file. Later segments are mapped over earlier ones.\n"
+"With --mapper the first rom is instead a cartridge image whose banks are\n"
+"switched into $8000-$ffff.\n"
+"With --machine the roms go into the PRG space the description declares,\n"
+"and may be left out when it maps its own.\n"
 "\n"
 "Options:\n"
 "  -v, --verbose              increment the verbosity level\n"
 "  -h, --help                 print this help message\n"
 "  -d, --debug                start in debugging mode\n"
+"  -r, --read-only-rom        ignore writes to ROM instead of copying pages\n"
+"  -m, --mapper=NAME          bank-switching hardware of the first rom, one\n"
+"                             of nrom, uxrom, axrom, bank8k, bank4k\n"
+"      --cpu=NAME             CPU to emulate, one of nmos (default), 65c02,\n"
+"                             2a03\n"
+"      --machine=FILE         lay out memory and devices like FILE says\n"
+"                             instead of the default, see config.c\n"
+"      --bus-accurate         step the CPU one cycle at a time with every bus\n"
+"                             access real hardware makes, see __cpu_engine.h\n"
+"      --pair-profile         print the most frequent opcode pairs on exit\n"
+"      --flat                 keep memory in a flat 64 KiB host mapping\n"
+"      --hle=FILE             replace routines with native code, FILE has\n"
+"                             lines of 'addr native', see hle.c\n"
+"      --memo[=FILE]          replay calls of routines that only compute,\n"
+"                             those at the addresses in FILE or every one\n"
+"                             called from the code, see memo.c\n"
+"      --flow[=FILE]          analyse the control flow of the roms up front,\n"
+"                             kept in FILE (default the first rom plus\n"
+"                             .flow) for the next run, see flow.c\n"
+"      --shm=SRC@ADDR[,SIZE]  share a window with other processes, SRC is\n"
+"                             shm:NAME or a file\n"
+"      --doorbell=SOCKET      connect the doorbell at $3ff1 to SOCKET\n"
+"      --stats[=FILE]         dump counters as JSON to FILE or stderr at exit\n"
+"                             and on SIGUSR1\n"
+"      --stats-interval=SECS  also report instructions/sec every SECS\n"
+"      --perf-counters        report host cycles, instructions, branch and\n"
+"                             cache misses of the run loop on exit, per\n"
+"                             instruction and class of them, see perf.c\n"
+"      --verify[=ENGINE]      run with checkpoints, then replay the segments\n"
+"                             between them in parallel on ENGINE, step\n"
+"                             (default) or fused, and check they match,\n"
+"                             see verify.c\n"
+"      --verify-segment=CYCLES  cycles between checkpoints (default 1000000)\n"
+"      --verify-threads=N     threads replaying (default one per core)\n"
+"      --server[=SOCKET]      run jobs sent on SOCKET or stdin, see server.c\n"
+"      --sessions=SOCKET      give every connection on SOCKET a machine with\n"
+"                             its console on it, see session.c\n"
+"      --session-threads=N    threads the sessions share (default one per\n"
+"                             core)\n"
+"      --cpus=N               run N CPUs on their own threads, see board.c\n"
+"      --quantum=CYCLES       cycles the CPUs run between syncs (default 1000)\n"
+"      --shared=ADDR[,SIZE]   window the CPUs share (default $6000,$800)\n"
+"      --coverage=FILE        record executed, read and written addresses and\n"
+"                             branch directions, merged into FILE\n"
+"      --coverage-listing=FILE  write an annotated disassembly of the merged\n"
+"                             coverage to FILE, see cover.c\n"
+"      --coverage-lcov=FILE   write the merged coverage as an lcov tracefile\n"
+"      --heatmap=FILE         count accesses per address, write them to FILE\n"
+"                             as a PGM image and report on exit, see heat.c\n"
+"      --heatmap-top=N        entries per section of the report (default 16)\n"
 ;
 
+static unsigned long parse_num(const char *s, char **end) {
+    if(*s == '$') return strtoul(s+1, end, 16);
+    return strtoul(s, end, 0);
+}
+
+/* map rom[@addr[,offset[,size]]] into the current machine */
+int load_segment(const char *spec) {
+    unsigned long addr = 0x8000, off = 0, sz = (unsigned long)-1;
+    const char *at = strrchr(spec, '@');
+    size_t len = at ? (size_t)(at - spec) : strlen(spec);
+    rom_image_t *img;
+    char *path, *end;
+
+    if(at) {
+        addr = parse_num(at+1, &end);
+        if(*end == ',') off = parse_num(end+1, &end);
+        if(*end == ',') sz = parse_num(end+1, &end);
+        if(*end || addr > 0xffff) {
+            fprintf(stderr, "[Error] Bad segment '%s'\n", spec);
+            return -1;
+        }
+    }
+
+    if(!(path = malloc(len+1))) die("[Error] Out of memory\n");
+    (void)memcpy(path, spec, len);
+    path[len] = '\0';
+    img = rom_image_load(path);
+    if(!img) perror(path);
+    free(path);
+    if(!img) return -1;
+
+    memory_map_rom_segment(img, off, sz, addr, cmd_options.rom_flags);
+    rom_image_unref(img);
+    return 0;
+}
+
+/* plug a whole image into the current machine as a bank-switched cartridge */
+int load_cartridge(const char *path) {
+    rom_image_t *img;
+    int ret;
+
+    if(!(img = rom_image_load(path))) {
+        perror(path);
+        return -1;
+    }
+    if((ret = cartridge_insert(img, cmd_options.mapper)))
+        fprintf(stderr, "[Error] '%s' is too small for mapper %s\n",
+                path, cmd_options.mapper->name);
+    rom_image_unref(img);
+    return ret;
+}
+
+/* --flow file, set when there is one */
+static char *flow_file = NULL;
+
+/* next to the first rom, or the machine description without roms */
+static void flow_file_init(int argc, char *argv[]) {
+    const char *src = argc ? argv[0] : cmd_options.machine->path;
+    const char *at = argc ? strrchr(src, '@') : NULL;
+    size_t len = at ? (size_t)(at - src) : strlen(src);
+
+    if(!(flow_file = malloc(len + sizeof ".flow")))
+        die("[Error] Out of memory\n");
+    (void)memcpy(flow_file, src, len);
+    (void)strcpy(flow_file + len, ".flow");
+}
+
+/* everything besides roms that goes into the current machine */
+int load_extras(void) {
+    unsigned i;
+    /* before traps are patched into the code */
+    if(flow_file) (void)flow_open(flow_file);
+    for(i = 0; i < cmd_options.n_shm; ++i)
+        if(shm_map(cmd_options.shm[i])) return -1;
+    if(cmd_options.doorbell && shm_doorbell_connect(cmd_options.doorbell))
+        return -1;
+    if(cmd_options.hle_path && hle_load(cmd_options.hle_path)) return -1;
+    if(cmd_options.memo && memo_load(cmd_options.memo_path)) return -1;
+    return 0;
+}
+
+/* roms for board_setup() */
+static char **board_argv;
+static int board_argc;
+
+/* every CPU of a board loads the same roms */
+static int board_setup(unsigned cpu) {
+    (void)cpu;
+    if(cmd_options.machine && config_apply(cmd_options.machine)) return -1;
+    if(cmd_options.variant) current_machine->variant = cmd_options.variant;
+    if(cmd_options.bus_accurate)
+        current_machine->flags |= MACHINE_BUS_ACCURATE;
+    for(int i = 0; i < board_argc; ++i)
+        if(i == 0 && cmd_options.mapper ? load_cartridge(board_argv[i])
+                                         : load_segment(board_argv[i]))
+            return -1;
+    return load_extras();
+}
+
+/* merge into --coverage and write the reports from the merged data */
+static int write_coverage(const char *source) {
+    cover_t *c = current_machine->cover;
+    FILE *f;
+
+    if(cmd_options.cover_path) {
+        if(cover_save(c, cmd_options.cover_path)) {
+            perror(cmd_options.cover_path);
+            return -1;
+        }
+        (void)cover_load(c, cmd_options.cover_path);
+    }
+    if(cmd_options.cover_listing) {
+        if(!(f = fopen(cmd_options.cover_listing, "w"))) {
+            perror(cmd_options.cover_listing);
+            return -1;
+        }
+        cover_listing(f);
+        (void)fclose(f);
+    }
+    if(cmd_options.cover_lcov) {
+        if(!(f = fopen(cmd_options.cover_lcov, "w"))) {
+            perror(cmd_options.cover_lcov);
+            return -1;
+        }
+        cover_lcov(f, source);
+        (void)fclose(f);
+    }
+    return 0;
+}
+
+static int write_heatmap(void) {
+    FILE *f;
+    int err;
+
+    if(!(f = fopen(cmd_options.heat_path, "wb"))) {
+        perror(cmd_options.heat_path);
+        return -1;
+    }
+    err = heat_write_image(f);
+    if(fclose(f) || err) {
+        perror(cmd_options.heat_path);
+        return -1;
+    }
+    heat_report(stderr, cmd_options.heat_top);
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     int ret = EXIT_SUCCESS;
 
@@ -32,10 +292,39 @@ int main(int argc, char *argv[]) {
         {"verbose", no_argument, NULL, 'v'},
         {"help", no_argument, NULL, 'h'},
         {"debug", no_argument, NULL, 'd'},
+        {"pair-profile", no_argument, NULL, 'P'},
+        {"flat", no_argument, NULL, 'F'},
+        {"hle", required_argument, NULL, 'H'},
+        {"memo", optional_argument, NULL, 'E'},
+        {"flow", optional_argument, NULL, 'Y'},
+        {"shm", required_argument, NULL, 'M'},
+        {"doorbell", required_argument, NULL, 'B'},
+        {"stats", optional_argument, NULL, 'T'},
+        {"stats-interval", required_argument, NULL, 'I'},
+        {"perf-counters", no_argument, NULL, 'R'},
+        {"verify", optional_argument, NULL, 'D'},
+        {"verify-segment", required_argument, NULL, 'Z'},
+        {"verify-threads", required_argument, NULL, 'z'},
+        {"server", optional_argument, NULL, 'S'},
+        {"sessions", required_argument, NULL, 'J'},
+        {"session-threads", required_argument, NULL, 'X'},
+        {"cpus", required_argument, NULL, 'C'},
+        {"quantum", required_argument, NULL, 'Q'},
+        {"shared", required_argument, NULL, 'W'},
+        {"read-only-rom", no_argument, NULL, 'r'},
+        {"mapper", required_argument, NULL, 'm'},
+        {"cpu", required_argument, NULL, 'U'},
+        {"bus-accurate", no_argument, NULL, 'G'},
+        {"machine", required_argument, NULL, 'K'},
+        {"coverage", required_argument, NULL, 'V'},
+        {"coverage-listing", required_argument, NULL, 'L'},
+        {"coverage-lcov", required_argument, NULL, 'O'},
+        {"heatmap", required_argument, NULL, 'A'},
+        {"heatmap-top", required_argument, NULL, 'N'},
         {0, 0, 0, 0},
         };
 
-        if((c = getopt_long(argc, argv, "vhd", long_opts, &longind)) == -1)
+        if((c = getopt_long(argc, argv, "vhdrm:", long_opts, &longind)) == -1)
            break;
 
         switch(c) {
@@ -47,6 +336,158 @@ int main(int argc, char *argv[]) {
             cmd_options.step = 1;
             break;
 
+        case 'P':
+            cmd_options.pair_profile = 1;
+            break;
+
+        case 'F':
+            cmd_options.flat = 1;
+            break;
+
+        case 'H':
+            cmd_options.hle_path = optarg;
+            break;
+
+        case 'E':
+            cmd_options.memo = 1;
+            cmd_options.memo_path = optarg;
+            break;
+
+        case 'Y':
+            cmd_options.flow = 1;
+            cmd_options.flow_path = optarg;
+            break;
+
+        case 'M': {
+            const char **shm = realloc(cmd_options.shm,
+                                       (cmd_options.n_shm+1) * sizeof *shm);
+            if(!shm) die("[Error] Out of memory\n");
+            cmd_options.shm = shm;
+            shm[cmd_options.n_shm++] = optarg;
+            break;
+        }
+
+        case 'B':
+            cmd_options.doorbell = optarg;
+            break;
+
+        case 'T':
+            cmd_options.stats = 1;
+            cmd_options.stats_path = optarg;
+            break;
+
+        case 'I':
+            cmd_options.stats = 1;
+            cmd_options.stats_interval = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'R':
+            cmd_options.perf = 1;
+            break;
+
+        case 'D':
+            cmd_options.verify = 1;
+            if(!optarg || !strcmp(optarg, "step"))
+                cmd_options.verify_engine = VERIFY_STEP;
+            else if(!strcmp(optarg, "fused"))
+                cmd_options.verify_engine = VERIFY_FUSED;
+            else {
+                fprintf(stderr, "[Error] Unknown engine '%s', try step or "
+                        "fused\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'Z':
+            cmd_options.verify_segment = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'z':
+            cmd_options.verify_threads = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'S':
+            cmd_options.server = 1;
+            cmd_options.server_path = optarg;
+            break;
+
+        case 'J':
+            cmd_options.sessions_path = optarg;
+            break;
+
+        case 'X':
+            cmd_options.session_threads = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'C':
+            cmd_options.cpus = strtoul(optarg, NULL, 0);
+            if(!cmd_options.cpus || cmd_options.cpus > BOARD_MAX_CPUS) {
+                fprintf(stderr, "[Error] --cpus must be 1 to %d\n",
+                        BOARD_MAX_CPUS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'Q':
+            cmd_options.quantum = strtoul(optarg, NULL, 0);
+            break;
+
+        case 'W': {
+            char *end;
+            cmd_options.shared_addr = parse_num(optarg, &end);
+            if(*end == ',') cmd_options.shared_size = parse_num(end+1, &end);
+            break;
+        }
+
+        case 'r':
+            cmd_options.rom_flags |= MEMORY_ROM_READONLY;
+            break;
+
+        case 'm':
+            if(!(cmd_options.mapper = mapper_find(optarg))) {
+                fprintf(stderr, "[Error] Unknown mapper '%s', try one of %s\n",
+                        optarg, mapper_names());
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'U':
+            if(!(cmd_options.variant = cpu_variant_find(optarg))) {
+                fprintf(stderr, "[Error] Unknown CPU '%s', try one of nmos, "
+                        "65c02, 2a03\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'K':
+            if(!(cmd_options.machine = config_get(optarg)))
+                exit(EXIT_FAILURE);
+            break;
+
+        case 'G':
+            cmd_options.bus_accurate = 1;
+            break;
+
+        case 'V':
+            cmd_options.cover_path = optarg;
+            break;
+
+        case 'L':
+            cmd_options.cover_listing = optarg;
+            break;
+
+        case 'O':
+            cmd_options.cover_lcov = optarg;
+            break;
+
+        case 'A':
+            cmd_options.heat_path = optarg;
+            break;
+
+        case 'N':
+            cmd_options.heat_top = strtoul(optarg, NULL, 0);
+            break;
+
         case 'h':
             die(help_str);
 
@@ -60,40 +501,113 @@ int main(int argc, char *argv[]) {
     }
 
     argv += optind;
-    if((argc -= optind) < 1) die(help_str);
+    argc -= optind;
+    if(cmd_options.stats
+       && stats_enable(cmd_options.stats_path, cmd_options.stats_interval)) {
+        perror(cmd_options.stats_path);
+        exit(EXIT_FAILURE);
+    }
+    if(cmd_options.server)
+        exit(server_run(cmd_options.server_path) ? EXIT_FAILURE : EXIT_SUCCESS);
+    if(argc < 1 && !cmd_options.machine) die(help_str);
+    if(cmd_options.flow_path) flow_file = (char *)cmd_options.flow_path;
+    else if(cmd_options.flow) flow_file_init(argc, argv);
 
-    FILE *f;
-    if(!(f = fopen(argv[0], "rb"))) {
-        perror("fopen");
+    if(cmd_options.sessions_path && cmd_options.cpus > 1) {
+        fprintf(stderr, "[Error] Sessions are single CPU machines\n");
+        exit(EXIT_FAILURE);
+    }
+    if(cmd_options.perf && (cmd_options.cpus > 1 || cmd_options.sessions_path
+                            || cmd_options.step)) {
+        fprintf(stderr, "[Error] Host counters only measure a single CPU "
+                "run\n");
+        exit(EXIT_FAILURE);
+    }
+    if(cmd_options.verify && (cmd_options.cpus > 1 || cmd_options.sessions_path
+                              || cmd_options.step || cmd_options.perf)) {
+        fprintf(stderr, "[Error] Only a single CPU run can be verified\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(cmd_options.cpus > 1) {
+        board_t *board;
+        board_argv = argv;
+        board_argc = argc;
+        if(!(board = board_new(cmd_options.cpus, cmd_options.quantum,
+                               cmd_options.shared_addr, cmd_options.shared_size,
+                               board_setup))) {
+            fprintf(stderr, "[Error] Cannot set up %u CPUs, the shared window "
+                    "must be whole pages\n", cmd_options.cpus);
+            exit(EXIT_FAILURE);
+        }
+        if(board_run(board)) ret = EXIT_FAILURE;
+        board_free(board);
+        exit(ret);
+    }
+
+    machine_t *machine;
+    if(!(machine = machine_new())) die("[Error] Out of memory\n");
+    machine_select(machine);
+    if(cmd_options.machine && config_apply(cmd_options.machine)) {
         ret = EXIT_FAILURE;
         goto ret;
     }
+    if(cmd_options.variant) machine->variant = cmd_options.variant;
+    if(cmd_options.bus_accurate) machine->flags |= MACHINE_BUS_ACCURATE;
+    if(cmd_options.cover_path || cmd_options.cover_listing
+       || cmd_options.cover_lcov)
+        (void)cover_enable();
+    if(cmd_options.heat_path) (void)heat_enable();
+    if(cmd_options.flat && !memory_flat_enable())
+        fprintf(stderr, "[Error] No flat memory view, using page tables\n");
 
-    fseek(f, 0, SEEK_END);
-    size_t rom_sz = ftell(f);
-    rewind(f);
-
-    {
-        uint8_t rom[rom_sz];
-        if(fread(rom, 1, rom_sz, f) != rom_sz) {
-            fclose(f);
-            perror("fread");
+    for(int i = 0; i < argc; ++i)
+        if(i == 0 && cmd_options.mapper ? load_cartridge(argv[i])
+                                         : load_segment(argv[i])) {
             ret = EXIT_FAILURE;
             goto ret;
         }
-        fclose(f);
-        /* TODO: load ROM from FILE * directly */
-        memory_load_rom_addr(rom, rom_sz, 0x8000);
+    if(load_extras()) {
+        ret = EXIT_FAILURE;
+        goto ret;
     }
     cpu_init();
 
+    if(cmd_options.sessions_path)
+        exit(session_run(cmd_options.sessions_path, machine,
+                         cmd_options.session_threads)
+             ? EXIT_FAILURE : EXIT_SUCCESS);
     if(cmd_options.step)
         do {
             cpu_step();
             cpu_dump();
         } while(!cpu_halt && fgetc(stdin) != 'q');
-    else
-        while(!cpu_halt) cpu_step();
+    else if(cmd_options.verify) {
+        if(verify_run(machine, cmd_options.verify_engine,
+                      cmd_options.verify_segment, cmd_options.verify_threads))
+            ret = EXIT_FAILURE;
+    } else if(cmd_options.perf) {
+        if(perf_start())
+            fprintf(stderr, "[Error] No host performance counters\n");
+        cpu_run();
+        perf_stop();
+        perf_report(stderr, cpu_engine());
+    } else
+        cpu_run();
+
+    if(cmd_options.pair_profile)
+        fusion_profile_dump(stderr, 16);
+    if(machine->cover
+       && write_coverage(argc ? argv[0] : cmd_options.machine->path))
+        ret = EXIT_FAILURE;
+    if(machine->heat && write_heatmap()) ret = EXIT_FAILURE;
+    if(machine->memo && cmd_options.verbose) memo_report(stderr);
+    if(machine->flow) {
+        if(flow_update(machine->flow, flow_file)) perror(flow_file);
+        if(cmd_options.verbose) flow_report(stderr);
+    }
+
+    machine_free(machine);
 
 ret:
     exit(ret);
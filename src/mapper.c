@@ -0,0 +1,116 @@
+#include <emu6502/mapper.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/utils.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* point the window at addr to a bank of the image */
+void cartridge_switch(cartridge_t *cart, uint16_t addr, unsigned bank) {
+    size_t off = (size_t)(bank % cart->banks) * (cart->mapper->window<<8);
+    memory_map_bank(cart->img->data + off, addr, cart->mapper->window);
+}
+
+int cartridge_write(cartridge_t *cart, uint16_t addr, uint8_t val) {
+    return cart->mapper->write && cart->mapper->write(cart, addr, val);
+}
+
+/* NROM: 16 KiB images are mirrored, 32 KiB fill $8000-$ffff, no registers */
+static void nrom_reset(cartridge_t *cart) {
+    cartridge_switch(cart, 0x8000, 0);
+    cartridge_switch(cart, 0xc000, cart->banks-1);
+}
+
+static int nrom_write(cartridge_t *cart, uint16_t addr, uint8_t val) {
+    (void)cart, (void)val;
+    return addr >= 0x8000;
+}
+
+/* UxROM: switchable 16 KiB at $8000, last bank fixed at $c000 */
+static int uxrom_write(cartridge_t *cart, uint16_t addr, uint8_t val) {
+    if(addr < 0x8000) return 0;
+    cartridge_switch(cart, 0x8000, val);
+    return 1;
+}
+
+/* AxROM: one switchable 32 KiB bank */
+static void axrom_reset(cartridge_t *cart) {
+    cartridge_switch(cart, 0x8000, 0);
+}
+
+static int axrom_write(cartridge_t *cart, uint16_t addr, uint8_t val) {
+    if(addr < 0x8000) return 0;
+    cartridge_switch(cart, 0x8000, val&0x7);
+    return 1;
+}
+
+/* bank8k/bank4k: $8000-$ffff split into 8 KiB/4 KiB windows, a write
+ * anywhere in a window selects its bank. They start out with the first
+ * banks in order and the last bank in the top window for the vectors. */
+static void window_reset(cartridge_t *cart) {
+    unsigned size = cart->mapper->window<<8, i, n = 0x8000 / size;
+    for(i = 0; i < n; ++i)
+        cartridge_switch(cart, 0x8000 + i*size, i+1 < n ? i : cart->banks-1);
+}
+
+static int window_write(cartridge_t *cart, uint16_t addr, uint8_t val) {
+    uint16_t size = cart->mapper->window<<8;
+    if(addr < 0x8000) return 0;
+    cartridge_switch(cart, addr & ~(size-1), val);
+    return 1;
+}
+
+static const mapper_t mappers[] = {
+{"nrom",   0x40, nrom_reset,  nrom_write},
+{"uxrom",  0x40, nrom_reset,  uxrom_write},
+{"axrom",  0x80, axrom_reset, axrom_write},
+{"bank8k", 0x20, window_reset, window_write},
+{"bank4k", 0x10, window_reset, window_write},
+};
+
+const mapper_t *mapper_find(const char *name) {
+    unsigned i;
+    for(i = 0; i < sizeof mappers / sizeof *mappers; ++i)
+        if(!strcmp(mappers[i].name, name)) return &mappers[i];
+    return NULL;
+}
+
+const char *mapper_names(void) {
+    return "nrom, uxrom, axrom, bank8k, bank4k";
+}
+
+/* plug an image into the current machine, replacing any cartridge */
+int cartridge_insert(rom_image_t *img, const mapper_t *mapper) {
+    machine_t *m = current_machine;
+    size_t size = mapper->window<<8;
+    cartridge_t *cart;
+
+    if(img->size < size) return -1;
+    if(!(cart = malloc(sizeof *cart))) return -1;
+    cart->mapper = mapper;
+    cart->img = rom_image_ref(img);
+    cart->banks = img->size / size;
+
+    cartridge_free(m->cart);
+    m->cart = cart;
+    /* take the machine's reference and set up the page flags once, read
+     * only so that writes reach the mapper */
+    memory_map_rom_segment(img, 0, 0x8000, 0x8000, MEMORY_ROM_READONLY);
+    mapper->reset(cart);
+    return 0;
+}
+
+/* the bank state lives in the page table, which the caller copies */
+cartridge_t *cartridge_copy(const cartridge_t *src) {
+    cartridge_t *cart;
+    if(!(cart = malloc(sizeof *cart))) die("[Error] Out of memory\n");
+    *cart = *src;
+    cart->img = rom_image_ref(src->img);
+    return cart;
+}
+
+void cartridge_free(cartridge_t *cart) {
+    if(!cart) return;
+    rom_image_unref(cart->img);
+    free(cart);
+}
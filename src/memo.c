@@ -0,0 +1,612 @@
+#include <emu6502/memo.h>
+#include <emu6502/cpu.h>
+#include <emu6502/hle.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/decoding.h>
+#include <emu6502/flow.h>
+#include <emu6502/stats.h>
+#include <emu6502/utils.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Memoization of routines that only compute.
+ *
+ * Every memoized routine gets an HLE trap on its first byte. On a call the
+ * trap looks for an earlier call with the same inputs: the registers and
+ * flags the routine read before setting them and the bytes it read before
+ * writing them, code included. If there is one its effects are replayed,
+ * registers, bytes written and cycles, and the trap returns straight away.
+ * Otherwise the call is run here one instruction at a time and recorded,
+ * along with every memoized routine it calls in turn, up to the RTS at the
+ * S the call started with.
+ *
+ * Accesses are seen through the trace hook of memory.c. Stack bytes are
+ * kept relative to S, so a routine matches at any depth unless it looks
+ * at S itself or reaches the stack page some other way. A routine that
+ * touches anything but plain RAM and ROM, uses an instruction the tables
+ * below don't know, or runs too long is given up on for good. Recording
+ * stops wherever that happens and the machine simply runs on. */
+
+#define reg cpu_reg
+
+/* a recording gives up after this many instructions */
+#define MEMO_MAX_STEPS 100000
+/* bytes a call may touch */
+#define MEMO_MAX_BYTES 512
+/* nested calls recorded at once, deeper ones are only run */
+#define MEMO_MAX_DEPTH 16
+/* misses after which a routine that rarely hits is given up on */
+#define MEMO_MAX_MISSES 256
+
+#define MEMO_NZ (FLAGS_NEGATIVE|FLAGS_ZERO)
+#define MEMO_NZC (MEMO_NZ|FLAGS_CARRY)
+#define MEMO_P 0xff
+
+/* touched states */
+#define TOUCH_IN      (1<<0)
+#define TOUCH_WRITTEN (1<<1)
+
+/* one call being recorded */
+typedef struct memo_level {
+    memo_routine_t *routine;
+    cpu_reg_t entry;
+    uint64_t cycles;
+    uint16_t in, wr;
+    int s_abs, overflow;
+    /* state and first value of the bytes touched in this call */
+    uint32_t stamp;
+    uint32_t gen[0x10000];
+    uint8_t state[0x10000];
+    uint8_t val[0x10000];
+    uint16_t touched[MEMO_MAX_BYTES];
+    unsigned n_touched;
+} memo_level_t;
+
+typedef struct memo_rec {
+    memo_level_t *levels[MEMO_MAX_DEPTH];
+    unsigned depth;
+    /* the current instruction pushes or pulls */
+    int stack_op;
+    int abort, impure;
+    unsigned long steps;
+} memo_rec_t;
+
+static __thread memo_rec_t rec;
+
+/* Registers and flags an instruction reads and sets, -1 for ones whose
+ * effects aren't only those and its memory accesses. */
+static int memo_regs(const instr_t *in, uint16_t *rd, uint16_t *wr) {
+    uint16_t r = 0, w = 0;
+
+    switch(in->mode) {
+    case MODE_ABSOLUTE_X: case MODE_ZERO_PAGE_X:
+    case MODE_ZERO_PAGE_INDIRECT_X: case MODE_ABSOLUTE_INDIRECT_X:
+        r = MEMO_X;
+        break;
+    case MODE_ABSOLUTE_Y: case MODE_ZERO_PAGE_Y: case MODE_ZERO_PAGE_INDIRECT_Y:
+        r = MEMO_Y;
+        break;
+    case MODE_ACCUMULATOR:
+        r = MEMO_A;
+        w = MEMO_A;
+        break;
+    default:
+        break;
+    }
+
+    switch(in->type) {
+    case OP_ORA: case OP_AND: case OP_EOR:
+        r |= MEMO_A, w |= MEMO_A|MEMO_NZ; break;
+    case OP_ADC: case OP_SBC:
+        r |= MEMO_A|FLAGS_CARRY|FLAGS_DECIMAL;
+        w |= MEMO_A|MEMO_NZC|FLAGS_OVERFLOW;
+        break;
+    case OP_ASL: case OP_LSR: w |= MEMO_NZC; break;
+    case OP_ROL: case OP_ROR: r |= FLAGS_CARRY, w |= MEMO_NZC; break;
+    case OP_INC: case OP_DEC: w |= MEMO_NZ; break;
+    case OP_BIT:
+        r |= MEMO_A;
+        w |= in->mode == MODE_IMMEDIATE ? FLAGS_ZERO : MEMO_NZ|FLAGS_OVERFLOW;
+        break;
+    case OP_CMP: r |= MEMO_A, w |= MEMO_NZC; break;
+    case OP_CPX: r |= MEMO_X, w |= MEMO_NZC; break;
+    case OP_CPY: r |= MEMO_Y, w |= MEMO_NZC; break;
+    case OP_LDA: w |= MEMO_A|MEMO_NZ; break;
+    case OP_LDX: w |= MEMO_X|MEMO_NZ; break;
+    case OP_LDY: w |= MEMO_Y|MEMO_NZ; break;
+    /* stores set no flags, only the read-modify-writes above do */
+    case OP_STA: r |= MEMO_A; break;
+    case OP_STX: r |= MEMO_X; break;
+    case OP_STY: r |= MEMO_Y; break;
+    case OP_TAX: r |= MEMO_A, w |= MEMO_X|MEMO_NZ; break;
+    case OP_TAY: r |= MEMO_A, w |= MEMO_Y|MEMO_NZ; break;
+    case OP_TXA: r |= MEMO_X, w |= MEMO_A|MEMO_NZ; break;
+    case OP_TYA: r |= MEMO_Y, w |= MEMO_A|MEMO_NZ; break;
+    case OP_TSX: r |= MEMO_S, w |= MEMO_X|MEMO_NZ; break;
+    case OP_INX: case OP_DEX: r |= MEMO_X, w |= MEMO_X|MEMO_NZ; break;
+    case OP_INY: case OP_DEY: r |= MEMO_Y, w |= MEMO_Y|MEMO_NZ; break;
+    case OP_PHA: r |= MEMO_A; break;
+    case OP_PHX: r |= MEMO_X; break;
+    case OP_PHY: r |= MEMO_Y; break;
+    case OP_PHP: r |= MEMO_P; break;
+    case OP_PLA: w |= MEMO_A|MEMO_NZ; break;
+    case OP_PLX: w |= MEMO_X|MEMO_NZ; break;
+    case OP_PLY: w |= MEMO_Y|MEMO_NZ; break;
+    case OP_PLP: w |= MEMO_P; break;
+    case OP_CLC: case OP_SEC: w |= FLAGS_CARRY; break;
+    case OP_CLI: case OP_SEI: w |= FLAGS_INTERRUPT; break;
+    case OP_CLD: case OP_SED: w |= FLAGS_DECIMAL; break;
+    case OP_CLV: w |= FLAGS_OVERFLOW; break;
+    case OP_BPL: case OP_BMI: r |= FLAGS_NEGATIVE; break;
+    case OP_BVC: case OP_BVS: r |= FLAGS_OVERFLOW; break;
+    case OP_BCC: case OP_BCS: r |= FLAGS_CARRY; break;
+    case OP_BNE: case OP_BEQ: r |= FLAGS_ZERO; break;
+    case OP_TRB: case OP_TSB: r |= MEMO_A, w |= FLAGS_ZERO; break;
+    case OP_JSR: case OP_RTS: case OP_JMP: case OP_NOP: case OP_BRA:
+    case OP_BBR: case OP_BBS: case OP_RMB: case OP_SMB: case OP_STZ:
+        break;
+    default:
+        return -1;
+    }
+    *rd = r;
+    *wr = w;
+    return 0;
+}
+
+static int memo_is_stack_op(enum instr_type type) {
+    switch(type) {
+    case OP_JSR: case OP_RTS: case OP_PHA: case OP_PHX: case OP_PHY:
+    case OP_PHP: case OP_PLA: case OP_PLX: case OP_PLY: case OP_PLP:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void memo_touch(memo_level_t *l, uint16_t addr, int write, int stack) {
+    if(l->gen[addr] != l->stamp) {
+        l->gen[addr] = l->stamp;
+        l->state[addr] = 0;
+        if(l->n_touched == MEMO_MAX_BYTES) {
+            l->overflow = 1;
+            return;
+        }
+        l->touched[l->n_touched++] = addr;
+    }
+    if(write) l->state[addr] |= TOUCH_WRITTEN;
+    else if(!l->state[addr]) {
+        l->state[addr] = TOUCH_IN;
+        (void)memory_peek(addr, &l->val[addr]);
+    }
+    if(addr>>8 == 0x01 && !stack) l->s_abs = 1;
+}
+
+/* From the trace hook of memory.c while recording, plain when addr is RAM
+ * or ROM that doesn't decode writes. */
+void memo_access(uint16_t addr, int write, int plain) {
+    unsigned i;
+    if(!plain) {
+        rec.impure = rec.abort = 1;
+        return;
+    }
+    for(i = 0; i < rec.depth; ++i)
+        memo_touch(rec.levels[i], addr, write, rec.stack_op);
+}
+
+static uint16_t memo_addr(const memo_byte_t *b) {
+    return b->stack ? 0x100 | (uint8_t)(reg.s + b->addr) : b->addr;
+}
+
+static uint32_t memo_key(unsigned sig, uint16_t mask, const cpu_reg_t *in,
+                         const uint8_t *vals, unsigned n) {
+    uint32_t h = 2166136261u ^ sig;
+    unsigned i;
+#define MEMO_HASH(b) (h = (h ^ (uint8_t)(b)) * 16777619u)
+    MEMO_HASH(mask & MEMO_A ? in->a : 0);
+    MEMO_HASH(mask & MEMO_X ? in->x : 0);
+    MEMO_HASH(mask & MEMO_Y ? in->y : 0);
+    MEMO_HASH(mask & MEMO_S ? in->s : 0);
+    MEMO_HASH(in->p & mask);
+    for(i = 0; i < n; ++i) MEMO_HASH(vals[i]);
+#undef MEMO_HASH
+    return h;
+}
+
+/* A call made with the same inputs as now. The values at the reads of each
+ * signature are hashed together with the registers it needs and looked up,
+ * so a lookup costs a pass over the bytes a call reads per signature and
+ * not one per call kept. */
+static memo_entry_t *memo_match(const memo_routine_t *r) {
+    uint8_t vals[MEMO_MAX_BYTES];
+    unsigned s, i;
+
+    for(s = 0; s < r->n_sigs; ++s) {
+        const memo_sig_t *sig = &r->sigs[s];
+        uint16_t mask = sig->in_mask;
+        memo_entry_t *e;
+        uint32_t h;
+
+        for(i = 0; i < sig->n_reads; ++i)
+            if(!memory_peek(memo_addr(&sig->reads[i]), &vals[i])) break;
+        if(i < sig->n_reads) continue;
+        h = memo_key(s, mask, &reg, vals, sig->n_reads);
+        for(e = r->buckets[h % MEMO_BUCKETS]; e; e = e->next)
+            if(e->hash == h && e->sig == s
+               && !((mask & MEMO_A && reg.a != e->in.a)
+                    || (mask & MEMO_X && reg.x != e->in.x)
+                    || (mask & MEMO_Y && reg.y != e->in.y)
+                    || (mask & MEMO_S && reg.s != e->in.s)
+                    || (reg.p ^ e->in.p) & mask & MEMO_P)
+               && !memcmp(e->in_vals, vals, sig->n_reads))
+                return e;
+    }
+    return NULL;
+}
+
+/* Replay a call up to its RTS. While recording, its inputs and effects
+ * become those of the calls around it. */
+static void memo_apply(machine_t *m, const memo_routine_t *r,
+                       const memo_entry_t *e) {
+    const memo_sig_t *sig = &r->sigs[e->sig];
+    unsigned i, l;
+
+    for(l = 0; l < rec.depth && m->memo_rec; ++l) {
+        memo_level_t *level = rec.levels[l];
+        level->in |= sig->in_mask & ~level->wr;
+        if(sig->in_mask & MEMO_S) level->s_abs = 1;
+        for(i = 0; i < sig->n_reads; ++i)
+            memo_touch(level, memo_addr(&sig->reads[i]), 0,
+                       sig->reads[i].stack);
+    }
+    for(i = 0; i < e->n_writes; ++i) {
+        rec.stack_op = e->writes[i].stack;
+        memory_write(memo_addr(&e->writes[i]), e->writes[i].val);
+    }
+    for(l = 0; l < rec.depth && m->memo_rec; ++l)
+        rec.levels[l]->wr |= e->out_mask;
+
+    if(e->out_mask & MEMO_A) reg.a = e->out.a;
+    if(e->out_mask & MEMO_X) reg.x = e->out.x;
+    if(e->out_mask & MEMO_Y) reg.y = e->out.y;
+    reg.p = (reg.p & ~e->out_mask) | (e->out.p & e->out_mask & MEMO_P);
+    m->cycles += e->cycles;
+    STAT_ADD(cycles, e->cycles);
+}
+
+static void memo_push(machine_t *m, memo_routine_t *r) {
+    memo_level_t *l;
+    if(rec.depth == MEMO_MAX_DEPTH) return;
+    if(!(l = rec.levels[rec.depth])
+       && !(l = rec.levels[rec.depth] = calloc(1, sizeof *l)))
+        die("[Error] Out of memory\n");
+    rec.depth++;
+    if(!++l->stamp) {
+        (void)memset(l->gen, 0, sizeof l->gen);
+        l->stamp = 1;
+    }
+    l->routine = r;
+    l->entry = reg;
+    l->cycles = m->cycles;
+    l->in = l->wr = 0;
+    l->s_abs = l->overflow = 0;
+    l->n_touched = 0;
+}
+
+/* the signature of a call, added if it is new, -1 if there is no room */
+static int memo_sig(memo_routine_t *r, uint16_t in_mask,
+                    const memo_byte_t *reads, unsigned n_reads) {
+    memo_sig_t *sig;
+    unsigned s, i;
+
+    for(s = 0; s < r->n_sigs; ++s) {
+        sig = &r->sigs[s];
+        if(sig->in_mask != in_mask || sig->n_reads != n_reads) continue;
+        for(i = 0; i < n_reads; ++i)
+            if(sig->reads[i].addr != reads[i].addr
+               || sig->reads[i].stack != reads[i].stack) break;
+        if(i == n_reads) return s;
+    }
+    if(r->n_sigs == MEMO_SIGS) return -1;
+    sig = &r->sigs[r->n_sigs];
+    if(!(sig->reads = malloc(n_reads * sizeof *reads)) && n_reads)
+        die("[Error] Out of memory\n");
+    (void)memcpy(sig->reads, reads, n_reads * sizeof *reads);
+    sig->n_reads = n_reads;
+    sig->in_mask = in_mask;
+    return r->n_sigs++;
+}
+
+/* keep the call of the innermost level, now at its RTS */
+static void memo_finish(machine_t *m, memo_level_t *l) {
+    static __thread memo_byte_t reads[MEMO_MAX_BYTES], writes[MEMO_MAX_BYTES];
+    static __thread uint8_t vals[MEMO_MAX_BYTES];
+    memo_routine_t *r = l->routine;
+    unsigned i, n_reads = 0, n_writes = 0;
+    memo_entry_t *e, **p;
+    uint16_t in_mask;
+    int sig;
+
+    if(l->overflow) return;
+    for(i = 0; i < l->n_touched; ++i) {
+        uint16_t addr = l->touched[i];
+        memo_byte_t b;
+        b.stack = addr>>8 == 0x01 && !l->s_abs;
+        b.addr = b.stack ? (uint8_t)(addr - l->entry.s) : addr;
+        if(l->state[addr] & TOUCH_IN) {
+            b.val = 0;
+            vals[n_reads] = l->val[addr];
+            reads[n_reads++] = b;
+        }
+        if(l->state[addr] & TOUCH_WRITTEN) {
+            (void)memory_peek(addr, &b.val);
+            writes[n_writes++] = b;
+        }
+    }
+    in_mask = l->in | (l->s_abs ? MEMO_S : 0);
+    if((sig = memo_sig(r, in_mask, reads, n_reads)) < 0) return;
+
+    if(!r->entries
+       && !(r->entries = calloc(MEMO_ENTRIES, sizeof *r->entries)))
+        die("[Error] Out of memory\n");
+    e = &r->entries[r->next];
+    r->next = (r->next + 1) % MEMO_ENTRIES;
+    if(r->n_entries < MEMO_ENTRIES) r->n_entries++;
+    else {
+        for(p = &r->buckets[e->hash % MEMO_BUCKETS]; *p != e; p = &(*p)->next);
+        *p = e->next;
+        free(e->writes);
+    }
+    if(!(e->writes = malloc(n_writes * sizeof *writes + n_reads))
+       && n_writes + n_reads)
+        die("[Error] Out of memory\n");
+    (void)memcpy(e->writes, writes, n_writes * sizeof *writes);
+    e->n_writes = n_writes;
+    e->in_vals = (uint8_t *)(e->writes + n_writes);
+    (void)memcpy(e->in_vals, vals, n_reads);
+    e->sig = sig;
+    e->in = l->entry;
+    e->out_mask = l->wr & ~MEMO_S;
+    e->out = reg;
+    e->cycles = (uint32_t)(m->cycles - l->cycles);
+    e->hash = memo_key(sig, in_mask, &e->in, vals, n_reads);
+    p = &r->buckets[e->hash % MEMO_BUCKETS];
+    e->next = *p;
+    *p = e;
+}
+
+static memo_routine_t *memo_find(const memo_t *memo, uint16_t pc) {
+    unsigned i;
+    for(i = 0; i < memo->n_routines; ++i)
+        if(memo->routines[i]->pc == pc) return memo->routines[i];
+    return NULL;
+}
+
+/* One instruction of a recording. Returns 0 to go on, 1 when the outermost
+ * call reached its RTS and -1 to give up. */
+static int memo_step(machine_t *m) {
+    memo_routine_t *r;
+    memo_entry_t *e;
+    const instr_t *in;
+    uint16_t rd, wr;
+    uint8_t opcode;
+    unsigned l;
+
+    if(m->cycles >= m->next_event) memory_sync_due();
+    if(!memory_peek(reg.pc, &opcode)) return -1;
+    if(rec.depth) {
+        memo_level_t *top = rec.levels[rec.depth-1];
+        /* left the call some other way than its RTS */
+        if(reg.s > top->entry.s) return -1;
+        if(opcode == 0x60 && reg.s == top->entry.s) {
+            memo_finish(m, top);
+            if(!--rec.depth) return 1;
+        }
+    }
+
+    rec.stack_op = 0;
+    if(opcode == HLE_OPCODE && (r = memo_find(m->memo, reg.pc))) {
+        /* the recorded call itself when nothing is recorded yet */
+        if(rec.depth && !r->impure && (e = memo_match(r))) {
+            r->hits++;
+            STAT_INC(memo_hits);
+            memo_apply(m, r, e);
+            opcode = 0x60;
+        } else {
+            if(rec.depth) {
+                r->misses++;
+                STAT_INC(memo_misses);
+            }
+            if(!r->impure) memo_push(m, r);
+            reg.pc++;
+            opcode = r->opcode;
+        }
+    } else opcode = memory_read(reg.pc++);
+
+    in = &m->variant->table[opcode];
+    if(memo_regs(in, &rd, &wr)) {
+        rec.impure = 1;
+        return -1;
+    }
+    for(l = 0; l < rec.depth; ++l)
+        rec.levels[l]->in |= rd & ~rec.levels[l]->wr;
+    rec.stack_op = memo_is_stack_op(in->type);
+    cpu_exec(opcode);
+    for(l = 0; l < rec.depth; ++l)
+        rec.levels[l]->wr |= wr;
+
+    if(cpu_halt) rec.impure = rec.abort = 1;
+    if(++rec.steps == MEMO_MAX_STEPS) rec.impure = rec.abort = 1;
+    return rec.abort ? -1 : 0;
+}
+
+/* run a call of the routine at pc and record it and the calls it makes */
+static int memo_record(machine_t *m) {
+    unsigned l;
+    int ret;
+
+    rec.depth = 0;
+    rec.abort = rec.impure = 0;
+    rec.steps = 0;
+    m->memo_rec = &rec;
+    memory_init();
+    while(!(ret = memo_step(m)));
+    if(ret < 0 && rec.impure)
+        for(l = 0; l < rec.depth; ++l) rec.levels[l]->routine->impure = 1;
+    rec.depth = 0;
+    rec.stack_op = 0;
+    m->memo_rec = NULL;
+    memory_init();
+    return ret;
+}
+
+static int memo_trap(void *user) {
+    machine_t *m = current_machine;
+    memo_routine_t *r = user;
+    memo_entry_t *e;
+
+    if(m->flags & MACHINE_BUS_ACCURATE || m->cover || m->heat) return 1;
+    /* the trap itself takes no time */
+    m->cycles -= m->variant->cycles[HLE_OPCODE];
+    STAT_ADD(cycles, -(uint64_t)m->variant->cycles[HLE_OPCODE]);
+    if(r->impure || m->memo_rec) return 1;
+    if((e = memo_match(r))) {
+        r->hits++;
+        STAT_INC(memo_hits);
+        memo_apply(m, r, e);
+        return 0;
+    }
+    r->misses++;
+    STAT_INC(memo_misses);
+    if(r->misses >= MEMO_MAX_MISSES && r->hits < r->misses) {
+        r->impure = 1;
+        return 1;
+    }
+    reg.pc--;
+    return memo_record(m) > 0 ? 0 : -1;
+}
+
+/* Memoize the routine at pc in the current machine, which has to be in
+ * RAM or PRG that is mapped already. Returns 0 or -1. */
+int memo_add(uint16_t pc) {
+    machine_t *m = current_machine;
+    memo_routine_t *r, **list;
+    uint8_t opcode;
+
+    if(m->memo && memo_find(m->memo, pc)) return 0;
+    if(!memory_peek(pc, &opcode) || opcode == HLE_OPCODE) return -1;
+    if(!m->memo) {
+        if(!(m->memo = calloc(1, sizeof *m->memo)))
+            die("[Error] Out of memory\n");
+        m->memo->refs = 1;
+    }
+    if(!(r = calloc(1, sizeof *r))) die("[Error] Out of memory\n");
+    r->pc = pc;
+    r->opcode = opcode;
+    if(hle_add(pc, memo_trap, r)) {
+        free(r);
+        return -1;
+    }
+    if(!(list = realloc(m->memo->routines,
+                        (m->memo->n_routines+1) * sizeof *list)))
+        die("[Error] Out of memory\n");
+    m->memo->routines = list;
+    list[m->memo->n_routines++] = r;
+    return 0;
+}
+
+/* memoize what the code calls */
+static int memo_scan_call(void *data, uint16_t pc, const instr_t *in,
+                          unsigned len, uint16_t target) {
+    (void)data, (void)pc, (void)len;
+    if(in->type == OP_JSR) (void)memo_add(target);
+    return 0;
+}
+
+/* memoize the JSR targets found following the code from the vectors */
+static void memo_scan(void) {
+    static uint8_t seen[0x2000];
+    const flow_walker_t w = {memory_peek, seen, memo_scan_call, NULL};
+    unsigned i;
+
+    (void)memset(seen, 0, sizeof seen);
+    for(i = 0xfffa; i < 0x10000; i += 2) {
+        uint8_t l, h;
+        if(memory_peek(i, &l) && memory_peek(i+1, &h))
+            flow_follow(&w, l | h<<8);
+    }
+}
+
+/* Lines of "addr" with # starting a comment, or with no file every
+ * routine called from code reachable from the vectors. */
+int memo_load(const char *path) {
+    char line[256];
+    unsigned lineno = 0;
+    FILE *f;
+    int ret = 0;
+
+    if(!path) {
+        memo_scan();
+        return 0;
+    }
+    if(!(f = fopen(path, "r"))) {
+        perror(path);
+        return -1;
+    }
+    while(!ret && fgets(line, sizeof line, f)) {
+        char *s = line, *end;
+        unsigned long pc;
+
+        ++lineno;
+        if((end = strchr(s, '#'))) *end = '\0';
+        s += strspn(s, " \t\r\n");
+        if(!*s) continue;
+
+        pc = *s == '$' ? strtoul(s+1, &end, 16) : strtoul(s, &end, 0);
+        if(end == s || pc > 0xffff || end[strspn(end, " \t\r\n")]) {
+            fprintf(stderr, "[Error] %s:%u: expected 'addr'\n", path, lineno);
+            ret = -1;
+        } else if(memo_add(pc)) {
+            fprintf(stderr, "[Error] %s:%u: $%04lx isn't RAM or ROM or is "
+                    "trapped already\n", path, lineno, pc);
+            ret = -1;
+        }
+    }
+    (void)fclose(f);
+    return ret;
+}
+
+/* machine copies on other threads share it, like ROM images */
+memo_t *memo_ref(memo_t *memo) {
+    if(memo) __atomic_add_fetch(&memo->refs, 1, __ATOMIC_RELAXED);
+    return memo;
+}
+
+void memo_unref(memo_t *memo) {
+    unsigned i, j;
+    if(!memo || __atomic_sub_fetch(&memo->refs, 1, __ATOMIC_ACQ_REL)) return;
+    for(i = 0; i < memo->n_routines; ++i) {
+        memo_routine_t *r = memo->routines[i];
+        for(j = 0; j < r->n_entries; ++j) free(r->entries[j].writes);
+        for(j = 0; j < r->n_sigs; ++j) free(r->sigs[j].reads);
+        free(r->entries);
+        free(r);
+    }
+    free(memo->routines);
+    free(memo);
+}
+
+void memo_report(FILE *f) {
+    const memo_t *memo = current_machine->memo;
+    unsigned i;
+    if(!memo) return;
+    fprintf(f, "Memoized routines:\n");
+    for(i = 0; i < memo->n_routines; ++i) {
+        const memo_routine_t *r = memo->routines[i];
+        fprintf(f, "  $%04x %10llu hits %10llu misses %3u calls kept%s\n",
+                r->pc, (unsigned long long)r->hits,
+                (unsigned long long)r->misses, r->n_entries,
+                r->impure ? "  given up" : "");
+    }
+}
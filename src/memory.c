@@ -1,15 +1,31 @@
+#define _GNU_SOURCE
 #include <emu6502/memory.h>
+#include <emu6502/machine.h>
+#include <emu6502/rom.h>
+#include <emu6502/mapper.h>
+#include <emu6502/stats.h>
+#include <emu6502/cover.h>
+#include <emu6502/heat.h>
+#include <emu6502/memo.h>
+#include <emu6502/utils.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <endianness.h>
 
 #define MIN(a, b) ((a)<(b)?(a):(b))
+#define MAX(a, b) ((a)>(b)?(a):(b))
 
-static uint8_t emu_ram[0x800] = {0};
-static uint8_t emu_prg_rom[0xbfe0] = {0};
+#define PRG_START 0x4020
 
-static const memory_map_entry_t *memory_map[0x1000] = {0};
+/* accesses go through memory_trace() */
+#define MEMORY_TRACING(m) ((m)->cover || (m)->heat || (m)->memo_rec)
 
-static uint8_t data_bus = 0;
+/* backing for PRG pages no image covers */
+static const uint8_t zero_page[0x100] = {0};
+
+static const memory_map_entry_t *default_map[0x1000] = {0};
+static int default_map_ready = 0;
 
 static void memory_ram_read(uint8_t *, uint16_t);
 static void memory_ram_write(uint8_t *, uint16_t);
@@ -19,69 +35,413 @@ static void memory_prg_rom_read(uint8_t *, uint16_t);
 static void memory_prg_rom_write(uint8_t *, uint16_t);
 static const memory_map_entry_t memory_prg_rom_entry;
 
+static uint8_t *memory_page_private(machine_t *, uint8_t);
+static void memory_page_update(machine_t *, uint8_t);
+
 static void memory_ram_read(uint8_t *bus, uint16_t addr) {
-    *bus = emu_ram[addr&0x7ff];
+    *bus = current_machine->page_data[addr>>8][addr&0xff];
 }
 
 static void memory_ram_write(uint8_t *bus, uint16_t addr) {
-    emu_ram[addr&0x7ff] = *bus;
+    current_machine->page_data[addr>>8][addr&0xff] = *bus;
 }
 
 static const memory_map_entry_t memory_ram_entry = {
     .read = memory_ram_read,
     .write = memory_ram_write,
+    .name = "ram",
 };
 
 static void memory_prg_rom_read(uint8_t *bus, uint16_t addr) {
-    *bus = emu_prg_rom[(addr-0x4020)];
+    *bus = current_machine->page_data[addr>>8][addr&0xff];
 }
 
+/* writes to shared ROM pages get a private copy of the page first, unless
+ * the cartridge takes them as register writes */
 static void memory_prg_rom_write(uint8_t *bus, uint16_t addr) {
-    emu_prg_rom[(addr-0x4020)] = *bus;
+    machine_t *m = current_machine;
+    uint8_t *page;
+    if(m->cart && cartridge_write(m->cart, addr, *bus)) return;
+    if(m->page_flags[addr>>8] & PAGE_READONLY) return;
+    if(!(page = memory_page_private(m, addr>>8))) return;
+    page[addr&0xff] = *bus;
 }
 
 static const memory_map_entry_t memory_prg_rom_entry = {
     .read = memory_prg_rom_read,
     .write = memory_prg_rom_write,
+    .name = "prg",
 };
 
-inline void memory_map_page(const memory_map_entry_t *const entry, uint16_t page) {
-    memory_map[page>>4] = entry;
+static uint8_t *memory_page_private(machine_t *m, uint8_t page) {
+    uint8_t *data;
+    if(m->page_flags[page] & PAGE_PRIVATE) return m->page_data[page];
+    if(m->flat) {
+        data = m->flat_prg + (page<<8);
+        m->page_flags[page] |= PAGE_PRIVATE;
+    } else if(!(data = malloc(0x100))) return NULL;
+    else m->page_flags[page] |= PAGE_PRIVATE|PAGE_ALLOC;
+    (void)memcpy(data, m->page_data[page], 0x100);
+    m->page_data[page] = data;
+    memory_page_update(m, page);
+    return data;
 }
 
-void memory_init(void) {
-    memset(memory_map, 0, sizeof memory_map);
+static void memory_page_release(machine_t *m, uint8_t page) {
+    if(m->page_flags[page] & PAGE_ALLOC) free(m->page_data[page]);
+    m->page_flags[page] &= ~(PAGE_PRIVATE|PAGE_ALLOC);
+}
+
+/* Point a PRG page at src. With a flat view the page has to live in it, so
+ * the contents are copied there instead. */
+static void memory_page_set(machine_t *m, uint8_t page, const uint8_t *src) {
+    uint8_t *data = (uint8_t *)src;
+    if(m->flat) {
+        data = m->flat_prg + (page<<8);
+        if(data != src) (void)memmove(data, src, 0x100);
+    }
+    memory_page_release(m, page);
+    m->page_data[page] = data;
+    if(m->flat) m->page_flags[page] |= PAGE_PRIVATE;
+}
+
+/* a page is accessed directly when the whole of it is plain memory */
+static void memory_page_update(machine_t *m, uint8_t page) {
+    unsigned i;
+    uint8_t flags = m->page_flags[page]
+        & ~(PAGE_READ|PAGE_WRITE|PAGE_TRACE_READ|PAGE_TRACE_WRITE);
+    for(i = 0; i < 0x10; ++i) {
+        const memory_map_entry_t *entry = m->map[page<<4 | i];
+        if(entry != &memory_ram_entry && entry != &memory_prg_rom_entry)
+            break;
+    }
+    if(i == 0x10 && m->page_data[page]) {
+        flags |= PAGE_READ;
+        if((flags & (PAGE_PRIVATE|PAGE_READONLY)) == PAGE_PRIVATE)
+            flags |= PAGE_WRITE;
+    }
+    /* tracing sees accesses off the fast path */
+    if(MEMORY_TRACING(m)) {
+        if(flags & PAGE_READ) flags ^= PAGE_READ|PAGE_TRACE_READ;
+        if(flags & PAGE_WRITE) flags ^= PAGE_WRITE|PAGE_TRACE_WRITE;
+    }
+    m->page_flags[page] = flags;
+}
+
+static void memory_default_map_init(void) {
     uint32_t page;
+    if(default_map_ready) return;
     for(page = 0x0; page < 0x2000; page += 0x10)
-        memory_map_page(&memory_ram_entry, page);
-    for(page = 0x4020; page < 0x10000; page += 0x10)
-        memory_map_page(&memory_prg_rom_entry, page);
+        default_map[page>>4] = &memory_ram_entry;
+    for(page = PRG_START; page < 0x10000; page += 0x10)
+        default_map[page>>4] = &memory_prg_rom_entry;
+    default_map_ready = 1;
+}
+
+void memory_machine_init(machine_t *m) {
+    unsigned page;
+    memory_default_map_init();
+    m->map = default_map;
+    m->lazy = NULL;
+    m->n_lazy = 0;
+    m->next_event = UINT64_MAX;
+    for(page = 0x00; page < 0x20; ++page) {
+        m->page_data[page] = m->ram + ((page&0x7)<<8);
+        m->page_flags[page] = PAGE_PRIVATE;
+    }
+    for(page = PRG_START>>8; page < 0x100; ++page)
+        m->page_data[page] = (uint8_t *)zero_page;
+    for(page = 0x00; page < 0x100; ++page)
+        memory_page_update(m, page);
+}
+
+static void memory_lazy_clear(machine_t *m) {
+    while(m->n_lazy) {
+        memory_device_t *dev = m->lazy[--m->n_lazy];
+        dev->free(dev);
+    }
+}
+
+void memory_machine_release(machine_t *m) {
+    unsigned page;
+    for(page = 0x00; page < 0x100; ++page)
+        memory_page_release(m, page);
+    if(m->map != default_map) free(m->map);
+    memory_lazy_clear(m);
+    free(m->lazy);
+    free(m->xram);
+    if(m->flat) {
+        (void)munmap(m->flat, 0x10000);
+        (void)munmap(m->flat_prg, 0x10000);
+    }
+    while(m->n_roms) rom_image_unref(m->roms[--m->n_roms]);
+    free(m->roms);
+}
+
+/* Give dst, which holds nothing yet, the memory of src. Shared pages stay
+ * shared, private ones and the state of lazy devices are copied. */
+int memory_machine_copy(machine_t *dst, const machine_t *src) {
+    unsigned page, i;
+    if(src->flat) return -1;
+
+    (void)memcpy(dst->ram, src->ram, sizeof dst->ram);
+    (void)memcpy(dst->page_flags, src->page_flags, sizeof dst->page_flags);
+    dst->xram = NULL;
+    if(src->xram) {
+        if(!(dst->xram = malloc(0x10000))) die("[Error] Out of memory\n");
+        (void)memcpy(dst->xram, src->xram, 0x10000);
+    }
+    for(page = 0x00; page < 0x100; ++page) {
+        uint8_t *data = src->page_data[page];
+        if(data >= src->ram && data < src->ram + sizeof src->ram)
+            data = dst->ram + (data - src->ram);
+        else if(src->xram && data >= src->xram && data < src->xram + 0x10000)
+            data = dst->xram + (data - src->xram);
+        else if(src->page_flags[page] & PAGE_ALLOC) {
+            if(!(data = malloc(0x100))) die("[Error] Out of memory\n");
+            (void)memcpy(data, src->page_data[page], 0x100);
+        }
+        dst->page_data[page] = data;
+    }
+
+    dst->map = default_map;
+    if(src->map != default_map) {
+        const memory_map_entry_t **map = malloc(sizeof default_map);
+        if(!map) die("[Error] Out of memory\n");
+        dst->map = memcpy(map, src->map, sizeof default_map);
+    }
+
+    if(!(dst->lazy = malloc(src->n_lazy * sizeof *dst->lazy)) && src->n_lazy)
+        die("[Error] Out of memory\n");
+    for(i = 0; i < src->n_lazy; ++i) {
+        dst->lazy[i] = src->lazy[i]->copy(src->lazy[i]);
+        dst->lazy[i]->entry = src->lazy[i]->entry;
+    }
+
+    dst->n_roms = 0;
+    if(!(dst->roms = malloc(src->n_roms * sizeof *dst->roms)) && src->n_roms)
+        die("[Error] Out of memory\n");
+    for(i = 0; i < src->n_roms; ++i)
+        dst->roms[dst->n_roms++] = rom_image_ref(src->roms[i]);
+    return 0;
+}
+
+/* Whether m has writable pages it shares with something else, windows
+ * from memory_map_shared(), which a copy would see change under it. */
+int memory_machine_shared(const machine_t *m) {
+    unsigned page;
+    for(page = 0x00; page < 0x100; ++page) {
+        const uint8_t *data = m->page_data[page];
+        if((m->page_flags[page] & (PAGE_PRIVATE|PAGE_ALLOC)) != PAGE_PRIVATE)
+            continue;
+        if(data >= m->ram && data < m->ram + sizeof m->ram) continue;
+        if(m->xram && data >= m->xram && data < m->xram + 0x10000) continue;
+        if(m->flat) continue;
+        return 1;
+    }
+    return 0;
+}
+
+static void memory_hold_rom(machine_t *m, rom_image_t *img) {
+    rom_image_t **roms;
+    unsigned i;
+    for(i = 0; i < m->n_roms; ++i)
+        if(m->roms[i] == img) return;
+    if(!(roms = realloc(m->roms, (m->n_roms+1) * sizeof *roms)))
+        die("[Error] Out of memory\n");
+    m->roms = roms;
+    m->roms[m->n_roms++] = rom_image_ref(img);
+}
+
+/* Set an entry of the layout every machine starts out with. Meant for
+ * devices every machine has, so that they don't each need a private copy
+ * of the map. */
+void memory_map_default_page(const memory_map_entry_t *const entry,
+                             uint16_t page) {
+    memory_default_map_init();
+    if(default_map[page>>4] != entry) default_map[page>>4] = entry;
+}
+
+/* earliest event of the machine's lazy devices */
+static void memory_reschedule(machine_t *m) {
+    uint64_t next = UINT64_MAX;
+    unsigned i;
+    for(i = 0; i < m->n_lazy; ++i)
+        next = MIN(next, m->lazy[i]->next_event);
+    m->next_event = next;
+}
+
+static memory_device_t *memory_device_find(const machine_t *m,
+                                           const memory_map_entry_t *entry) {
+    unsigned i;
+    for(i = 0; i < m->n_lazy; ++i)
+        if(m->lazy[i]->entry == entry) return m->lazy[i];
+    return NULL;
+}
+
+/* The entry of the first lazy device that differs between a and b, in
+ * its state, its timing or by being in only one of them. NULL if they all
+ * agree. */
+const memory_map_entry_t *memory_device_diff(const machine_t *a,
+                                             const machine_t *b) {
+    unsigned i;
+    for(i = 0; i < a->n_lazy; ++i) {
+        const memory_device_t *da = a->lazy[i];
+        const memory_device_t *db = memory_device_find(b, da->entry);
+        if(!db || da->synced != db->synced
+           || da->next_event != db->next_event || da->diff(da, db))
+            return da->entry;
+    }
+    for(i = 0; i < b->n_lazy; ++i)
+        if(!memory_device_find(a, b->lazy[i]->entry))
+            return b->lazy[i]->entry;
+    return NULL;
+}
+
+/* the state of a device mapped into the current machine with
+ * memory_map_page(), for its read and write callbacks */
+memory_device_t *memory_device(const memory_map_entry_t *entry) {
+    return memory_device_find(current_machine, entry);
+}
+
+/* the first time the entry is mapped into m, make its state */
+static void memory_lazy_add(machine_t *m, const memory_map_entry_t *entry) {
+    memory_device_t **lazy, *dev;
+    if(memory_device_find(m, entry)) return;
+    if(!(lazy = realloc(m->lazy, (m->n_lazy+1) * sizeof *lazy)))
+        die("[Error] Out of memory\n");
+    m->lazy = lazy;
+    dev = entry->lazy();
+    dev->entry = entry;
+    dev->synced = m->cycles;
+    m->lazy[m->n_lazy++] = dev;
+    memory_reschedule(m);
+}
+
+static void memory_device_sync(machine_t *m, memory_device_t *dev) {
+    if(!dev || dev->synced >= m->cycles) return;
+    STAT_INC(device_syncs);
+    dev->catch_up(dev, m->cycles);
+    dev->synced = m->cycles;
+    memory_reschedule(m);
+}
+
+/* Lazy devices only get state and events through maps of their own
+ * machine, the default map has no machine to keep them in. */
+void memory_map_page(const memory_map_entry_t *const entry, uint16_t page) {
+    machine_t *m = current_machine;
+    if(m->map[page>>4] == entry) return;
+    if(entry && entry->lazy) memory_lazy_add(m, entry);
+    if(m->map == default_map) {
+        const memory_map_entry_t **map = malloc(sizeof default_map);
+        if(!map) die("[Error] Out of memory\n");
+        m->map = memcpy(map, default_map, sizeof default_map);
+    }
+    m->map[page>>4] = entry;
+    memory_page_update(m, page>>8);
+}
+
+static void memory_trace(machine_t *m, uint16_t addr, int write) {
+    if(m->cover) COVER_SET(write ? m->cover->write : m->cover->read, addr);
+    if(m->heat) heat_access(m->heat, addr, write);
+    if(m->memo_rec) {
+        const memory_map_entry_t *entry = m->map[addr>>4];
+        /* cartridges take PRG writes as register writes */
+        memo_access(addr, write, entry == &memory_ram_entry
+                    || (entry == &memory_prg_rom_entry && !(write && m->cart)));
+    }
+}
+
+/* on reset, devices mapped into the machine stay where they are */
+void memory_init(void) {
+    machine_t *m = current_machine;
+    unsigned page;
+    for(page = 0x00; page < 0x100; ++page)
+        memory_page_update(m, page);
 }
 
 uint8_t memory_read(uint16_t addr) {
-    const memory_map_entry_t *entry = memory_map[addr>>4];
-    if(entry && entry->read) entry->read(&data_bus, addr);
+    machine_t *m = current_machine;
+    const memory_map_entry_t *entry;
+    STAT_INC(reads);
+    if(m->page_flags[addr>>8] & PAGE_READ)
+        return m->data_bus = m->page_data[addr>>8][addr&0xff];
+    if(MEMORY_TRACING(m)) {
+        memory_trace(m, addr, 0);
+        if(m->page_flags[addr>>8] & PAGE_TRACE_READ)
+            return m->data_bus = m->page_data[addr>>8][addr&0xff];
+    }
+    STAT_INC(device_reads[addr>>4]);
+    entry = m->map[addr>>4];
+    if(entry && entry->lazy)
+        memory_device_sync(m, memory_device_find(m, entry));
+    if(entry && entry->read) entry->read(&m->data_bus, addr);
     /* else open bus */
-    return data_bus;
+    return m->data_bus;
+}
+
+/* read without touching the bus, only from plain RAM and ROM */
+int memory_peek(uint16_t addr, uint8_t *out) {
+    machine_t *m = current_machine;
+    const memory_map_entry_t *entry = m->map[addr>>4];
+    if(entry != &memory_ram_entry && entry != &memory_prg_rom_entry)
+        return 0;
+    *out = m->page_data[addr>>8][addr&0xff];
+    return 1;
+}
+
+/* like memory_peek(), only from PRG */
+int memory_peek_prg(uint16_t addr, uint8_t *out) {
+    machine_t *m = current_machine;
+    if(m->map[addr>>4] != &memory_prg_rom_entry) return 0;
+    *out = m->page_data[addr>>8][addr&0xff];
+    return 1;
 }
 
 uint16_t memory_read_w(uint16_t addr) {
-    union {
-        uint16_t w;
-        struct {
-            uint8_t l;
-            uint8_t h;
-        };
-    } out;
-    out.l = memory_read(addr);
-    out.h = memory_read(addr+1);
-    return end_le16toh(out.w);
+    machine_t *m = current_machine;
+    /* both bytes from the same plain page */
+    if((addr&0xff) != 0xff && m->page_flags[addr>>8] & PAGE_READ) {
+        const uint8_t *p = m->page_data[addr>>8] + (addr&0xff);
+        STAT_ADD(reads, 2);
+        m->data_bus = p[1];
+        return p[0] | p[1]<<8;
+    }
+    return memory_read(addr) | memory_read(addr+1)<<8;
+}
+
+/* pointer in zero page, $ff wraps around to $00 */
+uint16_t memory_read_zp_w(uint8_t addr) {
+    return memory_read(addr) | memory_read((uint8_t)(addr+1))<<8;
+}
+
+/* word whose high byte comes from the same page, like NMOS JMP (a) */
+uint16_t memory_read_w_page(uint16_t addr) {
+    return memory_read(addr)
+        | memory_read((addr&0xff00) | (uint8_t)(addr+1))<<8;
 }
 
 void memory_write(uint16_t addr, uint8_t val) {
-    const memory_map_entry_t *entry = memory_map[addr>>4];
-    data_bus = val;
-    if(entry && entry->write) entry->write(&data_bus, addr);
+    machine_t *m = current_machine;
+    const memory_map_entry_t *entry;
+    m->data_bus = val;
+    STAT_INC(writes);
+    if(m->page_flags[addr>>8] & PAGE_WRITE) {
+        m->page_data[addr>>8][addr&0xff] = val;
+        return;
+    }
+    if(MEMORY_TRACING(m)) {
+        memory_trace(m, addr, 1);
+        if(m->page_flags[addr>>8] & PAGE_TRACE_WRITE) {
+            m->page_data[addr>>8][addr&0xff] = val;
+            return;
+        }
+    }
+    STAT_INC(device_writes[addr>>4]);
+    entry = m->map[addr>>4];
+    if(entry && entry->lazy)
+        memory_device_sync(m, memory_device_find(m, entry));
+    if(entry && entry->write) entry->write(&m->data_bus, addr);
 }
 
 void memory_write_w(uint16_t addr, uint16_t val) {
@@ -97,13 +457,264 @@ void memory_write_w(uint16_t addr, uint16_t val) {
     memory_write(addr+1, v.h);
 }
 
-void memory_load_rom(uint8_t *data, size_t sz) {
-    (void)memcpy(emu_prg_rom, data, MIN(sz, sizeof emu_prg_rom));
+/* Read len bytes from addr on into dst like that many memory_read()s,
+ * wrapping at $ffff. Pages that are plain memory are copied whole, only
+ * the rest goes byte by byte through its devices. */
+void memory_read_block(uint16_t addr, uint8_t *dst, size_t len) {
+    machine_t *m = current_machine;
+    while(len) {
+        size_t n = MIN(len, 0x100u - (addr&0xff)), i;
+        if(m->page_flags[addr>>8] & PAGE_READ) {
+            (void)memcpy(dst, m->page_data[addr>>8] + (addr&0xff), n);
+            m->data_bus = dst[n-1];
+            STAT_ADD(reads, n);
+        } else for(i = 0; i < n; ++i) dst[i] = memory_read(addr + i);
+        addr += n, dst += n, len -= n;
+    }
+}
+
+/* the other way around, from src, which mustn't be emulated memory */
+void memory_write_block(uint16_t addr, const uint8_t *src, size_t len) {
+    machine_t *m = current_machine;
+    while(len) {
+        size_t n = MIN(len, 0x100u - (addr&0xff)), i;
+        if(m->page_flags[addr>>8] & PAGE_WRITE) {
+            (void)memcpy(m->page_data[addr>>8] + (addr&0xff), src, n);
+            m->data_bus = src[n-1];
+            STAT_ADD(writes, n);
+        } else for(i = 0; i < n; ++i) memory_write(addr + i, src[i]);
+        addr += n, src += n, len -= n;
+    }
+}
+
+/* for devices setting their next event from a read or write */
+void memory_schedule(memory_device_t *dev, uint64_t cycle) {
+    dev->next_event = cycle;
+    memory_reschedule(current_machine);
+}
+
+/* Catch up the devices whose events are due. The run loops call this
+ * between instructions once cycles reaches next_event. */
+void memory_sync_due(void) {
+    machine_t *m = current_machine;
+    unsigned i;
+    for(i = 0; i < m->n_lazy; ++i)
+        if(m->lazy[i]->next_event <= m->cycles)
+            memory_device_sync(m, m->lazy[i]);
+    memory_reschedule(m);
+}
+
+void memory_map_rom(rom_image_t *img, uint16_t addr, int flags) {
+    memory_map_rom_segment(img, 0, img->size, addr, flags);
+}
+
+/* Map sz bytes from offset off of an image into PRG space at addr. Whole
+ * pages point into the image and are shared with every other machine
+ * mapping it, pages it only partly covers get a private copy. */
+void memory_map_rom_segment(rom_image_t *img, size_t off, size_t sz,
+                            uint16_t addr, int flags) {
+    machine_t *m = current_machine;
+    uint32_t start = addr, end, page;
+
+    if(off >= img->size) return;
+    sz = MIN(sz, img->size - off);
+    end = sz < 0x10000u - addr ? addr + sz : 0x10000;
+    /* only PRG space takes images, from PRG_START in the default layout */
+    while(start < end && m->map[start>>4] != &memory_prg_rom_entry)
+        start = (start | 0xf) + 1;
+    if(start >= end) return;
+    memory_hold_rom(m, img);
+
+    for(page = start>>8; page <= (end-1)>>8; ++page) {
+        uint32_t lo = MAX(page<<8, start), hi = MIN((page+1)<<8, end);
+        const uint8_t *src = img->data + off + (lo - addr);
+
+        if(lo == page<<8 && hi == (page+1)<<8) {
+            memory_page_set(m, page, src);
+        } else {
+            uint8_t *data = memory_page_private(m, page);
+            if(!data) die("[Error] Out of memory\n");
+            (void)memcpy(data + (lo&0xff), src, hi - lo);
+        }
+        if(flags & MEMORY_ROM_READONLY) m->page_flags[page] |= PAGE_READONLY;
+        else m->page_flags[page] &= ~PAGE_READONLY;
+        memory_page_update(m, page);
+    }
+}
+
+/* Repoint whole pages at data for bank switching. Only the page table is
+ * touched, the caller keeps whatever data lives in alive. */
+void memory_map_bank(const uint8_t *data, uint16_t addr, unsigned pages) {
+    machine_t *m = current_machine;
+    unsigned page = addr>>8, end = MIN(page + pages, 0x100);
+    for(; page < end; ++page, data += 0x100) {
+        if(m->page_flags[page] & PAGE_PRIVATE) {
+            memory_page_set(m, page, data);
+            memory_page_update(m, page);
+        } else m->page_data[page] = (uint8_t *)data;
+    }
+}
+
+/* Give the current machine a flat 64 KiB host view of its address space,
+ * so that engines generating code can turn RAM and ROM accesses into plain
+ * loads and stores. RAM lives in a memfd that is mapped once per host page
+ * of 0x0000-0x1fff, so those mirrors are real aliases. Mirrors closer than
+ * a host page can't be, which is what flat_fold is for. PRG pages are kept
+ * in a second, read-only part of the view: the page table points into a
+ * writable alias of it, so copy-on-write and bank switches copy into the
+ * view instead of only swapping pointers.
+ *
+ * Only pages with PAGE_READ/PAGE_WRITE set may be accessed through the
+ * view, everything else has to go through memory_read()/memory_write(). */
+uint8_t *memory_flat_enable(void) {
+    machine_t *m = current_machine;
+    long host = sysconf(_SC_PAGESIZE);
+    size_t ram_sz;
+    uint8_t *flat, *prg;
+    unsigned addr, page;
+    int fd;
+
+    if(m->flat) return m->flat;
+    if(m->xram) return NULL;
+    if(host <= 0 || host > 0x2000 || 0x2000 % host) return NULL;
+    ram_sz = MAX((size_t)host, 0x800);
+
+    if((fd = memfd_create("emu6502", MFD_CLOEXEC)) < 0) return NULL;
+    if(ftruncate(fd, ram_sz + 0x10000)) goto fail_fd;
+    flat = mmap(NULL, 0x10000, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(flat == MAP_FAILED) goto fail_fd;
+    prg = mmap(NULL, 0x10000, PROT_READ|PROT_WRITE, MAP_SHARED, fd, ram_sz);
+    if(prg == MAP_FAILED) goto fail_flat;
+
+    for(addr = 0; addr < 0x2000; addr += host)
+        if(mmap(flat + addr, host, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED,
+                fd, addr % ram_sz) == MAP_FAILED) goto fail_prg;
+    if(mmap(flat + 0x2000, 0xe000, PROT_READ, MAP_SHARED|MAP_FIXED,
+            fd, ram_sz + 0x2000) == MAP_FAILED) goto fail_prg;
+    (void)close(fd);
+
+    (void)memcpy(flat, m->ram, 0x800);
+    for(page = 0x00; page < 0x20; ++page)
+        m->page_data[page] = flat + ((page&0x7)<<8);
+    m->flat = flat;
+    m->flat_prg = prg;
+    m->flat_fold = 0x1fff & ~((host-1) & ~0x7ff);
+    for(page = PRG_START>>8; page < 0x100; ++page) {
+        memory_page_set(m, page, m->page_data[page]);
+        memory_page_update(m, page);
+    }
+    return flat;
+
+fail_prg:
+    (void)munmap(prg, 0x10000);
+fail_flat:
+    (void)munmap(flat, 0x10000);
+fail_fd:
+    (void)close(fd);
+    return NULL;
+}
+
+/* Back whole pages from addr with memory that the caller keeps alive and
+ * may share with other machines or processes. Reads and writes go straight
+ * to it. Returns 0 or -1. */
+int memory_map_shared(uint8_t *data, uint16_t addr, size_t size) {
+    machine_t *m = current_machine;
+    uint32_t page, end = (uint32_t)addr + size, block;
+
+    if((addr | size) & 0xff || !size || end > 0x10000 || m->flat) return -1;
+    for(page = addr>>8; page < end>>8; ++page, data += 0x100) {
+        for(block = 0; block < 0x10; ++block)
+            memory_map_page(&memory_ram_entry, page<<8 | block<<4);
+        memory_page_release(m, page);
+        m->page_data[page] = data;
+        m->page_flags[page] &= ~PAGE_READONLY;
+        m->page_flags[page] |= PAGE_PRIVATE;
+        memory_page_update(m, page);
+    }
+    return 0;
+}
+
+/* Start the layout of the current machine over with nothing mapped, for
+ * machine descriptions that place all of their memory and devices, see
+ * config.c. RAM they declare lives in xram, at its own address, so that
+ * mirrors and copies of the machine can find it. A flat view only knows
+ * the default layout. */
+int memory_map_clear(void) {
+    machine_t *m = current_machine;
+    unsigned page;
+
+    if(m->flat) return -1;
+    if(!m->xram && !(m->xram = calloc(1, 0x10000)))
+        die("[Error] Out of memory\n");
+    if(m->map == default_map && !(m->map = malloc(sizeof default_map)))
+        die("[Error] Out of memory\n");
+    (void)memset(m->map, 0, sizeof default_map);
+    memory_lazy_clear(m);
+    memory_reschedule(m);
+    for(page = 0x00; page < 0x100; ++page) {
+        memory_page_release(m, page);
+        m->page_data[page] = NULL;
+        m->page_flags[page] = 0;
+        memory_page_update(m, page);
+    }
+    return 0;
+}
+
+/* RAM of size bytes at addr, repeated up to end like on a decoder that
+ * ignores the upper address lines. Everything is whole pages, inside a
+ * layout memory_map_clear() started. */
+int memory_map_ram(uint16_t addr, size_t size, uint32_t end) {
+    machine_t *m = current_machine;
+    uint32_t page, block;
+
+    if(!m->xram || (addr | size | end) & 0xff || !size || end > 0x10000
+       || end < addr + size) return -1;
+    for(page = addr>>8; page < end>>8; ++page) {
+        for(block = 0; block < 0x10; ++block)
+            m->map[page<<4 | block] = &memory_ram_entry;
+        memory_page_release(m, page);
+        m->page_data[page] = m->xram + addr + ((page<<8) - addr) % size;
+        m->page_flags[page] = PAGE_PRIVATE;
+        memory_page_update(m, page);
+    }
+    return 0;
+}
+
+/* PRG space from addr to end that images and cartridges map into, reading
+ * as zeros until they do */
+void memory_map_prg(uint16_t addr, uint32_t end) {
+    machine_t *m = current_machine;
+    uint32_t block, page;
+
+    for(block = addr>>4; block < (end+0xf)>>4 && block < 0x1000; ++block)
+        m->map[block] = &memory_prg_rom_entry;
+    for(page = addr>>8; page < (end+0xff)>>8 && page < 0x100; ++page) {
+        if(!m->page_data[page]) m->page_data[page] = (uint8_t *)zero_page;
+        memory_page_update(m, page);
+    }
+}
+
+/* Change a byte of plain RAM or PRG even where writes would be dropped or
+ * taken by a cartridge, in a private copy of the page. Returns the old
+ * byte, or -1 if addr isn't plain memory. */
+int memory_patch(uint16_t addr, uint8_t val) {
+    machine_t *m = current_machine;
+    uint8_t old, *page;
+    if(!memory_peek(addr, &old)) return -1;
+    if(!(page = memory_page_private(m, addr>>8))) die("[Error] Out of memory\n");
+    page[addr&0xff] = val;
+    return old;
+}
+
+void memory_load_rom(const uint8_t *data, size_t sz) {
+    memory_load_rom_addr(data, sz, PRG_START);
 }
 
-void memory_load_rom_addr(uint8_t *data, size_t sz, uint16_t addr) {
-    if(addr < 0x4020) return;
-    addr -= 0x4020;
-    (void)memcpy(emu_prg_rom + addr, data,
-                 MIN(sz, sizeof emu_prg_rom - addr));
+void memory_load_rom_addr(const uint8_t *data, size_t sz, uint16_t addr) {
+    rom_image_t *img;
+    if(addr < PRG_START) return;
+    if(!(img = rom_image_new(data, MIN(sz, 0x10000u - addr))))
+        die("[Error] Out of memory\n");
+    memory_map_rom(img, addr, 0);
+    rom_image_unref(img);
 }
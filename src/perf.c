@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+#include <emu6502/perf.h>
+#include <emu6502/cpu.h>
+#include <emu6502/decoding.h>
+#include <emu6502/machine.h>
+#include <linux/perf_event.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Host performance counters around the run loop of the thread that calls
+ * perf_start(), read with perf_event_open(2).
+ *
+ * Every event is opened on its own, so what the host or its
+ * perf_event_paranoid doesn't allow is reported unavailable and the rest
+ * still count; the software task clock works nearly everywhere. Totals
+ * are scaled up when the kernel multiplexed an event.
+ *
+ * Events also signal the thread every period of them, and the handler
+ * charges the sample to perf_opcode, the opcode the engines noted last.
+ * The per class figures split the totals by those samples and divide by
+ * how many instructions of the class ran, so coalesced signals cost
+ * precision, not accuracy. Cache misses are those of L1d reads and of
+ * the last level, which is the generic event the kernel has for L2 and
+ * beyond. */
+
+__thread uint8_t perf_opcode;
+__thread uint64_t *perf_ops;
+
+enum {
+    PERF_TASK_CLOCK,
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LL_MISSES,
+    PERF_EVENTS
+};
+
+#define PERF_CACHE(cache, op, result) \
+    ((cache) | (op)<<8 | (result)<<16)
+
+static const struct perf_event {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    /* events between samples */
+    uint64_t period;
+} perf_events[PERF_EVENTS] = {
+    [PERF_TASK_CLOCK] = {"task-ns", PERF_TYPE_SOFTWARE,
+                         PERF_COUNT_SW_TASK_CLOCK, 100000},
+    [PERF_CYCLES] = {"cycles", PERF_TYPE_HARDWARE,
+                     PERF_COUNT_HW_CPU_CYCLES, 200000},
+    [PERF_INSTRUCTIONS] = {"instrs", PERF_TYPE_HARDWARE,
+                           PERF_COUNT_HW_INSTRUCTIONS, 200000},
+    [PERF_BRANCH_MISSES] = {"br-miss", PERF_TYPE_HARDWARE,
+                            PERF_COUNT_HW_BRANCH_MISSES, 2000},
+    [PERF_L1D_MISSES] = {"L1d-miss", PERF_TYPE_HW_CACHE,
+                         PERF_CACHE(PERF_COUNT_HW_CACHE_L1D,
+                                    PERF_COUNT_HW_CACHE_OP_READ,
+                                    PERF_COUNT_HW_CACHE_RESULT_MISS), 2000},
+    [PERF_LL_MISSES] = {"LL-miss", PERF_TYPE_HW_CACHE,
+                        PERF_CACHE(PERF_COUNT_HW_CACHE_LL,
+                                   PERF_COUNT_HW_CACHE_OP_READ,
+                                   PERF_COUNT_HW_CACHE_RESULT_MISS), 200},
+};
+
+static int perf_fd[PERF_EVENTS] = {-1, -1, -1, -1, -1, -1};
+/* why an event couldn't be opened */
+static int perf_errno[PERF_EVENTS];
+static uint64_t perf_total[PERF_EVENTS];
+static int perf_counted[PERF_EVENTS];
+/* written by the handler only, on the measured thread */
+static volatile uint64_t perf_samples[PERF_EVENTS][0x100];
+static uint64_t perf_ops_run[0x100];
+static uint64_t perf_cycles;
+static struct timespec perf_t0;
+static double perf_secs;
+
+static void perf_sample(int sig, siginfo_t *si, void *ctx) {
+    int i, saved = errno;
+    (void)sig, (void)ctx;
+    for(i = 0; i < PERF_EVENTS; ++i)
+        if(perf_fd[i] >= 0 && perf_fd[i] == si->si_fd)
+            perf_samples[i][perf_opcode]++;
+    errno = saved;
+}
+
+static int perf_open(const struct perf_event *e) {
+    struct perf_event_attr attr;
+    (void)memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = e->type;
+    attr.config = e->config;
+    attr.sample_period = e->period;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                     | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+                   PERF_FLAG_FD_CLOEXEC);
+}
+
+/* signal this thread on overflows, counting goes on if that fails */
+static void perf_arm(int fd) {
+    struct f_owner_ex owner = {F_OWNER_TID, syscall(SYS_gettid)};
+    if(fcntl(fd, F_SETFL, O_ASYNC) || fcntl(fd, F_SETSIG, SIGIO)
+       || fcntl(fd, F_SETOWN_EX, &owner))
+        (void)fcntl(fd, F_SETFL, 0);
+}
+
+/* Open and start the counters on this thread, 0 if any is counting. */
+int perf_start(void) {
+    struct sigaction sa;
+    int i, n = 0;
+
+    (void)memset(&sa, 0, sizeof sa);
+    sa.sa_sigaction = perf_sample;
+    sa.sa_flags = SA_SIGINFO|SA_RESTART;
+    (void)sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGIO, &sa, NULL);
+
+    for(i = 0; i < PERF_EVENTS; ++i) {
+        if((perf_fd[i] = perf_open(&perf_events[i])) < 0) {
+            perf_errno[i] = errno;
+            continue;
+        }
+        perf_arm(perf_fd[i]);
+        n++;
+    }
+    (void)memset(perf_ops_run, 0, sizeof perf_ops_run);
+    perf_ops = perf_ops_run;
+    perf_cycles = current_machine->cycles;
+    (void)clock_gettime(CLOCK_MONOTONIC, &perf_t0);
+    for(i = 0; i < PERF_EVENTS; ++i)
+        if(perf_fd[i] >= 0) (void)ioctl(perf_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    return n ? 0 : -1;
+}
+
+void perf_stop(void) {
+    struct timespec t1;
+    int i;
+
+    for(i = 0; i < PERF_EVENTS; ++i)
+        if(perf_fd[i] >= 0) (void)ioctl(perf_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    (void)clock_gettime(CLOCK_MONOTONIC, &t1);
+    perf_secs = (t1.tv_sec - perf_t0.tv_sec)
+              + (t1.tv_nsec - perf_t0.tv_nsec) / 1e9;
+    perf_cycles = current_machine->cycles - perf_cycles;
+    perf_ops = NULL;
+
+    for(i = 0; i < PERF_EVENTS; ++i) {
+        /* value, time enabled, time running */
+        uint64_t v[3];
+        if(perf_fd[i] < 0) continue;
+        (void)fcntl(perf_fd[i], F_SETFL, 0);
+        if(read(perf_fd[i], v, sizeof v) != sizeof v) {
+            perf_errno[i] = errno ? errno : EIO;
+            (void)close(perf_fd[i]);
+            perf_fd[i] = -1;
+            continue;
+        }
+        perf_total[i] = v[2] && v[2] < v[1]
+                      ? (uint64_t)((double)v[0] * v[1] / v[2]) : v[0];
+        (void)close(perf_fd[i]);
+        perf_fd[i] = -1;
+        perf_counted[i] = 1;
+    }
+}
+
+/* Totals per emulated instruction and cycle, then per class of
+ * instruction, for the run of the engine named. */
+void perf_report(FILE *f, const char *engine) {
+    const instr_t *table = current_machine->variant->table;
+    uint64_t ops[0x100] = {0}, samples[PERF_EVENTS][0x100];
+    uint64_t all[PERF_EVENTS] = {0}, instructions = 0;
+    unsigned types[0x100], n_types = 0;
+    int i, j, e;
+
+    (void)memset(samples, 0, sizeof samples);
+    for(i = 0; i < 0x100; ++i) {
+        unsigned t = table[i].type & 0xff;
+        ops[t] += perf_ops_run[i];
+        instructions += perf_ops_run[i];
+        for(e = 0; e < PERF_EVENTS; ++e) {
+            samples[e][t] += perf_samples[e][i];
+            all[e] += perf_samples[e][i];
+        }
+    }
+
+    fprintf(f, "-----\nHost counters, %s engine:\n", engine);
+    fprintf(f, "%llu instructions, %llu cycles in %.3fs, %.2f MIPS\n",
+            (unsigned long long)instructions,
+            (unsigned long long)perf_cycles, perf_secs,
+            perf_secs > 0 ? instructions / perf_secs / 1e6 : 0.0);
+    fprintf(f, "%-10s %16s %12s %12s\n", "event", "total", "per instr",
+            "per cycle");
+    for(e = 0; e < PERF_EVENTS; ++e) {
+        if(!perf_counted[e]) {
+            fprintf(f, "%-10s unavailable: %s\n", perf_events[e].name,
+                    strerror(perf_errno[e]));
+            continue;
+        }
+        fprintf(f, "%-10s %16llu %12.3f %12.3f\n", perf_events[e].name,
+                (unsigned long long)perf_total[e],
+                instructions ? (double)perf_total[e] / instructions : 0.0,
+                perf_cycles ? (double)perf_total[e] / perf_cycles : 0.0);
+    }
+
+    /* classes that ran, most frequent first */
+    for(i = 0; i < 0x100; ++i) {
+        if(!ops[i]) continue;
+        for(j = n_types; j > 0 && ops[types[j-1]] < ops[i]; --j)
+            types[j] = types[j-1];
+        types[j] = i;
+        n_types++;
+    }
+    if(!n_types) return;
+
+    fprintf(f, "Per instruction of each class, from samples:\n%-6s %14s %6s",
+            "class", "instructions", "share");
+    for(e = 0; e < PERF_EVENTS; ++e)
+        if(perf_counted[e] && all[e]) fprintf(f, " %10s", perf_events[e].name);
+    fputc('\n', f);
+    for(i = 0; i < (int)n_types; ++i) {
+        unsigned t = types[i];
+        fprintf(f, "%-6s %14llu %5.1f%%", instr_type_str(t),
+                (unsigned long long)ops[t], 100.0 * ops[t] / instructions);
+        for(e = 0; e < PERF_EVENTS; ++e)
+            if(perf_counted[e] && all[e])
+                fprintf(f, " %10.3f", (double)perf_total[e] * samples[e][t]
+                                      / all[e] / ops[t]);
+        fputc('\n', f);
+    }
+}
@@ -0,0 +1,563 @@
+#include <emu6502/decoding.h>
+#include <emu6502/utils.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGRAM_NAME "emu6502-recomp"
+
+#define NMI_VECTOR 0xfffa
+#define RESET_VECTOR 0xfffc
+#define BRK_VECTOR 0xfffe
+
+const char *help_str = ""
+"Usage: " PROGRAM_NAME " [option]... rom\n"
+"\n"
+"Translates a ROM image to C, one function per routine reachable from the\n"
+"interrupt vectors. Link the output with emu6502-rt.a.\n"
+"\n"
+"Options:\n"
+"  -o, --output=FILE          write the C source to FILE instead of stdout\n"
+"  -a, --address=ADDR         load the image at ADDR (default $8000)\n"
+"  -f, --flow=FILE            also start routines at the entries of a control\n"
+"                             flow file emu6502 --flow wrote for the rom\n"
+"  -c, --cpu=VARIANT          translate for nmos (default), 65c02 or 2a03\n"
+"  -h, --help                 print this help message\n"
+;
+
+/* What the translation depends on per CPU variant. Only documented
+ * opcodes are translated, which every variant decodes the same way. The
+ * 65C02 takes JMP (a) pointers across pages, clears D on BRK and takes a
+ * cycle more for ADC and SBC in decimal mode. */
+static const struct recomp_cpu {
+    const char *name;
+    const uint8_t *cycles;
+    const char *adc, *sbc;
+    int cmos;
+} cpus[] = {
+    {"nmos", instruction_cycles, "alu_adc_nmos", "alu_sbc_nmos", 0},
+    {"65c02", instruction_cycles_65c02, "alu_adc_65c02", "alu_sbc_65c02", 1},
+    {"2a03", instruction_cycles, "alu_adc", "alu_sbc", 0},
+};
+static const struct recomp_cpu *cpu = &cpus[0];
+
+static uint8_t image[0x10000];
+static uint8_t loaded[0x10000];
+
+static uint16_t routines[0x10000];
+static unsigned n_routines = 0;
+static uint8_t is_routine[0x10000];
+
+/* per-routine walk state */
+static uint8_t member[0x10000];
+static uint8_t label[0x10000];
+static uint16_t worklist[0x10000];
+
+/* which function the dispatcher enters for an address */
+static int entry_of[0x10000];
+
+static int decodable(uint16_t addr) {
+    const instr_t *instr = &instruction_table[image[addr]];
+    unsigned i, len;
+    if(instr->type == OP_UNKNOWN) return 0;
+    len = instr_mode_len(instr->mode);
+    for(i = 0; i < len; ++i)
+        if(!loaded[(uint16_t)(addr+i)]) return 0;
+    return 1;
+}
+
+static uint16_t operand(uint16_t addr) {
+    return image[(uint16_t)(addr+1)] | image[(uint16_t)(addr+2)]<<8;
+}
+
+static uint16_t branch_target(uint16_t addr) {
+    return addr+2 + (int8_t)image[(uint16_t)(addr+1)];
+}
+
+static int is_branch(enum instr_type type) {
+    switch(type) {
+    case OP_BCC: case OP_BCS: case OP_BNE: case OP_BEQ:
+    case OP_BPL: case OP_BMI: case OP_BVC: case OP_BVS:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static const char *reg_name(enum instr_type type) {
+    switch(type) {
+    case OP_LDX: case OP_STX: case OP_CPX:
+        return "x";
+    case OP_LDY: case OP_STY: case OP_CPY:
+        return "y";
+    default:
+        return "a";
+    }
+}
+
+static const char *rmw_name(enum instr_type type) {
+    switch(type) {
+    case OP_INC: return "RC_INC_";
+    case OP_DEC: return "RC_DEC_";
+    case OP_ASL: return "alu_asl";
+    case OP_LSR: return "alu_lsr";
+    case OP_ROL: return "alu_rol";
+    default:     return "alu_ror";
+    }
+}
+
+static void add_routine(uint16_t addr) {
+    if(is_routine[addr] || !decodable(addr)) return;
+    is_routine[addr] = 1;
+    routines[n_routines++] = addr;
+}
+
+/* collect the instructions reachable from a routine entry without following
+ * subroutine calls */
+static void walk(uint16_t entry) {
+    unsigned sp = 0;
+    memset(member, 0, sizeof member);
+    memset(label, 0, sizeof label);
+    label[entry] = 1;
+    worklist[sp++] = entry;
+
+    while(sp) {
+        uint16_t addr = worklist[--sp];
+        const instr_t *instr;
+        uint16_t next;
+
+        if(member[addr] || !decodable(addr)) continue;
+        member[addr] = 1;
+        instr = &instruction_table[image[addr]];
+        next = addr + instr_mode_len(instr->mode);
+
+        if(is_branch(instr->type)) {
+            label[branch_target(addr)] = 1;
+            worklist[sp++] = branch_target(addr);
+            worklist[sp++] = next;
+        } else switch(instr->type) {
+        case OP_JMP:
+            if(instr->mode == MODE_ABSOLUTE) {
+                label[operand(addr)] = 1;
+                worklist[sp++] = operand(addr);
+            }
+            break;
+
+        case OP_JSR:
+            add_routine(operand(addr));
+            label[next] = 1;
+            worklist[sp++] = next;
+            break;
+
+        case OP_RTS:
+        case OP_RTI:
+        case OP_BRK:
+            break;
+
+        default:
+            worklist[sp++] = next;
+            break;
+        }
+    }
+
+    /* fallthrough into code that is not emitted right after needs a goto */
+    for(uint32_t addr = 0, prev = 0x10000; addr < 0x10000; ++addr) {
+        if(!member[addr]) continue;
+        if(prev != 0x10000) {
+            const instr_t *instr = &instruction_table[image[prev]];
+            uint16_t next = prev + instr_mode_len(instr->mode);
+            if(next != addr) label[next] = 1;
+        }
+        prev = addr;
+    }
+}
+
+/* Entries of an emu6502 --flow file, which include code the emulator saw
+ * reached through pointers. Everything else in it is left alone. */
+static int add_flow_entries(const char *path) {
+    char line[256];
+    FILE *f;
+
+    if(!(f = fopen(path, "r"))) return -1;
+    while(fgets(line, sizeof line, f)) {
+        unsigned addr;
+        if(sscanf(line, "entry $%x", &addr) == 1 && addr <= 0xffff)
+            add_routine(addr);
+    }
+    (void)fclose(f);
+    return 0;
+}
+
+static void ea_str(char *buf, size_t sz, uint16_t addr,
+                   enum instr_address_mode mode) {
+    uint16_t o = operand(addr);
+    uint8_t zp = o&0xff;
+    switch(mode) {
+    case MODE_ABSOLUTE:
+        snprintf(buf, sz, "0x%04x", o);
+        break;
+    case MODE_ZERO_PAGE:
+        snprintf(buf, sz, "0x%02x", zp);
+        break;
+    case MODE_ZERO_PAGE_X:
+        snprintf(buf, sz, "(uint8_t)(0x%02x + cpu_reg.x)", zp);
+        break;
+    case MODE_ZERO_PAGE_Y:
+        snprintf(buf, sz, "(uint8_t)(0x%02x + cpu_reg.y)", zp);
+        break;
+    case MODE_ABSOLUTE_X:
+        snprintf(buf, sz, "(uint16_t)(0x%04x + cpu_reg.x)", o);
+        break;
+    case MODE_ABSOLUTE_Y:
+        snprintf(buf, sz, "(uint16_t)(0x%04x + cpu_reg.y)", o);
+        break;
+    case MODE_ZERO_PAGE_INDIRECT_X:
+        snprintf(buf, sz, "memory_read_zp_w(0x%02x + cpu_reg.x)", zp);
+        break;
+    case MODE_ZERO_PAGE_INDIRECT_Y:
+        snprintf(buf, sz, "(uint16_t)(memory_read_zp_w(0x%02x) + cpu_reg.y)", zp);
+        break;
+    case MODE_ABSOLUTE_INDIRECT:
+        snprintf(buf, sz, cpu->cmos ? "memory_read_w(0x%04x)"
+                                    : "memory_read_w_page(0x%04x)", o);
+        break;
+    default:
+        die("[Error] Address mode has no effective address\n");
+    }
+}
+
+static void val_str(char *buf, size_t sz, uint16_t addr,
+                    enum instr_address_mode mode) {
+    char ea[64];
+    switch(mode) {
+    case MODE_ACCUMULATOR:
+        snprintf(buf, sz, "cpu_reg.a");
+        break;
+    case MODE_IMMEDIATE:
+        snprintf(buf, sz, "0x%02x", image[(uint16_t)(addr+1)]);
+        break;
+    default:
+        ea_str(ea, sizeof ea, addr, mode);
+        snprintf(buf, sz, "memory_read(%s)", ea);
+        break;
+    }
+}
+
+/* stores that provably hit internal RAM cannot halt or reset the CPU */
+static int store_is_ram(uint16_t addr, enum instr_address_mode mode) {
+    switch(mode) {
+    case MODE_ZERO_PAGE:
+    case MODE_ZERO_PAGE_X:
+    case MODE_ZERO_PAGE_Y:
+        return 1;
+    case MODE_ABSOLUTE:
+        return operand(addr) < 0x2000;
+    case MODE_ABSOLUTE_X:
+    case MODE_ABSOLUTE_Y:
+        return operand(addr) + 0xff < 0x2000;
+    default:
+        return 0;
+    }
+}
+
+static void emit_goto(FILE *out, uint16_t target) {
+    if(member[target])
+        fprintf(out, "goto L_%04x;", target);
+    else
+        fprintf(out, "{ cpu_reg.pc = 0x%04x; return; }", target);
+}
+
+static void emit_instr(FILE *out, uint16_t addr) {
+    uint8_t opcode = image[addr];
+    const instr_t *instr = &instruction_table[opcode];
+    enum instr_address_mode mode = instr->mode;
+    uint16_t next = addr + instr_mode_len(mode);
+    const char *r = reg_name(instr->type), *cond = NULL, *fn = NULL;
+    char ea[64], val[80];
+    int store = 0;
+
+    if(label[addr]) fprintf(out, "L_%04x:\n    RC_DUE(0x%04x);\n", addr, addr);
+    fprintf(out, "    /* $%04x: %s %s */\n", addr,
+            instr_type_str(instr->type), instr_mode_str(mode));
+    fprintf(out, "    RC_CYCLES(%u);\n", cpu->cycles[opcode]);
+
+    if(mode != MODE_ACCUMULATOR && mode != MODE_IMPLIED
+       && mode != MODE_IMMEDIATE && mode != MODE_RELATIVE)
+        ea_str(ea, sizeof ea, addr, mode);
+    if(mode != MODE_IMPLIED && mode != MODE_RELATIVE
+       && mode != MODE_ABSOLUTE_INDIRECT)
+        val_str(val, sizeof val, addr, mode);
+
+    switch(instr->type) {
+    case OP_LDA: case OP_LDX: case OP_LDY:
+        fprintf(out, "    alu_load(&cpu_reg.%s, %s);\n", r, val);
+        break;
+
+    case OP_STA: case OP_STX: case OP_STY:
+        store = 1;
+        if(!store_is_ram(addr, mode))
+            fprintf(out, "    cpu_reg.pc = 0x%04x;\n", next);
+        fprintf(out, "    RC_ST(%s, cpu_reg.%s);\n", ea, r);
+        break;
+
+    case OP_ADC:
+    case OP_SBC:
+        fprintf(out, "    %s(%s);\n", instr->type == OP_ADC ? cpu->adc
+                                                          : cpu->sbc, val);
+        if(cpu->cmos) fprintf(out, "    RC_DECIMAL_CYCLE();\n");
+        break;
+    case OP_AND:
+        fprintf(out, "    alu_load(&cpu_reg.a, cpu_reg.a & %s);\n", val);
+        break;
+    case OP_ORA:
+        fprintf(out, "    alu_load(&cpu_reg.a, cpu_reg.a | %s);\n", val);
+        break;
+    case OP_EOR:
+        fprintf(out, "    alu_load(&cpu_reg.a, cpu_reg.a ^ %s);\n", val);
+        break;
+    case OP_CMP: case OP_CPX: case OP_CPY:
+        fprintf(out, "    alu_compare(cpu_reg.%s, %s);\n", r, val);
+        break;
+    case OP_BIT: fprintf(out, "    alu_bit(%s);\n", val); break;
+
+    case OP_INC: case OP_DEC: case OP_ASL:
+    case OP_LSR: case OP_ROL: case OP_ROR:
+        fn = rmw_name(instr->type);
+        if(mode == MODE_ACCUMULATOR) {
+            fprintf(out, "    alu_load(&cpu_reg.a, %s(cpu_reg.a));\n", fn);
+            break;
+        }
+        store = 1;
+        if(!store_is_ram(addr, mode))
+            fprintf(out, "    cpu_reg.pc = 0x%04x;\n", next);
+        fprintf(out, "    RC_RMW(%s, %s);\n", ea, fn);
+        break;
+
+    case OP_INX: fprintf(out, "    alu_load(&cpu_reg.x, cpu_reg.x+1);\n"); break;
+    case OP_INY: fprintf(out, "    alu_load(&cpu_reg.y, cpu_reg.y+1);\n"); break;
+    case OP_DEX: fprintf(out, "    alu_load(&cpu_reg.x, cpu_reg.x-1);\n"); break;
+    case OP_DEY: fprintf(out, "    alu_load(&cpu_reg.y, cpu_reg.y-1);\n"); break;
+
+    case OP_TAX: fprintf(out, "    alu_load(&cpu_reg.x, cpu_reg.a);\n"); break;
+    case OP_TXA: fprintf(out, "    alu_load(&cpu_reg.a, cpu_reg.x);\n"); break;
+    case OP_TAY: fprintf(out, "    alu_load(&cpu_reg.y, cpu_reg.a);\n"); break;
+    case OP_TYA: fprintf(out, "    alu_load(&cpu_reg.a, cpu_reg.y);\n"); break;
+    case OP_TSX: fprintf(out, "    alu_load(&cpu_reg.x, cpu_reg.s);\n"); break;
+    case OP_TXS: fprintf(out, "    cpu_reg.s = cpu_reg.x;\n"); break;
+
+    case OP_PHA: fprintf(out, "    RC_PUSH(cpu_reg.a);\n"); break;
+    case OP_PHP: fprintf(out, "    RC_PUSH(cpu_reg.p);\n"); break;
+    case OP_PLA: fprintf(out, "    alu_load(&cpu_reg.a, RC_PULL());\n"); break;
+    case OP_PLP: fprintf(out, "    cpu_reg.p = RC_PULL();\n"); break;
+
+    case OP_CLC: fprintf(out, "    cpu_reg.p &= ~FLAGS_CARRY;\n"); break;
+    case OP_SEC: fprintf(out, "    cpu_reg.p |=  FLAGS_CARRY;\n"); break;
+    case OP_CLD: fprintf(out, "    cpu_reg.p &= ~FLAGS_DECIMAL;\n"); break;
+    case OP_SED: fprintf(out, "    cpu_reg.p |=  FLAGS_DECIMAL;\n"); break;
+    case OP_CLI: fprintf(out, "    cpu_reg.p &= ~FLAGS_INTERRUPT;\n"); break;
+    case OP_SEI: fprintf(out, "    cpu_reg.p |=  FLAGS_INTERRUPT;\n"); break;
+    case OP_CLV: fprintf(out, "    cpu_reg.p &= ~FLAGS_OVERFLOW;\n"); break;
+
+    case OP_BCC: cond = "!HAS_FLAG(FLAGS_CARRY)"; break;
+    case OP_BCS: cond = "HAS_FLAG(FLAGS_CARRY)"; break;
+    case OP_BNE: cond = "!HAS_FLAG(FLAGS_ZERO)"; break;
+    case OP_BEQ: cond = "HAS_FLAG(FLAGS_ZERO)"; break;
+    case OP_BPL: cond = "!HAS_FLAG(FLAGS_NEGATIVE)"; break;
+    case OP_BMI: cond = "HAS_FLAG(FLAGS_NEGATIVE)"; break;
+    case OP_BVC: cond = "!HAS_FLAG(FLAGS_OVERFLOW)"; break;
+    case OP_BVS: cond = "HAS_FLAG(FLAGS_OVERFLOW)"; break;
+
+    case OP_JMP:
+        if(mode == MODE_ABSOLUTE) {
+            fprintf(out, "    ");
+            emit_goto(out, operand(addr));
+            fprintf(out, "\n");
+        } else {
+            /* unresolved: let the dispatcher or the interpreter take it */
+            fprintf(out, "    cpu_reg.pc = %s;\n    return;\n", ea);
+        }
+        return;
+
+    case OP_JSR:
+        fprintf(out, "    RC_JSR(0x%04x);\n", next);
+        if(is_routine[operand(addr)])
+            fprintf(out, "    RC_CALL(r_%04x, 0x%04x, 0x%04x);\n",
+                    operand(addr), operand(addr), next);
+        else
+            fprintf(out, "    cpu_reg.pc = 0x%04x;\n    return;\n",
+                    operand(addr));
+        break;
+
+    case OP_RTS: fprintf(out, "    RC_RTS();\n    return;\n"); return;
+    case OP_RTI: fprintf(out, "    RC_RTI();\n    return;\n"); return;
+    case OP_BRK:
+        fprintf(out, "    cpu_reg.pc = 0x%04x;\n    RC_BRK();\n", next);
+        if(cpu->cmos) fprintf(out, "    cpu_reg.p &= ~FLAGS_DECIMAL;\n");
+        fprintf(out, "    return;\n");
+        return;
+
+    case OP_NOP:
+        break;
+
+    default:
+        die("[Error] Walked into an undecodable instruction\n");
+    }
+
+    if(store && !store_is_ram(addr, mode))
+        fprintf(out, "    RC_SYNC(0x%04x);\n", next);
+
+    if(cond) {
+        fprintf(out, "    if(%s) ", cond);
+        emit_goto(out, branch_target(addr));
+        fprintf(out, "\n");
+    }
+
+    /* fall through to the next instruction, which may not follow here */
+    if(!member[next] || label[next]) {
+        uint32_t a;
+        for(a = addr+1; a < 0x10000 && !member[a]; ++a);
+        if(a != next) {
+            fprintf(out, "    ");
+            emit_goto(out, next);
+            fprintf(out, "\n");
+        }
+    }
+}
+
+static void emit_routine(FILE *out, unsigned idx) {
+    uint16_t entry = routines[idx];
+    uint32_t addr;
+
+    walk(entry);
+
+    fprintf(out, "\nstatic void r_%04x(void) {\n"
+                 "    switch(cpu_reg.pc) {\n", entry);
+    for(addr = 0; addr < 0x10000; ++addr) {
+        if(!member[addr] || !label[addr]) continue;
+        fprintf(out, "    case 0x%04x: goto L_%04x;\n", addr, addr);
+        if(entry_of[addr] < 0 || addr == entry) entry_of[addr] = idx;
+    }
+    fprintf(out, "    default: return;\n"
+                 "    }\n\n");
+
+    for(addr = 0; addr < 0x10000; ++addr)
+        if(member[addr]) emit_instr(out, addr);
+    fprintf(out, "}\n");
+}
+
+static void emit(FILE *out, uint16_t load_addr, size_t sz) {
+    unsigned i;
+    uint32_t addr;
+
+    fprintf(out, "/* generated by " PROGRAM_NAME ", do not edit */\n"
+                 "#include <emu6502/recomp.h>\n\n");
+    /* the walk discovers routines, so keep going until the list is stable */
+    for(i = 0; i < n_routines; ++i) walk(routines[i]);
+    for(i = 0; i < n_routines; ++i)
+        fprintf(out, "static void r_%04x(void);\n", routines[i]);
+    for(i = 0; i < n_routines; ++i)
+        emit_routine(out, i);
+
+    fprintf(out, "\nconst recomp_fn_t recomp_table[0x10000] = {\n");
+    for(addr = 0; addr < 0x10000; ++addr)
+        if(entry_of[addr] >= 0)
+            fprintf(out, "[0x%04x] = r_%04x,\n", addr,
+                    routines[entry_of[addr]]);
+    fprintf(out, "};\n\n"
+                 "const char recomp_cpu[] = \"%s\";\n"
+                 "const uint16_t recomp_image_addr = 0x%04x;\n"
+                 "const size_t recomp_image_size = %zu;\n"
+                 "const uint8_t recomp_image[] = {", cpu->name, load_addr, sz);
+    for(i = 0; i < sz; ++i)
+        fprintf(out, "%s0x%02x,", i%16 ? " " : "\n",
+                image[(uint16_t)(load_addr+i)]);
+    fprintf(out, "\n};\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *out_path = NULL, *flow_path = NULL;
+    unsigned long load_addr = 0x8000;
+    FILE *f, *out = stdout;
+    size_t sz;
+
+    for(;;) {
+        int longind, c;
+
+        static struct option long_opts[] = {
+        {"output", required_argument, NULL, 'o'},
+        {"address", required_argument, NULL, 'a'},
+        {"flow", required_argument, NULL, 'f'},
+        {"cpu", required_argument, NULL, 'c'},
+        {"help", no_argument, NULL, 'h'},
+        {0, 0, 0, 0},
+        };
+
+        if((c = getopt_long(argc, argv, "o:a:f:c:h", long_opts, &longind)) == -1)
+           break;
+
+        switch(c) {
+        case 'o':
+            out_path = optarg;
+            break;
+
+        case 'a':
+            load_addr = strtoul(optarg + (*optarg == '$'), NULL, 16);
+            if(load_addr > 0xffff) die("[Error] Load address out of range\n");
+            break;
+
+        case 'f':
+            flow_path = optarg;
+            break;
+
+        case 'c':
+            for(cpu = cpus; strcmp(cpu->name, optarg); )
+                if(++cpu == cpus + sizeof cpus / sizeof *cpus) {
+                    fprintf(stderr, "[Error] Unknown CPU '%s', try one of "
+                            "nmos, 65c02, 2a03\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+            break;
+
+        case 'h':
+            die(help_str);
+
+        case '?':
+            break;
+
+        default:
+            printf("?? getopt returned character code 0%o ??\n", c);
+            break;
+        }
+    }
+
+    argv += optind;
+    if((argc -= optind) < 1) die(help_str);
+
+    if(!(f = fopen(argv[0], "rb"))) {
+        perror("fopen");
+        return EXIT_FAILURE;
+    }
+    sz = fread(image + load_addr, 1, sizeof image - load_addr, f);
+    fclose(f);
+    memset(loaded + load_addr, 1, sz);
+
+    memset(entry_of, 0xff, sizeof entry_of);
+    add_routine(image[RESET_VECTOR] | image[RESET_VECTOR+1]<<8);
+    add_routine(image[NMI_VECTOR] | image[NMI_VECTOR+1]<<8);
+    add_routine(image[BRK_VECTOR] | image[BRK_VECTOR+1]<<8);
+    if(flow_path && add_flow_entries(flow_path)) {
+        perror(flow_path);
+        return EXIT_FAILURE;
+    }
+    if(!n_routines) die("[Error] No code reachable from the vectors\n");
+
+    if(out_path && !(out = fopen(out_path, "w"))) {
+        perror("fopen");
+        return EXIT_FAILURE;
+    }
+    emit(out, load_addr, sz);
+    if(out != stdout) fclose(out);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,34 @@
+#include <emu6502/recomp.h>
+#include <emu6502/args.h>
+#include <emu6502/cpu.h>
+#include <stdlib.h>
+
+struct cmd_options cmd_options = {
+    .verbose = 0,
+    .step = 0,
+};
+
+unsigned recomp_depth = 0;
+
+/* run translated routines where there are any and interpret everything
+ * else, e.g. targets of indirect jumps the recompiler could not resolve */
+void recomp_run(void) {
+    while(!cpu_halt) {
+        recomp_fn_t fn = recomp_table[cpu_reg.pc];
+        if(fn) fn();
+        else cpu_step();
+    }
+}
+
+int main(void) {
+    machine_t *machine;
+    if(!(machine = machine_new())) return EXIT_FAILURE;
+    /* what isn't translated is interpreted as the same CPU */
+    if(!(machine->variant = cpu_variant_find(recomp_cpu))) return EXIT_FAILURE;
+    machine_select(machine);
+    memory_load_rom_addr(recomp_image, recomp_image_size, recomp_image_addr);
+    cpu_init();
+    recomp_run();
+    machine_free(machine);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 200809L
+#include <emu6502/rom.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* the image owns its data, which follows the header in the same block */
+rom_image_t *rom_image_new(const uint8_t *data, size_t sz) {
+    rom_image_t *img;
+    if(!(img = malloc(sizeof *img + sz))) return NULL;
+    img->data = (uint8_t *)(img + 1);
+    img->size = sz;
+    img->refs = 1;
+    img->map = NULL;
+    (void)memcpy(img + 1, data, sz);
+    return img;
+}
+
+/* for things that can't be mapped, like pipes */
+static rom_image_t *rom_image_read(int fd) {
+    rom_image_t *img = NULL;
+    uint8_t *buf = NULL, *tmp;
+    size_t sz = 0, cap = 0;
+    ssize_t n;
+
+    for(;;) {
+        if(sz == cap) {
+            cap = cap ? cap*2 : 0x10000;
+            if(!(tmp = realloc(buf, cap))) goto ret;
+            buf = tmp;
+        }
+        if((n = read(fd, buf + sz, cap - sz)) < 0) {
+            if(errno == EINTR) continue;
+            goto ret;
+        }
+        if(!n) break;
+        sz += n;
+    }
+    img = rom_image_new(buf, sz);
+
+ret:
+    free(buf);
+    return img;
+}
+
+rom_image_t *rom_image_load(const char *path) {
+    rom_image_t *img = NULL;
+    struct stat st;
+    void *map;
+    int fd, err;
+
+    if((fd = open(path, O_RDONLY)) < 0) return NULL;
+    if(fstat(fd, &st) < 0) goto ret;
+    if(!S_ISREG(st.st_mode) || !st.st_size) {
+        img = rom_image_read(fd);
+        goto ret;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) goto ret;
+    if(!(img = malloc(sizeof *img))) {
+        munmap(map, st.st_size);
+        goto ret;
+    }
+    img->data = map;
+    img->size = st.st_size;
+    img->refs = 1;
+    img->map = map;
+
+ret:
+    err = errno;
+    close(fd);
+    errno = err;
+    return img;
+}
+
+rom_image_t *rom_image_ref(rom_image_t *img) {
+    __atomic_add_fetch(&img->refs, 1, __ATOMIC_RELAXED);
+    return img;
+}
+
+void rom_image_unref(rom_image_t *img) {
+    if(!img || __atomic_sub_fetch(&img->refs, 1, __ATOMIC_ACQ_REL)) return;
+    if(img->map) munmap(img->map, img->size);
+    free(img);
+}
@@ -0,0 +1,248 @@
+#define _POSIX_C_SOURCE 200809L
+#include <emu6502/server.h>
+#include <emu6502/args.h>
+#include <emu6502/cpu.h>
+#include <emu6502/machine.h>
+#include <emu6502/config.h>
+#include <emu6502/utils.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Job server, one connection at a time on a Unix socket or on stdin and
+ * stdout. Requests are lines, followed by raw input bytes for run:
+ *
+ *   load [machine=FILE] ROM...                      -> ok ID
+ *   run CYCLES INPUT_LEN #ID|[machine=FILE] ROM...  -> done STOP CYCLES
+ *                                                      OUTPUT_LEN
+ *   quit
+ *
+ * ROMs are given like on the command line, and laid out by the machine
+ * description FILE or --machine if there is one, see config.c. Each
+ * description is read once and shared by every set of ROMs using it, and
+ * with one the ROMs may be left out. Every set of ROMs is booted
+ * once, up to the reset vector, and kept as a snapshot that each job starts
+ * from a copy of, so images, page tables and the fusion cache stay warm.
+ * A job runs until it halts or CYCLES cycles (0 for no limit) have passed,
+ * reading its input at $3ff0 and getting $ff past its end. STOP is one of
+ * halt, illegal, cycles or output, the last when it wrote more than
+ * MAX_OUTPUT bytes. Failed requests get "error MESSAGE" back. */
+
+#define MAX_OUTPUT (1<<20)
+#define MAX_INPUT  (1<<24)
+
+typedef struct snapshot {
+    char *key;
+    machine_t *machine;
+} snapshot_t;
+
+typedef struct job {
+    const uint8_t *in;
+    size_t in_len, in_pos;
+    uint8_t *out;
+    size_t out_len;
+} job_t;
+
+static snapshot_t *snapshots = NULL;
+static unsigned n_snapshots = 0;
+
+static uint8_t job_in(void *data) {
+    job_t *job = data;
+    return job->in_pos < job->in_len ? job->in[job->in_pos++] : 0xff;
+}
+
+static void job_out(void *data, uint8_t val) {
+    job_t *job = data;
+    if(job->out_len == MAX_OUTPUT) {
+        cpu_halt = HALT_USER;
+        return;
+    }
+    job->out[job->out_len++] = val;
+}
+
+/* boot the ROMs in the space separated key, or find them booted already */
+static int snapshot_get(const char *key) {
+    const machine_config_t *cfg = cmd_options.machine;
+    snapshot_t *snap;
+    machine_t *m;
+    char *roms, *rom, *save;
+    unsigned i;
+    int ret = 0;
+
+    for(i = 0; i < n_snapshots; ++i)
+        if(!strcmp(snapshots[i].key, key)) return i;
+
+    if(!(roms = strdup(key))) die("[Error] Out of memory\n");
+    rom = strtok_r(roms, " ", &save);
+    if(rom && !strncmp(rom, "machine=", 8)) {
+        if(!(cfg = config_get(rom+8))) {
+            free(roms);
+            return -1;
+        }
+        rom = strtok_r(NULL, " ", &save);
+    }
+
+    if(!(m = machine_new())) die("[Error] Out of memory\n");
+    machine_select(m);
+    m->flags = MACHINE_TRAP_ILLEGAL;
+    if(cfg) ret = config_apply(cfg);
+    if(cmd_options.variant) m->variant = cmd_options.variant;
+    if(cmd_options.bus_accurate) m->flags |= MACHINE_BUS_ACCURATE;
+    for(i = 0; rom && !ret; ++i, rom = strtok_r(NULL, " ", &save))
+        ret = i == 0 && cmd_options.mapper ? load_cartridge(rom)
+                                           : load_segment(rom);
+    free(roms);
+    if(!ret && (i || cfg)) ret = load_extras();
+    if(ret || !(i || cfg)) {
+        machine_free(m);
+        return -1;
+    }
+    cpu_init();
+
+    if(!(snap = realloc(snapshots, (n_snapshots+1) * sizeof *snap)))
+        die("[Error] Out of memory\n");
+    snapshots = snap;
+    snap[n_snapshots].machine = m;
+    if(!(snap[n_snapshots].key = strdup(key))) die("[Error] Out of memory\n");
+    return n_snapshots++;
+}
+
+/* everything after the first n fields of a request line */
+static const char *skip_fields(const char *line, unsigned n) {
+    while(n--) {
+        line += strspn(line, " ");
+        line += strcspn(line, " ");
+    }
+    return line + strspn(line, " ");
+}
+
+static void server_job(FILE *out, const char *key, unsigned long long cycles,
+                       const uint8_t *in, size_t in_len) {
+    static machine_t machine;
+    static int used = 0;
+    static uint8_t *out_buf = NULL;
+    static const char *stops[] = {
+        [0] = "cycles", [HALT_DEVICE] = "halt",
+        [HALT_ILLEGAL] = "illegal", [HALT_USER] = "output",
+    };
+    job_t job = {in, in_len, 0, NULL, 0};
+    int id;
+
+    if(*key == '#') {
+        char *end;
+        id = (int)strtoul(key+1, &end, 10);
+        if(*end || id >= (int)n_snapshots) id = -1;
+    } else id = snapshot_get(key);
+    if(id < 0) {
+        fprintf(out, "error cannot load '%s'\n", key);
+        return;
+    }
+    if(!out_buf && !(out_buf = malloc(MAX_OUTPUT)))
+        die("[Error] Out of memory\n");
+    job.out = out_buf;
+
+    if(used) machine_release(&machine);
+    (void)machine_copy(&machine, snapshots[id].machine);
+    used = 1;
+    machine_select(&machine);
+    machine.console_in = job_in;
+    machine.console_out = job_out;
+    machine.console = &job;
+    machine.cycles = 0;
+
+    cpu_run_for(cycles ? cycles : UINT64_MAX);
+    fprintf(out, "done %s %llu %zu\n", stops[machine.halt],
+            (unsigned long long)machine.cycles, job.out_len);
+    (void)fwrite(job.out, 1, job.out_len, out);
+}
+
+/* serve requests until the client quits or goes away */
+static void server_session(FILE *in, FILE *out) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+
+    while((len = getline(&line, &cap, in)) > 0) {
+        unsigned long long cycles;
+        size_t in_len;
+
+        if(line[len-1] == '\n') line[--len] = '\0';
+        if(!strcmp(line, "quit")) break;
+
+        if(!strncmp(line, "load ", 5)) {
+            int id = snapshot_get(skip_fields(line, 1));
+            if(id < 0) fprintf(out, "error cannot load '%s'\n", line+5);
+            else fprintf(out, "ok %d\n", id);
+        } else if(sscanf(line, "run %llu %zu", &cycles, &in_len) == 2) {
+            uint8_t *data;
+            if(in_len > MAX_INPUT) {
+                fprintf(out, "error input too long\n");
+                break;
+            }
+            if(!(data = malloc(in_len+1))) die("[Error] Out of memory\n");
+            if(fread(data, 1, in_len, in) != in_len) {
+                free(data);
+                break;
+            }
+            server_job(out, skip_fields(line, 3), cycles, data, in_len);
+            free(data);
+        } else fprintf(out, "error bad request\n");
+        (void)fflush(out);
+    }
+    free(line);
+}
+
+int server_run(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int sock;
+
+    (void)signal(SIGPIPE, SIG_IGN);
+    if(!path) {
+        server_session(stdin, stdout);
+        return 0;
+    }
+
+    if(strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "[Error] Socket path too long\n");
+        return -1;
+    }
+    (void)strcpy(addr.sun_path, path);
+    (void)unlink(path);
+    if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+       || bind(sock, (struct sockaddr *)&addr, sizeof addr)
+       || listen(sock, 16)) {
+        perror(path);
+        return -1;
+    }
+
+    for(;;) {
+        FILE *in, *out;
+        int fd = accept(sock, NULL, NULL), fd2;
+        if(fd < 0) {
+            if(errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        if((fd2 = dup(fd)) < 0 || !(in = fdopen(fd, "r"))) {
+            perror("fdopen");
+            (void)close(fd);
+            continue;
+        }
+        if(!(out = fdopen(fd2, "w"))) {
+            perror("fdopen");
+            (void)fclose(in);
+            (void)close(fd2);
+            continue;
+        }
+        server_session(in, out);
+        (void)fclose(in);
+        (void)fclose(out);
+    }
+    (void)close(sock);
+    return -1;
+}
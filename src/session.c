@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include <emu6502/session.h>
+#include <emu6502/cpu.h>
+#include <emu6502/machine.h>
+#include <emu6502/stats.h>
+#include <emu6502/utils.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/* Interactive sessions, one machine per connection on a Unix socket with
+ * its console at $3ff0 on the connection.
+ *
+ * Every machine is a copy of the one the command line booted and runs as
+ * a coroutine on a stack of its own. A few worker threads, one per core
+ * by default, each multiplex the sessions they accepted: a session runs
+ * until it reads $3ff0 with nothing received, can't get its output out,
+ * or has run SESSION_SLICE cycles, and then yields to its worker, which
+ * waits in epoll for the connections parked on input or output. Output
+ * is sent at the end of every slice and before waiting for input, so
+ * prompts arrive. A session ends when its machine halts, when it reads
+ * $3ff0 again after getting $ff for the client closing its end, or when
+ * the connection breaks.
+ *
+ * Sessions stay on the worker that accepted them, so thread-local state
+ * like current_machine and the fusion cache is always that of the thread
+ * they run on. Workers share nothing but the listening socket and the
+ * booted machine, which they only copy from. */
+
+#define SESSION_SLICE  20000
+#define SESSION_STACK  (128<<10)
+#define SESSION_BUF    4096
+#define SESSION_EVENTS 64
+#define MAX_WORKERS    64
+#if MAX_WORKERS >= STATS_MAX_THREADS
+#error "session workers need a stats slot each"
+#endif
+
+enum session_state {
+    SESSION_RUNNABLE,
+    SESSION_RUNNING,
+    SESSION_WAITING,
+    SESSION_DONE,
+};
+
+typedef struct session {
+    machine_t machine;
+    struct worker *w;
+    int fd;
+    enum session_state state;
+    /* read end closed, 2 once that was seen, connection broken */
+    int eof, gone;
+    ucontext_t ctx;
+    void *stack;
+    uint8_t in[SESSION_BUF];
+    size_t in_pos, in_len;
+    uint8_t out[SESSION_BUF];
+    size_t out_len;
+    /* run queue */
+    struct session *next;
+} session_t;
+
+typedef struct worker {
+    pthread_t thread;
+    int epoll;
+    ucontext_t sched;
+    session_t *run_head, *run_tail;
+    unsigned n_run;
+} worker_t;
+
+static const machine_t *template;
+static int listen_fd = -1;
+static size_t page_size;
+
+/* the session running on this thread */
+static __thread session_t *session_self = NULL;
+
+static void session_ready(worker_t *w, session_t *s) {
+    s->state = SESSION_RUNNABLE;
+    s->next = NULL;
+    if(w->run_tail) w->run_tail->next = s;
+    else w->run_head = s;
+    w->run_tail = s;
+    w->n_run++;
+}
+
+/* back to the worker until the connection is ready for events */
+static void session_wait(session_t *s, uint32_t events) {
+    struct epoll_event ev;
+    ev.events = events | EPOLLONESHOT;
+    ev.data.ptr = s;
+    if(epoll_ctl(s->w->epoll, EPOLL_CTL_MOD, s->fd, &ev)) {
+        s->gone = 1;
+        return;
+    }
+    s->state = SESSION_WAITING;
+    (void)swapcontext(&s->ctx, &s->w->sched);
+}
+
+/* send what the machine printed, waiting for room if wait is set */
+static void session_flush(session_t *s, int wait) {
+    size_t off = 0;
+    while(off < s->out_len && !s->gone) {
+        ssize_t n = write(s->fd, s->out + off, s->out_len - off);
+        if(n > 0) off += n;
+        else if(n < 0 && errno == EINTR) continue;
+        else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if(!wait) break;
+            session_wait(s, EPOLLOUT);
+        } else s->gone = 1;
+    }
+    if(s->gone) off = s->out_len;
+    (void)memmove(s->out, s->out + off, s->out_len - off);
+    s->out_len -= off;
+}
+
+static uint8_t session_in(void *data) {
+    session_t *s = data;
+    while(s->in_pos == s->in_len) {
+        ssize_t n;
+        /* $ff once like past the end of a job's input, then it's over */
+        if(s->eof == 1 && !s->gone) {
+            s->eof = 2;
+            return 0xff;
+        }
+        if(s->eof || s->gone) {
+            cpu_halt = HALT_USER;
+            return 0xff;
+        }
+        if((n = read(s->fd, s->in, sizeof s->in)) > 0) {
+            s->in_pos = 0;
+            s->in_len = n;
+        } else if(n < 0 && errno == EINTR) continue;
+        else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            session_flush(s, 1);
+            if(!s->gone) session_wait(s, EPOLLIN);
+        } else if(n == 0) s->eof = 1;
+        else s->gone = 1;
+    }
+    return s->in[s->in_pos++];
+}
+
+static void session_out(void *data, uint8_t val) {
+    session_t *s = data;
+    if(s->out_len == sizeof s->out) session_flush(s, 1);
+    if(s->gone) {
+        cpu_halt = HALT_USER;
+        return;
+    }
+    s->out[s->out_len++] = val;
+}
+
+/* the coroutine, returns to the worker at every yield and never ends */
+static void session_main(void) {
+    session_t *s = session_self;
+    while(!s->machine.halt && !s->gone) {
+        cpu_run_for(SESSION_SLICE);
+        session_flush(s, 0);
+        if(s->machine.halt) break;
+        s->state = SESSION_RUNNABLE;
+        (void)swapcontext(&s->ctx, &s->w->sched);
+    }
+    session_flush(s, 1);
+    s->state = SESSION_DONE;
+    (void)swapcontext(&s->ctx, &s->w->sched);
+}
+
+static void session_free(session_t *s) {
+    (void)close(s->fd);
+    machine_release(&s->machine);
+    (void)munmap(s->stack, SESSION_STACK);
+    free(s);
+}
+
+static int session_new(worker_t *w, int fd) {
+    struct epoll_event ev;
+    session_t *s;
+
+    if(!(s = calloc(1, sizeof *s))) die("[Error] Out of memory\n");
+    s->stack = mmap(NULL, SESSION_STACK, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_STACK, -1, 0);
+    if(s->stack == MAP_FAILED) {
+        free(s);
+        return -1;
+    }
+    /* guard page, stacks grow down */
+    (void)mprotect(s->stack, page_size, PROT_NONE);
+
+    if(machine_copy(&s->machine, template)) {
+        (void)munmap(s->stack, SESSION_STACK);
+        free(s);
+        return -1;
+    }
+    s->machine.flags &= ~MACHINE_STDIO;
+    s->machine.console_in = session_in;
+    s->machine.console_out = session_out;
+    s->machine.console = s;
+    s->w = w;
+    s->fd = fd;
+
+    (void)getcontext(&s->ctx);
+    s->ctx.uc_stack.ss_sp = s->stack;
+    s->ctx.uc_stack.ss_size = SESSION_STACK;
+    s->ctx.uc_link = NULL;
+    makecontext(&s->ctx, session_main, 0);
+
+    /* armed only while waiting */
+    ev.events = EPOLLONESHOT;
+    ev.data.ptr = s;
+    if(epoll_ctl(w->epoll, EPOLL_CTL_ADD, fd, &ev)) {
+        s->fd = -1;
+        session_free(s);
+        return -1;
+    }
+    session_ready(w, s);
+    return 0;
+}
+
+static void session_resume(worker_t *w, session_t *s) {
+    machine_select(&s->machine);
+    session_self = s;
+    s->state = SESSION_RUNNING;
+    (void)swapcontext(&w->sched, &s->ctx);
+    session_self = NULL;
+    if(s->state == SESSION_RUNNABLE) session_ready(w, s);
+    else if(s->state == SESSION_DONE) session_free(s);
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    struct epoll_event ev[SESSION_EVENTS];
+
+    (void)stats_thread_init();
+    for(;;) {
+        int n = epoll_wait(w->epoll, ev, SESSION_EVENTS, w->run_head ? 0 : -1);
+        unsigned k;
+        int i;
+
+        if(n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        for(i = 0; i < n; ++i) {
+            session_t *s = ev[i].data.ptr;
+            int fd;
+            /* one connection per wakeup spreads them over the workers */
+            if(!s) {
+                if((fd = accept4(listen_fd, NULL, NULL,
+                                 SOCK_NONBLOCK|SOCK_CLOEXEC)) < 0) {
+                    if(errno != EAGAIN && errno != EWOULDBLOCK
+                       && errno != EINTR && errno != ECONNABORTED)
+                        perror("accept");
+                } else if(session_new(w, fd)) (void)close(fd);
+            } else if(s->state == SESSION_WAITING) session_ready(w, s);
+        }
+        /* a slice each for what is runnable now, requeued ones go later */
+        for(k = w->n_run; k; --k) {
+            session_t *s = w->run_head;
+            if(!(w->run_head = s->next)) w->run_tail = NULL;
+            w->n_run--;
+            session_resume(w, s);
+        }
+    }
+    return NULL;
+}
+
+/* Serve sessions on the socket at path with copies of m, which is booted
+ * and stays untouched, on threads workers or one per core. Only returns
+ * on errors. */
+int session_run(const char *path, const machine_t *m, unsigned threads) {
+    static worker_t workers[MAX_WORKERS];
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct rlimit lim;
+    unsigned i;
+
+    if(m->memo) {
+        fprintf(stderr, "[Error] Memoized routines are shared unlocked, "
+                "sessions can't use them\n");
+        return -1;
+    }
+    if(m->flat) {
+        fprintf(stderr, "[Error] Machines with a flat view can't be copied, "
+                "sessions can't use them\n");
+        return -1;
+    }
+    /* a blocking read on it would stall every session of the worker */
+    if(m->doorbell >= 0) {
+        fprintf(stderr, "[Error] Sessions can't share a doorbell\n");
+        return -1;
+    }
+    if(strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "[Error] Socket path too long\n");
+        return -1;
+    }
+    if(!threads) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? n : 1;
+    }
+    if(threads > MAX_WORKERS) threads = MAX_WORKERS;
+    template = m;
+    page_size = sysconf(_SC_PAGESIZE);
+    (void)signal(SIGPIPE, SIG_IGN);
+    /* a descriptor per session */
+    if(!getrlimit(RLIMIT_NOFILE, &lim) && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        (void)setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    (void)strcpy(addr.sun_path, path);
+    (void)unlink(path);
+    if((listen_fd = socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,
+                           0)) < 0
+       || bind(listen_fd, (struct sockaddr *)&addr, sizeof addr)
+       || listen(listen_fd, SOMAXCONN)) {
+        perror(path);
+        return -1;
+    }
+
+    for(i = 0; i < threads; ++i) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN|EPOLLEXCLUSIVE;
+        ev.data.ptr = NULL;
+        if((workers[i].epoll = epoll_create1(EPOLL_CLOEXEC)) < 0
+           || epoll_ctl(workers[i].epoll, EPOLL_CTL_ADD, listen_fd, &ev)) {
+            perror("epoll");
+            return -1;
+        }
+        if(pthread_create(&workers[i].thread, NULL, worker_main,
+                          &workers[i])) {
+            fprintf(stderr, "[Error] Cannot start worker threads\n");
+            return -1;
+        }
+    }
+    for(i = 0; i < threads; ++i) (void)pthread_join(workers[i].thread, NULL);
+    return -1;
+}
@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 200809L
+#include <emu6502/shm.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Map SOURCE@ADDR[,SIZE] into the current machine, where SOURCE is
+ * shm:NAME for a POSIX shared memory object or a file path. Given a SIZE
+ * either is created if needed and grown to it, otherwise its current size
+ * is used.
+ * ADDR and SIZE have to be multiples of 256. The mapping stays for the
+ * life of the process, so copies of the machine share it too. */
+int shm_map(const char *spec) {
+    const char *at = strrchr(spec, '@');
+    unsigned long addr, size = 0;
+    char *src, *end;
+    struct stat st;
+    uint8_t *data;
+    int fd;
+
+    if(!at) goto bad;
+    addr = *++at == '$' ? strtoul(at+1, &end, 16) : strtoul(at, &end, 0);
+    if(*end == ',')
+        size = end[1] == '$' ? strtoul(end+2, &end, 16)
+                             : strtoul(end+1, &end, 0);
+    if(end == at || *end || addr > 0xffff) goto bad;
+
+    if(!(src = strndup(spec, at-1 - spec))) return -1;
+    if(!strncmp(src, "shm:", 4))
+        fd = shm_open(src+4, size ? O_RDWR|O_CREAT : O_RDWR, 0600);
+    else
+        fd = open(src, size ? O_RDWR|O_CREAT : O_RDWR, 0644);
+    if(fd < 0 || fstat(fd, &st)) {
+        perror(src);
+        free(src);
+        if(fd >= 0) (void)close(fd);
+        return -1;
+    }
+    if(!size) size = st.st_size;
+    if((unsigned long)st.st_size < size && ftruncate(fd, size)) {
+        perror(src);
+        free(src);
+        (void)close(fd);
+        return -1;
+    }
+    free(src);
+
+    data = size ? mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)
+                : MAP_FAILED;
+    (void)close(fd);
+    if(data == MAP_FAILED) goto bad;
+    if(memory_map_shared(data, addr, size)) {
+        (void)munmap(data, size);
+        goto bad;
+    }
+    return 0;
+
+bad:
+    fprintf(stderr, "[Error] Bad shared memory window '%s'\n", spec);
+    return -1;
+}
+
+/* Connect the current machine's doorbell at $3ff1 to a Unix stream socket
+ * some other process listens on. */
+int shm_doorbell_connect(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int fd;
+
+    if(strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "[Error] Socket path too long\n");
+        return -1;
+    }
+    (void)strcpy(addr.sun_path, path);
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+       || connect(fd, (struct sockaddr *)&addr, sizeof addr)) {
+        perror(path);
+        if(fd >= 0) (void)close(fd);
+        return -1;
+    }
+    current_machine->doorbell = fd;
+    return 0;
+}
+
+/* wait for the other side to ring, $ff once it hung up */
+uint8_t shm_doorbell_read(void) {
+    uint8_t val;
+    ssize_t n;
+    if(current_machine->doorbell < 0) return current_machine->data_bus;
+    while((n = read(current_machine->doorbell, &val, 1)) < 0
+          && errno == EINTR);
+    return n == 1 ? val : 0xff;
+}
+
+void shm_doorbell_write(uint8_t val) {
+    if(current_machine->doorbell < 0) return;
+    while(write(current_machine->doorbell, &val, 1) < 0 && errno == EINTR);
+}
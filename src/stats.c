@@ -0,0 +1,209 @@
+#define _POSIX_C_SOURCE 200809L
+#include <emu6502/stats.h>
+#include <emu6502/utils.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define MIN(a, b) ((a)<(b)?(a):(b))
+
+/* A slot counts for every thread that had it in turn, so nothing counted
+ * goes missing when threads come and go. stats_n_slots is how many were
+ * ever taken, for the dumps, which can't lock from signal handlers. */
+static stats_t stats_slots[STATS_MAX_THREADS];
+static uint8_t stats_taken[STATS_MAX_THREADS] = {1};
+static unsigned stats_n_slots = 1;
+__thread stats_t *stats_local = &stats_slots[0];
+
+static pthread_key_t stats_key;
+static pthread_once_t stats_key_once = PTHREAD_ONCE_INIT;
+
+static int stats_fd = -1;
+static unsigned stats_interval = 0;
+static uint64_t stats_last_instructions = 0;
+
+/* Dumps happen in signal handlers, so they format by hand into a buffer
+ * that goes out with write(). */
+typedef struct out {
+    int fd;
+    size_t len;
+    char buf[4096];
+} out_t;
+
+static void out_flush(out_t *o) {
+    size_t off = 0;
+    while(off < o->len) {
+        ssize_t n = write(o->fd, o->buf + off, o->len - off);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) break;
+        off += n;
+    }
+    o->len = 0;
+}
+
+static void out_str(out_t *o, const char *s) {
+    for(; *s; ++s) {
+        if(o->len == sizeof o->buf) out_flush(o);
+        o->buf[o->len++] = *s;
+    }
+}
+
+static void out_u64(out_t *o, uint64_t v) {
+    char tmp[21];
+    unsigned i = sizeof tmp - 1;
+    tmp[i] = '\0';
+    do tmp[--i] = '0' + v%10; while(v /= 10);
+    out_str(o, tmp + i);
+}
+
+static void out_field(out_t *o, const char *name, uint64_t v) {
+    out_str(o, "\"");
+    out_str(o, name);
+    out_str(o, "\": ");
+    out_u64(o, v);
+}
+
+static void out_addr(out_t *o, uint16_t addr) {
+    static const char digits[] = "0123456789abcdef";
+    char tmp[] = "\"0x0000\"";
+    unsigned i;
+    for(i = 0; i < 4; ++i) tmp[6-i] = digits[(addr >> 4*i) & 0xf];
+    out_str(o, tmp);
+}
+
+static unsigned stats_threads(void) {
+    return MIN(__atomic_load_n(&stats_n_slots, __ATOMIC_ACQUIRE),
+               STATS_MAX_THREADS);
+}
+
+/* the slot of a thread that exits is free for the next */
+static void stats_thread_exit(void *slot) {
+    __atomic_store_n(&stats_taken[(stats_t *)slot - stats_slots], 0,
+                     __ATOMIC_RELEASE);
+}
+
+static void stats_key_init(void) {
+    if(pthread_key_create(&stats_key, stats_thread_exit))
+        die("[Error] Can't make the stats key\n");
+}
+
+/* Give the calling thread counters of its own until it exits. With more
+ * threads running than slots it says so, stays on the first slot and
+ * returns -1. */
+int stats_thread_init(void) {
+    static int warned = 0;
+    unsigned slot, n;
+
+    (void)pthread_once(&stats_key_once, stats_key_init);
+    for(slot = 1; slot < STATS_MAX_THREADS; ++slot) {
+        uint8_t none = 0;
+        if(__atomic_compare_exchange_n(&stats_taken[slot], &none, 1, 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+    if(slot == STATS_MAX_THREADS) {
+        if(!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED))
+            fprintf(stderr, "[Error] More than %u threads, the rest count "
+                    "in the stats of thread 0\n", STATS_MAX_THREADS);
+        stats_local = &stats_slots[0];
+        return -1;
+    }
+    stats_local = &stats_slots[slot];
+    (void)pthread_setspecific(stats_key, stats_local);
+    n = __atomic_load_n(&stats_n_slots, __ATOMIC_RELAXED);
+    while(n <= slot && !__atomic_compare_exchange_n(&stats_n_slots, &n,
+                            slot+1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return 0;
+}
+
+/* write every thread's counters to fd as one line of JSON */
+void stats_dump(int fd) {
+    out_t o = {.fd = fd, .len = 0};
+    unsigned i, block, n = stats_threads();
+
+    out_str(&o, "{\"threads\": [");
+    for(i = 0; i < n; ++i) {
+        const stats_t *s = &stats_slots[i];
+        int first = 1;
+        out_str(&o, i ? ", {" : "{");
+        out_field(&o, "thread", i), out_str(&o, ", ");
+        out_field(&o, "instructions", s->instructions), out_str(&o, ", ");
+        out_field(&o, "cycles", s->cycles), out_str(&o, ", ");
+        out_field(&o, "reads", s->reads), out_str(&o, ", ");
+        out_field(&o, "writes", s->writes), out_str(&o, ", ");
+        out_field(&o, "illegal", s->illegal), out_str(&o, ", ");
+        out_field(&o, "fuse_hits", s->fuse_hits), out_str(&o, ", ");
+        out_field(&o, "fuse_misses", s->fuse_misses), out_str(&o, ", ");
+        out_field(&o, "memo_hits", s->memo_hits), out_str(&o, ", ");
+        out_field(&o, "memo_misses", s->memo_misses), out_str(&o, ", ");
+        out_field(&o, "resets", s->resets), out_str(&o, ", ");
+        out_field(&o, "device_syncs", s->device_syncs), out_str(&o, ", ");
+        out_str(&o, "\"devices\": [");
+        for(block = 0; block < 0x1000; ++block) {
+            if(!s->device_reads[block] && !s->device_writes[block]) continue;
+            out_str(&o, first ? "{\"addr\": " : ", {\"addr\": ");
+            out_addr(&o, block<<4), out_str(&o, ", ");
+            out_field(&o, "reads", s->device_reads[block]), out_str(&o, ", ");
+            out_field(&o, "writes", s->device_writes[block]);
+            out_str(&o, "}");
+            first = 0;
+        }
+        out_str(&o, "]}");
+    }
+    out_str(&o, "]}\n");
+    out_flush(&o);
+}
+
+static void stats_sample(void) {
+    out_t o = {.fd = stats_fd, .len = 0};
+    uint64_t total = 0;
+    unsigned i, n = stats_threads();
+    for(i = 0; i < n; ++i) total += stats_slots[i].instructions;
+    out_str(&o, "{");
+    out_field(&o, "instructions_per_sec",
+              (total - stats_last_instructions) / stats_interval);
+    out_str(&o, "}\n");
+    out_flush(&o);
+    stats_last_instructions = total;
+}
+
+static void stats_signal(int sig) {
+    int saved = errno;
+    if(sig == SIGUSR1) stats_dump(stats_fd);
+    else stats_sample();
+    errno = saved;
+}
+
+static void stats_exit(void) {
+    stats_dump(stats_fd);
+}
+
+/* Dump to path (stderr if NULL) on SIGUSR1 and at exit, and sample the
+ * instruction rate every interval seconds if it isn't 0. */
+int stats_enable(const char *path, unsigned interval) {
+    struct sigaction sa;
+
+    if(!path) stats_fd = STDERR_FILENO;
+    else if((stats_fd = open(path, O_WRONLY|O_CREAT|O_APPEND, 0644)) < 0)
+        return -1;
+
+    (void)memset(&sa, 0, sizeof sa);
+    sa.sa_handler = stats_signal;
+    sa.sa_flags = SA_RESTART;
+    (void)sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGUSR1, &sa, NULL);
+    (void)atexit(stats_exit);
+
+    if((stats_interval = interval)) {
+        struct itimerval it = {{interval, 0}, {interval, 0}};
+        (void)sigaction(SIGALRM, &sa, NULL);
+        (void)setitimer(ITIMER_REAL, &it, NULL);
+    }
+    return 0;
+}
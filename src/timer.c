@@ -0,0 +1,130 @@
+#include <emu6502/timer.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/utils.h>
+#include <stdlib.h>
+
+/* A 16 bit timer counting down once a cycle, a lazy device: it only does
+ * work when it is accessed or runs out. Its registers:
+ *
+ *   +0 +1  the count when read, the latch when written, low byte first;
+ *          writing the high byte loads the count from the latch and starts
+ *          it, a latch of 0 counting 65536 cycles
+ *   +2     control, see timer.h
+ *   +3     status, see timer.h, cleared by reading it
+ *
+ * It runs out when the count reaches 0, then stops there or, with
+ * TIMER_CONTINUOUS, starts over from the latch. With TIMER_HALT running
+ * out stops the machine like a write to $3fff, which makes it a watchdog
+ * the program has to keep reloading. Nothing raises interrupts, programs
+ * poll the status instead. */
+
+typedef struct timer_dev {
+    memory_device_t dev;
+    uint16_t latch;
+    /* the count while stopped */
+    uint16_t count;
+    uint8_t ctrl, status;
+    int running;
+    /* cycle the count was loaded at */
+    uint64_t start;
+} timer_dev_t;
+
+static void timer_read(uint8_t *, uint16_t);
+static void timer_write(uint8_t *, uint16_t);
+static memory_device_t *timer_new(void);
+
+static const memory_map_entry_t timer_entry = {
+    .read = timer_read,
+    .write = timer_write,
+    .lazy = timer_new,
+    .name = "timer",
+};
+
+static uint32_t timer_period(const timer_dev_t *t) {
+    return t->latch ? t->latch : 0x10000;
+}
+
+/* every time it ran out up to cycle */
+static void timer_catch_up(memory_device_t *dev, uint64_t cycle) {
+    timer_dev_t *t = (timer_dev_t *)dev;
+    uint32_t period = timer_period(t);
+
+    if(!t->running || dev->next_event > cycle) return;
+    t->status |= TIMER_DONE;
+    if(t->ctrl & TIMER_HALT) cpu_halt = HALT_DEVICE;
+    if(t->ctrl & TIMER_CONTINUOUS) {
+        dev->next_event += ((cycle - dev->next_event) / period + 1) * period;
+        return;
+    }
+    t->running = 0;
+    t->count = 0;
+    dev->next_event = UINT64_MAX;
+}
+
+static memory_device_t *timer_copy(const memory_device_t *dev) {
+    timer_dev_t *t;
+    if(!(t = malloc(sizeof *t))) die("[Error] Out of memory\n");
+    *t = *(const timer_dev_t *)dev;
+    return &t->dev;
+}
+
+static void timer_free(memory_device_t *dev) {
+    free(dev);
+}
+
+static int timer_diff(const memory_device_t *a, const memory_device_t *b) {
+    const timer_dev_t *ta = (const timer_dev_t *)a;
+    const timer_dev_t *tb = (const timer_dev_t *)b;
+    return ta->latch != tb->latch || ta->count != tb->count
+        || ta->ctrl != tb->ctrl || ta->status != tb->status
+        || ta->running != tb->running || ta->start != tb->start;
+}
+
+static memory_device_t *timer_new(void) {
+    timer_dev_t *t;
+    if(!(t = calloc(1, sizeof *t))) die("[Error] Out of memory\n");
+    t->dev.catch_up = timer_catch_up;
+    t->dev.copy = timer_copy;
+    t->dev.free = timer_free;
+    t->dev.diff = timer_diff;
+    t->dev.next_event = UINT64_MAX;
+    return &t->dev;
+}
+
+/* the count now, the device being caught up */
+static uint16_t timer_count(const timer_dev_t *t) {
+    uint64_t elapsed = current_machine->cycles - t->start;
+    uint32_t period = timer_period(t);
+    if(!t->running) return t->count;
+    return period - elapsed % period;
+}
+
+static void timer_read(uint8_t *bus, uint16_t addr) {
+    timer_dev_t *t = (timer_dev_t *)memory_device(&timer_entry);
+    switch(addr & 0xf) {
+    case 0x0: *bus = timer_count(t); break;
+    case 0x1: *bus = timer_count(t)>>8; break;
+    case 0x2: *bus = t->ctrl; break;
+    case 0x3: *bus = t->status; t->status = 0; break;
+    }
+}
+
+static void timer_write(uint8_t *bus, uint16_t addr) {
+    timer_dev_t *t = (timer_dev_t *)memory_device(&timer_entry);
+    switch(addr & 0xf) {
+    case 0x0: t->latch = (t->latch & 0xff00) | *bus; break;
+    case 0x1:
+        t->latch = (t->latch & 0x00ff) | *bus<<8;
+        t->running = 1;
+        t->start = current_machine->cycles;
+        memory_schedule(&t->dev, t->start + timer_period(t));
+        break;
+    case 0x2: t->ctrl = *bus; break;
+    }
+}
+
+/* Only in maps of their own, see memory_map_page(), for config.c. */
+void timer_map_at(uint16_t addr) {
+    memory_map_page(&timer_entry, addr);
+}
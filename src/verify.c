@@ -0,0 +1,428 @@
+#define _POSIX_C_SOURCE 200809L
+#include <emu6502/verify.h>
+#include <emu6502/cpu.h>
+#include <emu6502/decoding.h>
+#include <emu6502/fusion.h>
+#include <emu6502/machine.h>
+#include <emu6502/memory.h>
+#include <emu6502/stats.h>
+#include <emu6502/utils.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Checking a long run against another engine on every core.
+ *
+ * The machine runs once on the fused engine, as it would without
+ * checking. Every segment cycles it keeps a copy of itself as a
+ * checkpoint, and everything read from and written to the console goes
+ * into a log. Then worker threads replay the segments between
+ * consecutive checkpoints, each from a copy of the first one with the
+ * console fed from the log. Every replay has to end in exactly the state
+ * of the second checkpoint: registers, cycles, memory, the DMA
+ * controller and the console positions. Output that differs from the
+ * log, or reads past its end, fail the segment right away.
+ *
+ * Segments are independent, so the wall time goes down with the number
+ * of threads. A segment that fails is replayed again to find the
+ * instruction. Replaying it on the fused engine up to some cycle and on
+ * the plain interpreter to the same place, then comparing, shows whether
+ * they went apart before that point, and bisecting on the cycle narrows
+ * it down to one step of the fused engine. This assumes states that
+ * differ stay different, which holds unless the difference gets
+ * overwritten before the end of the segment.
+ *
+ * Checkpoints are whole machines, so the run can't share writable memory
+ * with other processes, ring a doorbell or use memoized calls. */
+
+#define MAX_THREADS 64
+#if MAX_THREADS >= STATS_MAX_THREADS
+#error "verify threads need a stats slot each"
+#endif
+
+typedef struct checkpoint {
+    machine_t m;
+    /* console bytes read and written before it */
+    size_t in, out;
+} checkpoint_t;
+
+typedef struct verify_log {
+    uint8_t *data;
+    size_t len, size;
+} verify_log_t;
+
+/* a machine replaying part of the run and its place in the logs */
+typedef struct replay {
+    machine_t m;
+    size_t in, out;
+    /* read past or wrote something else than the recorded run */
+    int off_log;
+    uint64_t instructions;
+} replay_t;
+
+static checkpoint_t **checkpoints;
+static unsigned n_checkpoints;
+static verify_log_t log_in, log_out;
+static uint64_t segment;
+static enum verify_engine engine;
+
+/* work for the threads */
+static unsigned next_segment, first_bad;
+static uint64_t *segment_instructions;
+
+static const char *const engine_names[] = {
+    [VERIFY_STEP] = "step",
+    [VERIFY_FUSED] = "fused",
+};
+
+static double verify_now(void) {
+    struct timespec t;
+    (void)clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void log_push(verify_log_t *l, uint8_t val) {
+    if(l->len == l->size) {
+        uint8_t *data;
+        l->size = l->size ? l->size * 2 : 4096;
+        if(!(data = realloc(l->data, l->size))) die("[Error] Out of memory\n");
+        l->data = data;
+    }
+    l->data[l->len++] = val;
+}
+
+static uint8_t record_in(void *data) {
+    uint8_t val = (uint8_t)getchar();
+    (void)data;
+    log_push(&log_in, val);
+    return val;
+}
+
+static void record_out(void *data, uint8_t val) {
+    (void)data;
+    (void)putchar(val);
+    log_push(&log_out, val);
+}
+
+static uint8_t replay_in(void *data) {
+    replay_t *r = data;
+    if(r->in < log_in.len) return log_in.data[r->in++];
+    r->off_log = 1;
+    cpu_halt = HALT_USER;
+    return 0xff;
+}
+
+static void replay_out(void *data, uint8_t val) {
+    replay_t *r = data;
+    if(r->out >= log_out.len || log_out.data[r->out] != val) {
+        r->off_log = 1;
+        cpu_halt = HALT_USER;
+    }
+    r->out++;
+}
+
+static void checkpoint(const machine_t *m) {
+    checkpoint_t *c, **list;
+    if(!(c = malloc(sizeof *c))) die("[Error] Out of memory\n");
+    (void)machine_copy(&c->m, m);
+    c->in = log_in.len;
+    c->out = log_out.len;
+    if(!(list = realloc(checkpoints, (n_checkpoints+1) * sizeof *list)))
+        die("[Error] Out of memory\n");
+    checkpoints = list;
+    checkpoints[n_checkpoints++] = c;
+}
+
+/* the run itself, on the console of m */
+static void verify_record(machine_t *m) {
+    unsigned flags = m->flags;
+    m->flags &= ~MACHINE_STDIO;
+    m->console_in = record_in;
+    m->console_out = record_out;
+    m->console = NULL;
+
+    checkpoint(m);
+    while(!m->halt) {
+        cpu_run_for(segment);
+        checkpoint(m);
+    }
+    (void)fflush(stdout);
+    m->flags = flags;
+    m->console_in = NULL;
+    m->console_out = NULL;
+}
+
+static replay_t *replay_new(unsigned k) {
+    const checkpoint_t *c = checkpoints[k];
+    replay_t *r;
+    if(!(r = calloc(1, sizeof *r))) die("[Error] Out of memory\n");
+    (void)machine_copy(&r->m, &c->m);
+    r->m.console_in = replay_in;
+    r->m.console_out = replay_out;
+    r->m.console = r;
+    r->in = c->in;
+    r->out = c->out;
+    return r;
+}
+
+static void replay_free(replay_t *r) {
+    machine_release(&r->m);
+    free(r);
+}
+
+/* the plain interpreter until cycles or a halt */
+static void replay_step(replay_t *r, uint64_t cycles) {
+    machine_select(&r->m);
+    while(!r->m.halt && r->m.cycles < cycles) {
+        cpu_step();
+        r->instructions++;
+    }
+}
+
+/* the engine of the run, the way verify_record() ran it */
+static void replay_fused(replay_t *r, uint64_t cycles) {
+    machine_select(&r->m);
+    if(!r->m.halt) fusion_run_until(cycles);
+}
+
+/* 0 if a is in the state b was recorded in, else what differs first is
+ * described in what */
+static int verify_diff(const machine_t *a, const machine_t *b,
+                       char *what, size_t size) {
+    static const char *const regs[] = {"A", "X", "Y", "S", "P"};
+    const uint8_t va[] = {a->cpu.a, a->cpu.x, a->cpu.y, a->cpu.s, a->cpu.p};
+    const uint8_t vb[] = {b->cpu.a, b->cpu.x, b->cpu.y, b->cpu.s, b->cpu.p};
+    const memory_map_entry_t *dev;
+    unsigned i, page;
+
+    if(a->cycles != b->cycles) {
+        (void)snprintf(what, size, "cycle %llu, recorded %llu",
+                       (unsigned long long)a->cycles,
+                       (unsigned long long)b->cycles);
+        return 1;
+    }
+    if(a->halt != b->halt) {
+        (void)snprintf(what, size, "%s", a->halt ? "halted, recorded running"
+                                                 : "running, recorded halted");
+        return 1;
+    }
+    if(a->cpu.pc != b->cpu.pc) {
+        (void)snprintf(what, size, "PC $%04x, recorded $%04x",
+                       a->cpu.pc, b->cpu.pc);
+        return 1;
+    }
+    for(i = 0; i < sizeof va; ++i)
+        if(va[i] != vb[i]) {
+            (void)snprintf(what, size, "%s $%02x, recorded $%02x", regs[i],
+                           va[i], vb[i]);
+            return 1;
+        }
+    for(page = 0x00; page < 0x100; ++page) {
+        const uint8_t *pa = a->page_data[page], *pb = b->page_data[page];
+        if(!pa || !pb) {
+            if(pa == pb) continue;
+            (void)snprintf(what, size, "page $%02x mapped differently", page);
+            return 1;
+        }
+        if(!memcmp(pa, pb, 0x100)) continue;
+        for(i = 0; pa[i] == pb[i]; ++i);
+        (void)snprintf(what, size, "$%04x = $%02x, recorded $%02x",
+                       page<<8 | i, pa[i], pb[i]);
+        return 1;
+    }
+    if((dev = memory_device_diff(a, b))) {
+        (void)snprintf(what, size, "%s device in another state",
+                       dev->name ? dev->name : "lazy");
+        return 1;
+    }
+    if(memcmp(&a->dma, &b->dma, sizeof a->dma)) {
+        (void)snprintf(what, size, "DMA registers");
+        return 1;
+    }
+    if(a->data_bus != b->data_bus) {
+        (void)snprintf(what, size, "data bus $%02x, recorded $%02x",
+                       a->data_bus, b->data_bus);
+        return 1;
+    }
+    return 0;
+}
+
+/* 0 if r is where c is, console included */
+static int replay_diff(const replay_t *r, const replay_t *c,
+                       size_t in, size_t out, char *what, size_t size) {
+    if(r->off_log) {
+        (void)snprintf(what, size, "console differs from the log at byte "
+                       "%zu in, %zu out", r->in, r->out);
+        return 1;
+    }
+    if(c && c->off_log) {
+        (void)snprintf(what, size, "the recording engine leaves the log");
+        return 1;
+    }
+    if(r->in != in || r->out != out) {
+        (void)snprintf(what, size, "console at byte %zu in, %zu out, "
+                       "recorded %zu, %zu", r->in, r->out, in, out);
+        return 1;
+    }
+    return 0;
+}
+
+/* 0 if replaying segment k ends at the next checkpoint */
+static int verify_segment(unsigned k) {
+    const checkpoint_t *end = checkpoints[k+1];
+    replay_t *r = replay_new(k);
+    char what[128];
+    int bad;
+
+    if(engine == VERIFY_FUSED)
+        replay_fused(r, checkpoints[k]->m.cycles + segment);
+    else replay_step(r, end->m.cycles);
+    bad = replay_diff(r, NULL, end->in, end->out, what, sizeof what)
+       || verify_diff(&r->m, &end->m, what, sizeof what);
+    segment_instructions[k] = r->instructions;
+    replay_free(r);
+    return bad;
+}
+
+static void *verify_worker(void *arg) {
+    (void)arg;
+    (void)stats_thread_init();
+    for(;;) {
+        unsigned k = __atomic_fetch_add(&next_segment, 1, __ATOMIC_RELAXED);
+        /* segments after a bad one don't matter anymore */
+        if(k + 1 >= n_checkpoints || k > __atomic_load_n(&first_bad,
+                                                        __ATOMIC_RELAXED))
+            break;
+        if(verify_segment(k)) {
+            unsigned bad = __atomic_load_n(&first_bad, __ATOMIC_RELAXED);
+            while(k < bad && !__atomic_compare_exchange_n(&first_bad, &bad, k,
+                             0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        }
+    }
+    return NULL;
+}
+
+/* The engine of the run from checkpoint k to the first of its stops from
+ * cycle t on, and the plain interpreter as far. 0 if they agree, what is
+ * filled in otherwise. The interpreter is left in *ref. */
+static int verify_probe(unsigned k, uint64_t t, replay_t **ref,
+                        char *what, size_t size) {
+    replay_t *p = replay_new(k), *r = replay_new(k);
+    int bad;
+
+    replay_fused(p, t);
+    replay_step(r, p->m.cycles);
+    bad = replay_diff(r, p, p->in, p->out, what, size)
+       || verify_diff(&r->m, &p->m, what, size);
+    replay_free(p);
+    if(*ref) replay_free(*ref);
+    *ref = r;
+    return bad;
+}
+
+/* narrow the failed segment k down to a step of the recording engine */
+static void verify_locate(FILE *f, unsigned k) {
+    uint64_t lo = checkpoints[k]->m.cycles, hi = lo + segment, before = 0;
+    replay_t *r = NULL;
+    char what[128];
+    unsigned i;
+    uint8_t op;
+
+    if(!verify_probe(k, hi, &r, what, sizeof what)) {
+        fprintf(f, "The interpreter agrees with the recording engine "
+                "replayed, the run itself isn't reproducible\n");
+        replay_free(r);
+        return;
+    }
+    while(hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if(verify_probe(k, mid, &r, what, sizeof what)) hi = mid;
+        else lo = mid;
+    }
+    (void)verify_probe(k, hi, &r, what, sizeof what);
+    (void)verify_probe(k, lo, &r, NULL, 0);
+
+    for(i = 0; i < k; ++i) before += segment_instructions[i];
+    machine_select(&r->m);
+    fprintf(f, "First diverging at instruction %llu, cycle %llu, $%04x",
+            (unsigned long long)(before + r->instructions),
+            (unsigned long long)r->m.cycles, r->m.cpu.pc);
+    if(memory_peek(r->m.cpu.pc, &op))
+        fprintf(f, ": $%02x %s %s", op,
+                instr_type_str(r->m.variant->table[op].type),
+                instr_mode_str(r->m.variant->table[op].mode));
+    fprintf(f, "\nAfter it the interpreter has %s\n", what);
+    replay_free(r);
+}
+
+/* Run m, selected and reset, to its halt in segments of cycles, then
+ * replay them on threads threads or one per core to check them. 0 if
+ * all of them match, 1 if one doesn't and -1 if m can't be checked. */
+int verify_run(machine_t *m, enum verify_engine e, uint64_t cycles,
+               unsigned threads) {
+    pthread_t workers[MAX_THREADS];
+    double t0, t1, t2;
+    unsigned i, n;
+    int ret = 0;
+
+    if(m->memo || m->flat || m->doorbell >= 0 || memory_machine_shared(m)) {
+        fprintf(stderr, "[Error] Only machines of their own can be checked, "
+                "without shared memory, a doorbell, memoized calls or a "
+                "flat view\n");
+        return -1;
+    }
+    if(!threads) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? online : 1;
+    }
+    if(threads > MAX_THREADS) threads = MAX_THREADS;
+    segment = cycles ? cycles : 1;
+    engine = e;
+
+    t0 = verify_now();
+    verify_record(m);
+    t1 = verify_now();
+
+    if(!(segment_instructions = calloc(n_checkpoints,
+                                       sizeof *segment_instructions)))
+        die("[Error] Out of memory\n");
+    next_segment = 0;
+    first_bad = n_checkpoints;
+    for(n = 0; n < threads && n + 1 < n_checkpoints; ++n)
+        if(pthread_create(&workers[n], NULL, verify_worker, NULL)) break;
+    if(!n) (void)verify_worker(NULL);
+    for(i = 0; i < n; ++i) (void)pthread_join(workers[i], NULL);
+    t2 = verify_now();
+    machine_select(m);
+
+    fprintf(stderr, "-----\nRecorded %u segment%s of %llu cycles in %.3fs, "
+            "replayed on the %s engine on %u thread%s in %.3fs\n",
+            n_checkpoints - 1, n_checkpoints == 2 ? "" : "s",
+            (unsigned long long)segment, t1 - t0, engine_names[e],
+            n ? n : 1, n > 1 ? "s" : "", t2 - t1);
+    if(first_bad < n_checkpoints) {
+        unsigned k = first_bad;
+        fprintf(stderr, "Segment %u, cycles %llu to %llu, diverges\n", k,
+                (unsigned long long)checkpoints[k]->m.cycles,
+                (unsigned long long)checkpoints[k+1]->m.cycles);
+        if(e == VERIFY_STEP) verify_locate(stderr, k);
+        machine_select(m);
+        ret = 1;
+    } else fprintf(stderr, "Every segment matches\n");
+
+    for(i = 0; i < n_checkpoints; ++i) {
+        machine_release(&checkpoints[i]->m);
+        free(checkpoints[i]);
+    }
+    machine_select(m);
+    free(checkpoints);
+    free(segment_instructions);
+    free(log_in.data);
+    free(log_out.data);
+    checkpoints = NULL;
+    n_checkpoints = 0;
+    return ret;
+}
@@ -0,0 +1,155 @@
+#include <emu6502/emu6502.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* ADC and SBC immediate of every variant and engine against a model of
+ * the chips, for every accumulator, operand, carry and decimal flag.
+ *
+ * The NMOS model is the one of VICE, which passes the decimal mode tests
+ * made on real 6510s. The 65C02 one follows the appendix of Bruce Clark's
+ * "Decimal Mode" tutorial on 6502.org: the accumulator of ADC is the NMOS
+ * one, SBC subtracts in binary and corrects by $60 and $06 where the high
+ * and the low digit borrowed, N and Z come from the result, and decimal
+ * mode takes a cycle more. The 2A03 has no decimal mode. */
+
+#define N 0x80
+#define V 0x40
+#define D 0x08
+#define Z 0x02
+#define C 0x01
+
+enum variant {NMOS, CMOS, RICOH};
+
+typedef struct result {
+    uint8_t a, p;
+    unsigned cycles;
+} result_t;
+
+static uint8_t nz(uint8_t v) {
+    return (v & N) | (v ? 0 : Z);
+}
+
+static void ref_binary(int sbc, uint8_t a, uint8_t b, int c, result_t *r) {
+    unsigned sum;
+    if(sbc) b = ~b;
+    sum = a + b + c;
+    r->a = sum;
+    r->p = nz(sum) | (sum > 0xff ? C : 0)
+         | ((a ^ sum) & (b ^ sum) & 0x80 ? V : 0);
+}
+
+static void ref_adc_nmos(uint8_t a, uint8_t b, int c, result_t *r) {
+    unsigned t = (a & 0xf) + (b & 0xf) + c;
+    if(t > 0x9) t += 6;
+    if(t <= 0xf) t = (t & 0xf) + (a & 0xf0) + (b & 0xf0);
+    else t = (t & 0xf) + (a & 0xf0) + (b & 0xf0) + 0x10;
+    r->p = (t & N) | ((a + b + c) & 0xff ? 0 : Z)
+         | (((a ^ t) & 0x80) && !((a ^ b) & 0x80) ? V : 0);
+    if((t & 0x1f0) > 0x90) t += 0x60;
+    r->p |= (t & 0xff0) > 0xf0 ? C : 0;
+    r->a = t;
+}
+
+static void ref_sbc_nmos(uint8_t a, uint8_t b, int c, result_t *r) {
+    unsigned bin = a - b - !c, t = (a & 0xf) - (b & 0xf) - !c;
+    if(t & 0x10) t = ((t - 6) & 0xf) | ((a & 0xf0) - (b & 0xf0) - 0x10);
+    else t = (t & 0xf) | ((a & 0xf0) - (b & 0xf0));
+    if(t & 0x100) t -= 0x60;
+    r->a = t;
+    r->p = nz(bin) | (bin < 0x100 ? C : 0)
+         | (((a ^ bin) & 0x80) && ((a ^ b) & 0x80) ? V : 0);
+}
+
+static void ref_decimal(enum variant v, int sbc, uint8_t a, uint8_t b, int c,
+                        result_t *r) {
+    result_t bin;
+    int diff;
+
+    if(v == NMOS) {
+        if(sbc) ref_sbc_nmos(a, b, c, r);
+        else ref_adc_nmos(a, b, c, r);
+        return;
+    }
+    if(!sbc) {
+        ref_adc_nmos(a, b, c, r);
+        r->p = (r->p & (V|C)) | nz(r->a);
+        return;
+    }
+    ref_binary(1, a, b, c, &bin);
+    diff = a - b - !c;
+    if(diff < 0) diff -= 0x60;
+    if((a & 0xf) - (b & 0xf) - !c < 0) diff -= 0x06;
+    r->a = diff;
+    r->p = (bin.p & (V|C)) | nz(r->a);
+}
+
+static void reference(enum variant v, int sbc, int decimal, uint8_t a,
+                      uint8_t b, int c, result_t *r) {
+    r->cycles = 2;
+    if(!decimal || v == RICOH) ref_binary(sbc, a, b, c, r);
+    else ref_decimal(v, sbc, a, b, c, r);
+    if(decimal && v == CMOS) r->cycles++;
+}
+
+static void run(emu6502_t *e, int sbc, int decimal, uint8_t a, uint8_t b,
+                int c, result_t *r) {
+    emu6502_regs_t regs = {a, 0, 0, 0xff, (decimal ? D : 0) | (c ? C : 0)
+                                          | 0x30, 0x0200};
+    uint64_t start;
+
+    emu6502_write(e, 0x0200, sbc ? 0xe9 : 0x69);
+    emu6502_write(e, 0x0201, b);
+    emu6502_set_regs(e, &regs);
+    start = emu6502_cycles(e);
+    (void)emu6502_step(e);
+    emu6502_get_regs(e, &regs);
+    r->a = regs.a;
+    r->p = regs.p & (N|V|Z|C);
+    r->cycles = emu6502_cycles(e) - start;
+}
+
+int main(void) {
+    static const struct {
+        const char *name;
+        enum variant v;
+        unsigned flags;
+    } variants[] = {
+        {"nmos", NMOS, 0},
+        {"65c02", CMOS, EMU6502_CPU_65C02},
+        {"2a03", RICOH, EMU6502_CPU_2A03},
+    };
+    unsigned i, bus, sbc, decimal, c, a, b, failed = 0;
+
+    for(i = 0; i < sizeof variants / sizeof *variants; ++i)
+    for(bus = 0; bus < 2; ++bus) {
+        emu6502_t *e = emu6502_new(variants[i].flags
+                                   | (bus ? EMU6502_BUS_ACCURATE : 0));
+        if(!e) {
+            fprintf(stderr, "[Error] Out of memory\n");
+            return EXIT_FAILURE;
+        }
+        for(sbc = 0; sbc < 2; ++sbc)
+        for(decimal = 0; decimal < 2; ++decimal)
+        for(c = 0; c < 2; ++c)
+        for(a = 0; a < 0x100; ++a)
+        for(b = 0; b < 0x100; ++b) {
+            result_t want, got;
+            reference(variants[i].v, sbc, decimal, a, b, c, &want);
+            run(e, sbc, decimal, a, b, c, &got);
+            if(want.a == got.a && want.p == got.p
+               && want.cycles == got.cycles) continue;
+            if(++failed <= 10)
+                fprintf(stderr, "%s%s: %s $%02x, $%02x, C=%u, D=%u: "
+                        "A=$%02x P=$%02x %u cycles, expected A=$%02x P=$%02x "
+                        "%u cycles\n", variants[i].name, bus ? " (bus)" : "",
+                        sbc ? "SBC" : "ADC", a, b, c, decimal, got.a, got.p,
+                        got.cycles, want.a, want.p, want.cycles);
+        }
+        emu6502_free(e);
+    }
+    if(failed) {
+        fprintf(stderr, "%u cases failed\n", failed);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+#include <emu6502/emu6502.h>
+#include <emu6502/cpu.h>
+#include <emu6502/decoding.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The decoding table of every variant against the opcode matrices of the
+ * chips, then every opcode that doesn't leave the code run on both
+ * engines: its length, its cycles and whether it leaves the flags alone.
+ *
+ * The matrices give mnemonic, addressing mode and base cycles. The NMOS
+ * one includes the undocumented opcodes under their usual names, the
+ * 65C02 one is the WDC part, with the Rockwell bit instructions and its
+ * unused opcodes as NOPs of the length and time they take. $02 is the HLE
+ * trap on every variant, see hle.c. */
+
+static const char *const matrix_nmos[16] = {
+    "BRK i 7|ORA (zp,x) 6|HLE i 2|SLO (zp,x) 8|NOP zp 3|ORA zp 3|ASL zp 5|SLO zp 5|PHP i 3|ORA # 2|ASL A 2|ANC # 2|NOP a 4|ORA a 4|ASL a 6|SLO a 6",
+    "BPL r 2|ORA (zp),y 5|JAM i 2|SLO (zp),y 8|NOP zp,x 4|ORA zp,x 4|ASL zp,x 6|SLO zp,x 6|CLC i 2|ORA a,y 4|NOP i 2|SLO a,y 7|NOP a,x 4|ORA a,x 4|ASL a,x 7|SLO a,x 7",
+    "JSR a 6|AND (zp,x) 6|JAM i 2|RLA (zp,x) 8|BIT zp 3|AND zp 3|ROL zp 5|RLA zp 5|PLP i 4|AND # 2|ROL A 2|ANC # 2|BIT a 4|AND a 4|ROL a 6|RLA a 6",
+    "BMI r 2|AND (zp),y 5|JAM i 2|RLA (zp),y 8|NOP zp,x 4|AND zp,x 4|ROL zp,x 6|RLA zp,x 6|SEC i 2|AND a,y 4|NOP i 2|RLA a,y 7|NOP a,x 4|AND a,x 4|ROL a,x 7|RLA a,x 7",
+    "RTI i 6|EOR (zp,x) 6|JAM i 2|SRE (zp,x) 8|NOP zp 3|EOR zp 3|LSR zp 5|SRE zp 5|PHA i 3|EOR # 2|LSR A 2|ALR # 2|JMP a 3|EOR a 4|LSR a 6|SRE a 6",
+    "BVC r 2|EOR (zp),y 5|JAM i 2|SRE (zp),y 8|NOP zp,x 4|EOR zp,x 4|LSR zp,x 6|SRE zp,x 6|CLI i 2|EOR a,y 4|NOP i 2|SRE a,y 7|NOP a,x 4|EOR a,x 4|LSR a,x 7|SRE a,x 7",
+    "RTS i 6|ADC (zp,x) 6|JAM i 2|RRA (zp,x) 8|NOP zp 3|ADC zp 3|ROR zp 5|RRA zp 5|PLA i 4|ADC # 2|ROR A 2|ARR # 2|JMP (a) 5|ADC a 4|ROR a 6|RRA a 6",
+    "BVS r 2|ADC (zp),y 5|JAM i 2|RRA (zp),y 8|NOP zp,x 4|ADC zp,x 4|ROR zp,x 6|RRA zp,x 6|SEI i 2|ADC a,y 4|NOP i 2|RRA a,y 7|NOP a,x 4|ADC a,x 4|ROR a,x 7|RRA a,x 7",
+    "NOP # 2|STA (zp,x) 6|NOP # 2|SAX (zp,x) 6|STY zp 3|STA zp 3|STX zp 3|SAX zp 3|DEY i 2|NOP # 2|TXA i 2|ANE # 2|STY a 4|STA a 4|STX a 4|SAX a 4",
+    "BCC r 2|STA (zp),y 6|JAM i 2|SHA (zp),y 6|STY zp,x 4|STA zp,x 4|STX zp,y 4|SAX zp,y 4|TYA i 2|STA a,y 5|TXS i 2|TAS a,y 5|SHY a,x 5|STA a,x 5|SHX a,y 5|SHA a,y 5",
+    "LDY # 2|LDA (zp,x) 6|LDX # 2|LAX (zp,x) 6|LDY zp 3|LDA zp 3|LDX zp 3|LAX zp 3|TAY i 2|LDA # 2|TAX i 2|LXA # 2|LDY a 4|LDA a 4|LDX a 4|LAX a 4",
+    "BCS r 2|LDA (zp),y 5|JAM i 2|LAX (zp),y 5|LDY zp,x 4|LDA zp,x 4|LDX zp,y 4|LAX zp,y 4|CLV i 2|LDA a,y 4|TSX i 2|LAS a,y 4|LDY a,x 4|LDA a,x 4|LDX a,y 4|LAX a,y 4",
+    "CPY # 2|CMP (zp,x) 6|NOP # 2|DCP (zp,x) 8|CPY zp 3|CMP zp 3|DEC zp 5|DCP zp 5|INY i 2|CMP # 2|DEX i 2|SBX # 2|CPY a 4|CMP a 4|DEC a 6|DCP a 6",
+    "BNE r 2|CMP (zp),y 5|JAM i 2|DCP (zp),y 8|NOP zp,x 4|CMP zp,x 4|DEC zp,x 6|DCP zp,x 6|CLD i 2|CMP a,y 4|NOP i 2|DCP a,y 7|NOP a,x 4|CMP a,x 4|DEC a,x 7|DCP a,x 7",
+    "CPX # 2|SBC (zp,x) 6|NOP # 2|ISC (zp,x) 8|CPX zp 3|SBC zp 3|INC zp 5|ISC zp 5|INX i 2|SBC # 2|NOP i 2|SBC # 2|CPX a 4|SBC a 4|INC a 6|ISC a 6",
+    "BEQ r 2|SBC (zp),y 5|JAM i 2|ISC (zp),y 8|NOP zp,x 4|SBC zp,x 4|INC zp,x 6|ISC zp,x 6|SED i 2|SBC a,y 4|NOP i 2|ISC a,y 7|NOP a,x 4|SBC a,x 4|INC a,x 7|ISC a,x 7",
+};
+
+static const char *const matrix_65c02[16] = {
+    "BRK i 7|ORA (zp,x) 6|HLE i 2|NOP i 1|TSB zp 5|ORA zp 3|ASL zp 5|RMB zp 5|PHP i 3|ORA # 2|ASL A 2|NOP i 1|TSB a 6|ORA a 4|ASL a 6|BBR zp,r 5",
+    "BPL r 2|ORA (zp),y 5|ORA (zp) 5|NOP i 1|TRB zp 5|ORA zp,x 4|ASL zp,x 6|RMB zp 5|CLC i 2|ORA a,y 4|INC A 2|NOP i 1|TRB a 6|ORA a,x 4|ASL a,x 6|BBR zp,r 5",
+    "JSR a 6|AND (zp,x) 6|NOP # 2|NOP i 1|BIT zp 3|AND zp 3|ROL zp 5|RMB zp 5|PLP i 4|AND # 2|ROL A 2|NOP i 1|BIT a 4|AND a 4|ROL a 6|BBR zp,r 5",
+    "BMI r 2|AND (zp),y 5|AND (zp) 5|NOP i 1|BIT zp,x 4|AND zp,x 4|ROL zp,x 6|RMB zp 5|SEC i 2|AND a,y 4|DEC A 2|NOP i 1|BIT a,x 4|AND a,x 4|ROL a,x 6|BBR zp,r 5",
+    "RTI i 6|EOR (zp,x) 6|NOP # 2|NOP i 1|NOP zp 3|EOR zp 3|LSR zp 5|RMB zp 5|PHA i 3|EOR # 2|LSR A 2|NOP i 1|JMP a 3|EOR a 4|LSR a 6|BBR zp,r 5",
+    "BVC r 2|EOR (zp),y 5|EOR (zp) 5|NOP i 1|NOP zp,x 4|EOR zp,x 4|LSR zp,x 6|RMB zp 5|CLI i 2|EOR a,y 4|PHY i 3|NOP i 1|NOP a 8|EOR a,x 4|LSR a,x 6|BBR zp,r 5",
+    "RTS i 6|ADC (zp,x) 6|NOP # 2|NOP i 1|STZ zp 3|ADC zp 3|ROR zp 5|RMB zp 5|PLA i 4|ADC # 2|ROR A 2|NOP i 1|JMP (a) 6|ADC a 4|ROR a 6|BBR zp,r 5",
+    "BVS r 2|ADC (zp),y 5|ADC (zp) 5|NOP i 1|STZ zp,x 4|ADC zp,x 4|ROR zp,x 6|RMB zp 5|SEI i 2|ADC a,y 4|PLY i 4|NOP i 1|JMP (a,x) 6|ADC a,x 4|ROR a,x 6|BBR zp,r 5",
+    "BRA r 3|STA (zp,x) 6|NOP # 2|NOP i 1|STY zp 3|STA zp 3|STX zp 3|SMB zp 5|DEY i 2|BIT # 2|TXA i 2|NOP i 1|STY a 4|STA a 4|STX a 4|BBS zp,r 5",
+    "BCC r 2|STA (zp),y 6|STA (zp) 5|NOP i 1|STY zp,x 4|STA zp,x 4|STX zp,y 4|SMB zp 5|TYA i 2|STA a,y 5|TXS i 2|NOP i 1|STZ a 4|STA a,x 5|STZ a,x 5|BBS zp,r 5",
+    "LDY # 2|LDA (zp,x) 6|LDX # 2|NOP i 1|LDY zp 3|LDA zp 3|LDX zp 3|SMB zp 5|TAY i 2|LDA # 2|TAX i 2|NOP i 1|LDY a 4|LDA a 4|LDX a 4|BBS zp,r 5",
+    "BCS r 2|LDA (zp),y 5|LDA (zp) 5|NOP i 1|LDY zp,x 4|LDA zp,x 4|LDX zp,y 4|SMB zp 5|CLV i 2|LDA a,y 4|TSX i 2|NOP i 1|LDY a,x 4|LDA a,x 4|LDX a,y 4|BBS zp,r 5",
+    "CPY # 2|CMP (zp,x) 6|NOP # 2|NOP i 1|CPY zp 3|CMP zp 3|DEC zp 5|SMB zp 5|INY i 2|CMP # 2|DEX i 2|WAI i 3|CPY a 4|CMP a 4|DEC a 6|BBS zp,r 5",
+    "BNE r 2|CMP (zp),y 5|CMP (zp) 5|NOP i 1|NOP zp,x 4|CMP zp,x 4|DEC zp,x 6|SMB zp 5|CLD i 2|CMP a,y 4|PHX i 3|STP i 3|NOP a 4|CMP a,x 4|DEC a,x 7|BBS zp,r 5",
+    "CPX # 2|SBC (zp,x) 6|NOP # 2|NOP i 1|CPX zp 3|SBC zp 3|INC zp 5|SMB zp 5|INX i 2|SBC # 2|NOP i 2|NOP i 1|CPX a 4|SBC a 4|INC a 6|BBS zp,r 5",
+    "BEQ r 2|SBC (zp),y 5|SBC (zp) 5|NOP i 1|NOP zp,x 4|SBC zp,x 4|INC zp,x 6|SMB zp 5|SED i 2|SBC a,y 4|PLX i 4|NOP i 1|NOP a 4|SBC a,x 4|INC a,x 7|BBS zp,r 5",
+};
+
+typedef struct ref {
+    char type[4], mode[8];
+    unsigned cycles;
+} ref_t;
+
+/* instructions that set no flag */
+static const char *const flag_neutral[] = {
+    "STA", "STX", "STY", "STZ", "SAX", "SHA", "SHX", "SHY", "TAS", "NOP",
+    "PHA", "PHP", "PHX", "PHY", "TXS", "RMB", "SMB", "BBR", "BBS", "BRA",
+    "BPL", "BMI", "BVC", "BVS", "BCC", "BCS", "BNE", "BEQ",
+};
+
+/* ones that leave the code at hand or stop the CPU */
+static const char *const control[] = {
+    "BRK", "JSR", "RTS", "RTI", "JMP", "JAM", "HLE", "STP", "WAI",
+};
+
+static int listed(const char *type, const char *const *list, size_t n) {
+    size_t i;
+    for(i = 0; i < n; ++i)
+        if(!strcmp(list[i], type)) return 1;
+    return 0;
+}
+
+static void parse(const char *const matrix[16], ref_t ref[0x100]) {
+    unsigned row, op = 0;
+    for(row = 0; row < 16; ++row) {
+        const char *s = matrix[row];
+        int n;
+        while(sscanf(s, "%3s %7s %u%n", ref[op].type, ref[op].mode,
+                     &ref[op].cycles, &n) == 3) {
+            op++;
+            s += n;
+            if(*s == '|') s++;
+        }
+    }
+}
+
+static unsigned mode_len(const char *mode) {
+    if(!strcmp(mode, "i") || !strcmp(mode, "A")) return 1;
+    if(mode[0] == 'a' || !strcmp(mode, "(a)") || !strcmp(mode, "(a,x)")
+       || !strcmp(mode, "zp,r")) return 3;
+    return 2;
+}
+
+static unsigned check_table(const cpu_variant_t *v, const ref_t ref[0x100]) {
+    unsigned op, failed = 0;
+    for(op = 0; op < 0x100; ++op) {
+        const char *type = instr_type_str(v->table[op].type);
+        const char *mode = instr_mode_str(v->table[op].mode);
+        if(!strcmp(type, ref[op].type) && !strcmp(mode, ref[op].mode)
+           && v->cycles[op] == ref[op].cycles) continue;
+        fprintf(stderr, "%s: $%02x is %s %s %u, expected %s %s %u\n",
+                v->name, op, type, mode, v->cycles[op], ref[op].type,
+                ref[op].mode, ref[op].cycles);
+        failed++;
+    }
+    return failed;
+}
+
+/* run op at $0200 with its operand pointing at $0310, or through $10 at
+ * $0320, and flags p */
+static unsigned check_run(emu6502_t *e, const char *name, int bus,
+                          unsigned op, const ref_t *ref, uint8_t p) {
+    emu6502_regs_t regs = {0x55, 0, 0, 0xff, p, 0x0200};
+    unsigned len = mode_len(ref->mode), branch, cycles, failed = 0;
+    uint64_t start;
+
+    emu6502_write(e, 0x0010, 0x20);
+    emu6502_write(e, 0x0011, 0x03);
+    emu6502_write(e, 0x0200, op);
+    emu6502_write(e, 0x0201, 0x10);
+    emu6502_write(e, 0x0202, !strcmp(ref->mode, "zp,r") ? 0x00 : 0x03);
+    if(!strcmp(ref->mode, "r")) emu6502_write(e, 0x0201, 0x00);
+    emu6502_set_regs(e, &regs);
+    start = emu6502_cycles(e);
+    (void)emu6502_step(e);
+    emu6502_get_regs(e, &regs);
+    cycles = emu6502_cycles(e) - start;
+    branch = !strcmp(ref->mode, "r") || !strcmp(ref->mode, "zp,r");
+
+    if(regs.pc != 0x0200 + len) {
+        fprintf(stderr, "%s%s: $%02x (%s %s) left pc at $%04x, expected "
+                "$%04x\n", name, bus ? " (bus)" : "", op, ref->type,
+                ref->mode, regs.pc, 0x0200 + len);
+        failed++;
+    }
+    /* taken branches take longer on the bus */
+    if(cycles != ref->cycles && !(bus && branch)) {
+        fprintf(stderr, "%s%s: $%02x (%s %s) took %u cycles, expected %u\n",
+                name, bus ? " (bus)" : "", op, ref->type, ref->mode, cycles,
+                ref->cycles);
+        failed++;
+    }
+    if(listed(ref->type, flag_neutral, sizeof flag_neutral
+                                       / sizeof *flag_neutral)
+       && regs.p != p) {
+        fprintf(stderr, "%s%s: $%02x (%s %s) changed P from $%02x to $%02x\n",
+                name, bus ? " (bus)" : "", op, ref->type, ref->mode, p,
+                regs.p);
+        failed++;
+    }
+    return failed;
+}
+
+int main(void) {
+    static const struct {
+        const cpu_variant_t *v;
+        const char *const *matrix;
+        unsigned flags;
+    } variants[] = {
+        {&cpu_nmos, matrix_nmos, 0},
+        {&cpu_65c02, matrix_65c02, EMU6502_CPU_65C02},
+        {&cpu_2a03, matrix_nmos, EMU6502_CPU_2A03},
+    };
+    static const uint8_t flags[] = {0x30, 0xf3};
+    unsigned i, bus, op, k, failed = 0;
+
+    for(i = 0; i < sizeof variants / sizeof *variants; ++i) {
+        ref_t ref[0x100];
+        parse(variants[i].matrix, ref);
+        failed += check_table(variants[i].v, ref);
+        for(bus = 0; bus < 2; ++bus) {
+            emu6502_t *e = emu6502_new(variants[i].flags
+                                       | (bus ? EMU6502_BUS_ACCURATE : 0));
+            if(!e) {
+                fprintf(stderr, "[Error] Out of memory\n");
+                return EXIT_FAILURE;
+            }
+            for(op = 0; op < 0x100; ++op) {
+                if(listed(ref[op].type, control,
+                          sizeof control / sizeof *control)) continue;
+                for(k = 0; k < sizeof flags; ++k)
+                    failed += check_run(e, variants[i].v->name, bus, op,
+                                        &ref[op], flags[k]);
+            }
+            emu6502_free(e);
+        }
+    }
+    if(failed) {
+        fprintf(stderr, "%u checks failed\n", failed);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}